@@ -0,0 +1,385 @@
+// palette-indexed animation - GIF and APNG of decoded frames
+// pixels are mapped to palette indices exactly (BK frames have 4 colors, UKNC 16,
+// show_sync adds a few), no quantization; every frame stores only the rectangle
+// changed since the previous one, repeated frames just make previous one last longer
+// (used by fx2vid.h for VID_GIF / VID_APNG)
+
+#ifndef FX2ANIM_H
+#define FX2ANIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include "fx2img.h"
+
+#define ANIM_GIF        0
+#define ANIM_APNG       1
+
+#define ANIM_FPS        50          // frame rate of both machines
+#define ANIM_MAXCOL     256
+
+struct anim_rect {
+    int       x, y, w, h;           // in source lines
+};
+
+struct anim_state {
+    FILE*     f;
+    int       format;
+    int       width;
+    int       height;
+    int       sy;                   // every line repeated sy times
+    uint32_t  pal[ANIM_MAXCOL];     // colors in order of appearance
+    int       pal_n;
+    int       gct_n;                // (gif) colors in global table
+    uint32_t  last_rgb;             // mapping cache
+    uint8_t   last_idx;
+    uint8_t*  pend;                 // frame waiting to be written (indices)
+    uint8_t*  next;                 // frame being mapped
+    anim_rect pend_rect;            // its changed rectangle
+    uint32_t  pend_delay;           // its duration in frames
+    uint32_t  frames;               // frames written to file
+    uint32_t  apng_seq;             // (apng) fcTL/fdAT sequence number
+    long      actl_pos;             // (apng) where acTL and PLTE are, patched on close
+    long      plte_pos;
+    std::vector<uint8_t> buf;       // rectangle pixels
+    std::vector<uint8_t> out;       // encoded data
+    int       error;
+};
+
+
+// (helper) color -> palette index, new colors are appended
+static inline uint8_t anim_index (anim_state* a, uint32_t rgb)
+{
+    if (rgb == a->last_rgb) return a->last_idx;
+    int i = 0;
+    while (i < a->pal_n && a->pal[i] != rgb) i++;
+    if (i == a->pal_n) {
+        if (a->pal_n == ANIM_MAXCOL) i = 0;     // can't happen with decoder colors
+        else a->pal[a->pal_n++] = rgb;
+    }
+    a->last_rgb = rgb;
+    a->last_idx = (uint8_t)i;
+    return (uint8_t)i;
+}
+
+// (helper) bits needed for palette of n colors
+static int anim_bits (int n)
+{
+    int b = 1;
+    while ((1 << b) < n) b++;
+    return b;
+}
+
+// (helper) rectangle where frames a and b differ, returns 0 if they are the same
+static int anim_diff (const uint8_t* a, const uint8_t* b, int w, int h, anim_rect* r)
+{
+    int y0 = 0, y1 = h - 1;
+    while (y0 < h && memcmp(a + y0*w, b + y0*w, w) == 0) y0++;
+    if (y0 == h) return 0;
+    while (y1 > y0 && memcmp(a + y1*w, b + y1*w, w) == 0) y1--;
+    int x0 = w, x1 = -1;
+    for (int y=y0; y<=y1; y++) {
+        const uint8_t* p = a + y*w;
+        const uint8_t* q = b + y*w;
+        int l = 0, rr = w - 1;
+        while (l < w && p[l] == q[l]) l++;
+        if (l == w) continue;
+        while (rr > l && p[rr] == q[rr]) rr--;
+        if (l < x0) x0 = l;
+        if (rr > x1) x1 = rr;
+    }
+    r->x = x0; r->w = x1 - x0 + 1;
+    r->y = y0; r->h = y1 - y0 + 1;
+    return 1;
+}
+
+// (helper) copy rectangle of frame to a->buf, lines repeated sy times,
+// optionally with png filter byte (0) in front of every line
+static void anim_take_rect (anim_state* a, const uint8_t* frame, const anim_rect* r, int filter)
+{
+    int row = r->w + (filter ? 1 : 0);
+    a->buf.resize((size_t)row * r->h * a->sy);
+    uint8_t* dst = &a->buf[0];
+    for (int y=0; y<r->h; y++) {
+        for (int k=0; k<a->sy; k++) {
+            if (filter) *dst++ = 0;
+            memcpy(dst, frame + (r->y + y)*a->width + r->x, r->w);
+            dst += r->w;
+        }
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// GIF
+////////////////////////////////////////////////////////////////////////////////
+
+struct gif_lzw {
+    std::vector<uint8_t>* o;
+    uint32_t  acc;
+    int       cnt;
+    int       size;                 // current code size
+    uint32_t  next;                 // next code to assign
+    int32_t   key[8192];            // hash of (prefix << 8 | pixel) -> code
+    uint16_t  val[8192];
+};
+
+static inline void gif_put (gif_lzw* z, uint32_t code)
+{
+    z->acc |= code << z->cnt;
+    z->cnt += z->size;
+    while (z->cnt >= 8) {
+        z->o->push_back(z->acc & 0xFF);
+        z->acc >>= 8;
+        z->cnt -= 8;
+    }
+}
+
+// lzw stream of indices, returns data split to sub-blocks in o
+static void gif_encode (const uint8_t* p, size_t len, int min_size, std::vector<uint8_t>& o)
+{
+    std::vector<uint8_t> raw;
+    raw.reserve(len / 4 + 16);
+    gif_lzw* z = new gif_lzw;
+    uint32_t clear = 1u << min_size;
+    z->o = &raw;
+    z->acc = 0;
+    z->cnt = 0;
+    z->size = min_size + 1;
+    z->next = clear + 2;
+    memset(z->key, 0xFF, sizeof(z->key));
+    gif_put(z, clear);
+    uint32_t prefix = p[0];
+    for (size_t i=1; i<len; i++) {
+        int32_t k = (int32_t)((prefix << 8) | p[i]);
+        uint32_t h = ((uint32_t)k * 2654435761u) >> 19;
+        while (z->key[h] >= 0 && z->key[h] != k) h = (h + 1) & 8191;
+        if (z->key[h] == k) { prefix = z->val[h]; continue; }
+        if (z->next > (1u << z->size) && z->size < 12) z->size++;
+        gif_put(z, prefix);
+        if (z->next < 4096) {
+            z->key[h] = k;
+            z->val[h] = (uint16_t)z->next++;
+        } else {
+            // table is full - start over
+            gif_put(z, clear);
+            z->size = min_size + 1;
+            z->next = clear + 2;
+            memset(z->key, 0xFF, sizeof(z->key));
+        }
+        prefix = p[i];
+    }
+    if (z->next > (1u << z->size) && z->size < 12) z->size++;
+    gif_put(z, prefix);
+    if (z->next + 1 > (1u << z->size) && z->size < 12) z->size++;
+    gif_put(z, clear + 1);
+    if (z->cnt > 0) raw.push_back(z->acc & 0xFF);
+    delete z;
+    o.clear();
+    o.push_back(min_size);
+    for (size_t i=0; i<raw.size(); i+=255) {
+        size_t n = (raw.size() - i < 255) ? raw.size() - i : 255;
+        o.push_back((uint8_t)n);
+        o.insert(o.end(), raw.begin() + i, raw.begin() + i + n);
+    }
+    o.push_back(0);
+}
+
+// (helper) color table of n entries (power of 2), unused ones black
+static void gif_palette (anim_state* a, int n, std::vector<uint8_t>& o)
+{
+    for (int i=0; i<n; i++) {
+        uint32_t c = (i < a->pal_n) ? a->pal[i] : 0;
+        o.push_back((c >> 16) & 0xFF); o.push_back((c >> 8) & 0xFF); o.push_back(c & 0xFF);
+    }
+}
+
+static void gif_write_frame (anim_state* a)
+{
+    std::vector<uint8_t> o;
+    if (a->frames == 0) {
+        // header, logical screen with global color table, endless loop
+        a->gct_n = a->pal_n;
+        int bits = anim_bits(a->pal_n);
+        const char* sig = "GIF89a";
+        o.insert(o.end(), sig, sig + 6);
+        img_le16(o, a->width); img_le16(o, a->height * a->sy);
+        o.push_back(0x80 | ((bits-1) << 4) | (bits-1));
+        o.push_back(0); o.push_back(0);
+        gif_palette(a, 1 << bits, o);
+        static const uint8_t loop[19] = { 0x21, 0xFF, 0x0B, 'N','E','T','S','C','A','P','E','2','.','0', 3, 1, 0, 0, 0 };
+        o.insert(o.end(), loop, loop + 19);
+    }
+    // graphic control - delay in 1/100 s, keep previous frame under this one
+    uint32_t delay = a->pend_delay * 100 / ANIM_FPS;
+    o.push_back(0x21); o.push_back(0xF9); o.push_back(4);
+    o.push_back(1 << 2);
+    img_le16(o, delay > 0xFFFF ? 0xFFFF : delay);
+    o.push_back(0); o.push_back(0);
+    // image descriptor, local color table if palette grew since header
+    anim_rect* r = &a->pend_rect;
+    o.push_back(0x2C);
+    img_le16(o, r->x); img_le16(o, r->y * a->sy);
+    img_le16(o, r->w); img_le16(o, r->h * a->sy);
+    int bits = anim_bits(a->gct_n);
+    if (a->pal_n > a->gct_n) {
+        bits = anim_bits(a->pal_n);
+        o.push_back(0x80 | (bits-1));
+        gif_palette(a, 1 << bits, o);
+    } else {
+        o.push_back(0);
+    }
+    anim_take_rect(a, a->pend, r, 0);
+    gif_encode(&a->buf[0], a->buf.size(), bits < 2 ? 2 : bits, a->out);
+    o.insert(o.end(), a->out.begin(), a->out.end());
+    if (fwrite(&o[0], 1, o.size(), a->f) != o.size()) a->error = 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// APNG (8 bit indexed)
+////////////////////////////////////////////////////////////////////////////////
+
+// (helper) plte data - always 256 entries, rewritten on close when all colors are known
+static void apng_plte (anim_state* a, std::vector<uint8_t>& o)
+{
+    std::vector<uint8_t> pl;
+    gif_palette(a, ANIM_MAXCOL, pl);
+    png_chunk(o, "PLTE", &pl[0], (uint32_t)pl.size());
+}
+
+// (helper) actl data
+static void apng_actl (anim_state* a, std::vector<uint8_t>& o)
+{
+    std::vector<uint8_t> d;
+    img_be32(d, a->frames); img_be32(d, 0);
+    png_chunk(o, "acTL", &d[0], (uint32_t)d.size());
+}
+
+static void apng_write_frame (anim_state* a)
+{
+    std::vector<uint8_t> o;
+    if (a->frames == 0) {
+        static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+        o.insert(o.end(), sig, sig + 8);
+        std::vector<uint8_t> ihdr;
+        img_be32(ihdr, a->width); img_be32(ihdr, a->height * a->sy);
+        ihdr.push_back(8); ihdr.push_back(3); ihdr.push_back(0); ihdr.push_back(0); ihdr.push_back(0);
+        png_chunk(o, "IHDR", &ihdr[0], (uint32_t)ihdr.size());
+        a->actl_pos = ftell(a->f) + (long)o.size();
+        apng_actl(a, o);
+        a->plte_pos = ftell(a->f) + (long)o.size();
+        apng_plte(a, o);
+    }
+    anim_rect* r = &a->pend_rect;
+    std::vector<uint8_t> fc;
+    img_be32(fc, a->apng_seq++);
+    img_be32(fc, r->w); img_be32(fc, r->h * a->sy);
+    img_be32(fc, r->x); img_be32(fc, r->y * a->sy);
+    fc.push_back(a->pend_delay >> 8);               // delay - frames / 50 s
+    fc.push_back(a->pend_delay & 0xFF);
+    fc.push_back(0); fc.push_back(ANIM_FPS);
+    fc.push_back(0);                                // dispose none
+    fc.push_back(0);                                // blend source
+    png_chunk(o, "fcTL", &fc[0], (uint32_t)fc.size());
+    anim_take_rect(a, a->pend, r, 1);
+    a->out.clear();
+    if (a->frames > 0) img_be32(a->out, a->apng_seq++);
+    dfl_zlib(&a->buf[0], (uint32_t)a->buf.size(), r->w + 1, a->out);
+    png_chunk(o, a->frames == 0 ? "IDAT" : "fdAT", &a->out[0], (uint32_t)a->out.size());
+    if (fwrite(&o[0], 1, o.size(), a->f) != o.size()) a->error = 1;
+}
+
+// (helper) finish apng - iend, frames count and final palette
+static void apng_finish (anim_state* a)
+{
+    std::vector<uint8_t> o;
+    png_chunk(o, "IEND", NULL, 0);
+    if (fwrite(&o[0], 1, o.size(), a->f) != o.size()) a->error = 1;
+    o.clear();
+    apng_actl(a, o);
+    if (fseek(a->f, a->actl_pos, SEEK_SET) != 0 || fwrite(&o[0], 1, o.size(), a->f) != o.size()) a->error = 1;
+    o.clear();
+    apng_plte(a, o);
+    if (fseek(a->f, a->plte_pos, SEEK_SET) != 0 || fwrite(&o[0], 1, o.size(), a->f) != o.size()) a->error = 1;
+    fseek(a->f, 0, SEEK_END);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Frames
+////////////////////////////////////////////////////////////////////////////////
+
+// start animation on already opened file (apng needs it seekable), returns 0 if ok
+static int anim_open (anim_state* a, FILE* f, int format, int width, int height, int sy)
+{
+    a->f = f;
+    a->format = format;
+    a->width = width;
+    a->height = height;
+    a->sy = sy;
+    a->pal_n = 0;
+    a->gct_n = 0;
+    a->last_rgb = 0xFFFFFFFF;
+    a->pend_delay = 0;
+    a->frames = 0;
+    a->apng_seq = 0;
+    a->error = 0;
+    a->pend = (uint8_t*) malloc(width*height);
+    a->next = (uint8_t*) malloc(width*height);
+    if (a->pend == NULL || a->next == NULL) return 1;
+    if (format == ANIM_APNG && ftell(f) < 0) return 2;
+    return 0;
+}
+
+// (helper) write pending frame
+static void anim_flush (anim_state* a)
+{
+    if (a->pend_delay == 0) return;
+    if (a->format == ANIM_GIF) gif_write_frame(a);
+    else apng_write_frame(a);
+    a->frames++;
+    a->pend_delay = 0;
+}
+
+// add frame of 32-bit pixels (1/50 s long)
+static void anim_frame (anim_state* a, const uint32_t* pix)
+{
+    int n = a->width * a->height;
+    for (int i=0; i<n; i++) a->next[i] = anim_index(a, pix[i] & 0xFFFFFF);
+    anim_rect r = { 0, 0, a->width, a->height };
+    if (a->pend_delay > 0) {
+        if (!anim_diff(a->pend, a->next, a->width, a->height, &r)) {
+            if (a->pend_delay < 0x7FFF) { a->pend_delay++; return; }
+            // delay field is full - same picture goes on as 1 pixel frame
+            r.w = 1; r.h = 1;
+        }
+        anim_flush(a);
+    }
+    uint8_t* t = a->pend; a->pend = a->next; a->next = t;
+    a->pend_rect = r;
+    a->pend_delay = 1;
+}
+
+// write last frame and trailer (file is not closed)
+static void anim_close (anim_state* a)
+{
+    if (a->pend) {
+        anim_flush(a);
+        if (a->frames > 0) {
+            if (a->format == ANIM_GIF) {
+                if (fputc(0x3B, a->f) == EOF) a->error = 1;
+            } else {
+                apng_finish(a);
+            }
+        }
+    }
+    free(a->pend);
+    free(a->next);
+    a->pend = NULL;
+    a->next = NULL;
+}
+
+#endif
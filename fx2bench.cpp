@@ -0,0 +1,365 @@
+// compile:
+//   windows: cl /O2 /EHsc fx2bench.cpp
+//   linux:   g++ -O2 -pthread fx2bench.cpp -o fx2bench
+//
+// decoder throughput benchmark - every decoder variant over bundled captures
+// (test/bk_signal.bin, test/uknc_signal.bin) and large synthetic signals made of their
+// repeated fields, with warmup and repetitions; prints table, and one JSON object per
+// result line with -o (to compare between commits, -l tags lines with commit or label)
+//   fx2bench [captures...] [-o results.json|-] [-l label] [-r reps] [-w warmup] [-s synth_MB]
+//
+// variants (first is the reference, others must give same frames):
+//   scalar      dec_bytes over capture samples in usb sized chunks
+//   scalar_inv  same over inverted samples, as live usb data comes (inv 0xFF)
+//   rle         rle pairs fed directly to decoder (dec_run), as .rle/.fx2c replay does
+//   bw          scalar into black & white framebuffer format (dec_to_bw every frame, BK only)
+//   sync_scan   vsync scanner only, no pixels (lower bound of any decoder)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "fx2dec.h"
+#include "fx2cap.h"
+#include "fx2stat.h"
+
+#define BENCH_MIN_NS    300000000ull    // repeat small inputs to at least that
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Options
+////////////////////////////////////////////////////////////////////////////////
+
+    int   opt_reps = 5;             // -r, timed repetitions (at least)
+    int   opt_warmup = 1;           // -w, untimed runs first
+    int   opt_synth_mb = 64;        // -s, synthetic signal size, 0 - none
+    const char* opt_out = NULL;     // -o, JSON lines output
+    const char* opt_label = "";     // -l
+    std::vector<const char*> opt_inputs;
+
+    const char* mode_names[2] = { "BK", "UKNC" };
+
+
+void usage ()
+{
+    printf("usage: fx2bench [captures...] [options]\n"
+        "  (no captures)    test/bk_signal.bin test/uknc_signal.bin\n"
+        "  -o <file|->      results as JSON lines to file or stdout (table goes to stderr then)\n"
+        "  -l <label>       label of every result line (commit id ...)\n"
+        "  -r <reps>        timed repetitions (5, small inputs are repeated to 0.3 s at least)\n"
+        "  -w <runs>        warmup runs (1)\n"
+        "  -s <MB>          synthetic signal size made of each capture's field (64, 0 - none)\n");
+}
+
+// returns 0 if ok
+int parse_options (int argc, char** argv)
+{
+    for (int i=0; i<argc; i++) {
+        const char* a = argv[i];
+        if (strcmp(a, "-o") == 0 && i+1 < argc) {
+            opt_out = argv[++i];
+        } else if (strcmp(a, "-l") == 0 && i+1 < argc) {
+            opt_label = argv[++i];
+        } else if (strcmp(a, "-r") == 0 && i+1 < argc) {
+            opt_reps = atoi(argv[++i]);
+            if (opt_reps < 1) opt_reps = 1;
+        } else if (strcmp(a, "-w") == 0 && i+1 < argc) {
+            opt_warmup = atoi(argv[++i]);
+        } else if (strcmp(a, "-s") == 0 && i+1 < argc) {
+            opt_synth_mb = atoi(argv[++i]);
+        } else if (a[0] == '-') {
+            fprintf(stderr, "unknown option %s\n", a);
+            return 1;
+        } else {
+            opt_inputs.push_back(a);
+        }
+    }
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Inputs
+////////////////////////////////////////////////////////////////////////////////
+
+struct bench_input {
+    std::string name;
+    int       mode;
+    std::vector<uint8_t> raw;       // samples as in capture files
+    std::vector<uint8_t> inv;       // same inverted (live usb data)
+    std::vector<uint8_t> rle;       // rle pairs by RLE_BLOCK_RAW blocks
+    std::vector<uint32_t> rle_len;  // encoded length of every block (0 - stored)
+};
+
+// (helper) derived forms of samples
+static void bench_prepare (bench_input* in)
+{
+    size_t n = in->raw.size();
+    in->inv.resize(n);
+    for (size_t i=0; i<n; i++) in->inv[i] = in->raw[i] ^ 0xFF;
+    in->rle.resize(n);
+    in->rle_len.clear();
+    size_t o = 0;
+    for (size_t i=0; i<n; i+=RLE_BLOCK_RAW) {
+        uint32_t len = (n - i < RLE_BLOCK_RAW) ? (uint32_t)(n - i) : RLE_BLOCK_RAW;
+        uint32_t e = rle_encode(&in->raw[i], len, &in->rle[o]);
+        if (e == 0) memcpy(&in->rle[o], &in->raw[i], len);
+        in->rle_len.push_back(e);
+        o += e ? e : len;
+    }
+    in->rle.resize(o);
+}
+
+// load whole capture as samples, returns 0 if ok
+static int bench_load (bench_input* in, const char* fname)
+{
+    cap_reader c;
+    if (cap_open(&c, fname, -1) != 0) {
+        fprintf(stderr, "unable to open capture %s\n", fname);
+        return 1;
+    }
+    std::vector<uint8_t> chunk(RLE_BLOCK_RAW);
+    int n;
+    while ((n = cap_read(&c, chunk.data())) > 0) in->raw.insert(in->raw.end(), chunk.begin(), chunk.begin() + n);
+    cap_close(&c);
+    if (n < 0) {
+        fprintf(stderr, "broken block in %s\n", fname);
+        return 1;
+    }
+    in->name = fname;
+    in->mode = c.mode;
+    bench_prepare(in);
+    return 0;
+}
+
+// long signal repeating one field of capture (same as fx2tool synth), returns 0 if ok
+static int bench_synth (bench_input* out, const bench_input* in, uint64_t size)
+{
+    vs_scan vs;
+    memset(&vs, 0, sizeof(vs));
+    vs.mode = in->mode;
+    uint64_t pulses[2];
+    if (vs_scan_feed(&vs, in->raw.data(), (uint32_t)in->raw.size(), pulses, 2) < 2) return 1;
+    uint64_t field = pulses[1] - pulses[0];
+    const uint8_t* src = in->raw.data() + pulses[0] - dec_vsync_len(in->mode);
+    out->raw.clear();
+    out->raw.reserve((size_t)size);
+    while (out->raw.size() < size) {
+        uint64_t k = std::min<uint64_t>(size - out->raw.size(), field);
+        out->raw.insert(out->raw.end(), src, src + k);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "synth %s %uMB", mode_names[in->mode], (uint32_t)(size >> 20));
+    out->name = name;
+    out->mode = in->mode;
+    bench_prepare(out);
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Variants
+////////////////////////////////////////////////////////////////////////////////
+
+    uint64_t  bench_hash;           // frames hash of checking run
+    int       bench_hashing;
+
+// (callback) frame complete
+void bench_on_frame (dec_state* d, uint32_t n)
+{
+    if (d->palette == 0) dec_to_bw(d->bufs[n], d->full);
+    if (bench_hashing) bench_hash = hash64(d->bufs[n], d->full*sizeof(uint32_t), bench_hash);
+}
+
+// (helper) decoder back to power-on state
+static void bench_reset (dec_state* d, int palette)
+{
+    d->n_cur = 0;
+    d->seq = 0;
+    d->cur_addr = 0;
+    d->lsync_cnt = 0;
+    d->palette = (uint8_t)palette;
+    d->on_frame = bench_on_frame;
+    // first frame is partly left from previous run otherwise
+    if (bench_hashing) for (uint32_t i=0; i<d->nbuf; i++) memset(d->bufs[i], 0, SCR_MAXBUF*sizeof(uint32_t));
+}
+
+// run of one variant, returns frames decoded
+typedef uint32_t (*bench_fn)(dec_state* d, const bench_input* in);
+
+static uint32_t run_scalar (dec_state* d, const bench_input* in)
+{
+    bench_reset(d, 1);
+    size_t n = in->raw.size();
+    for (size_t i=0; i<n; i+=USB_CHUNK)
+        dec_bytes(d, &in->raw[i], (n - i < USB_CHUNK) ? (uint32_t)(n - i) : USB_CHUNK, 0);
+    return d->seq;
+}
+
+static uint32_t run_scalar_inv (dec_state* d, const bench_input* in)
+{
+    bench_reset(d, 1);
+    size_t n = in->inv.size();
+    for (size_t i=0; i<n; i+=USB_CHUNK)
+        dec_bytes(d, &in->inv[i], (n - i < USB_CHUNK) ? (uint32_t)(n - i) : USB_CHUNK, 0xFF);
+    return d->seq;
+}
+
+static uint32_t run_rle (dec_state* d, const bench_input* in)
+{
+    bench_reset(d, 1);
+    const uint8_t* p = in->rle.data();
+    size_t left = in->raw.size();
+    for (size_t b=0; b<in->rle_len.size(); b++) {
+        uint32_t raw_len = (left < RLE_BLOCK_RAW) ? (uint32_t)left : RLE_BLOCK_RAW;
+        uint32_t e = in->rle_len[b];
+        if (e) rle_feed(d, p, e);
+        else dec_bytes(d, p, raw_len, 0);
+        p += e ? e : raw_len;
+        left -= raw_len;
+    }
+    return d->seq;
+}
+
+static uint32_t run_bw (dec_state* d, const bench_input* in)
+{
+    if (in->mode != MODE_BK) return 0;
+    bench_reset(d, 0);
+    size_t n = in->raw.size();
+    for (size_t i=0; i<n; i+=USB_CHUNK)
+        dec_bytes(d, &in->raw[i], (n - i < USB_CHUNK) ? (uint32_t)(n - i) : USB_CHUNK, 0);
+    return d->seq;
+}
+
+static uint32_t run_sync_scan (dec_state*, const bench_input* in)
+{
+    vs_scan vs;
+    memset(&vs, 0, sizeof(vs));
+    vs.mode = in->mode;
+    uint64_t pulses[64];
+    uint32_t frames = 0;
+    size_t n = in->raw.size();
+    for (size_t i=0; i<n; i+=USB_CHUNK)
+        frames += vs_scan_feed(&vs, &in->raw[i], (n - i < USB_CHUNK) ? (uint32_t)(n - i) : USB_CHUNK, pulses, 64);
+    return frames;
+}
+
+    struct bench_variant {
+        const char* name;
+        bench_fn  fn;
+        int       same_frames;      // must give frames of reference (first variant)
+    };
+
+    bench_variant variants[] = {
+        { "scalar",     run_scalar,     1 },
+        { "scalar_inv", run_scalar_inv, 1 },
+        { "rle",        run_rle,        1 },
+        { "bw",         run_bw,         0 },
+        { "sync_scan",  run_sync_scan,  0 },
+    };
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+// time all variants over input, returns count of mismatching ones
+static int bench_input_run (const bench_input* in, dec_state* d, FILE* tab, FILE* json)
+{
+    dec_set_mode(d, in->mode);
+    size_t samples = in->raw.size();
+    fprintf(tab, "%s: %s, %llu samples (rle %.1f%%)\n", in->name.c_str(), mode_names[in->mode],
+        (unsigned long long)samples, samples ? in->rle.size()*100.0/samples : 0.0);
+    fprintf(tab, "  variant      frames   reps    best ms  median ms      MB/s  ns/sample  frames/s  check\n");
+    int errors = 0;
+    uint64_t ref_hash = 0;
+    for (size_t v=0; v<sizeof(variants)/sizeof(variants[0]); v++) {
+        const bench_variant* var = &variants[v];
+        // checking run (hashes every frame, not timed)
+        bench_hashing = 1;
+        bench_hash = 0;
+        uint32_t frames = var->fn(d, in);
+        bench_hashing = 0;
+        if (v == 0) ref_hash = bench_hash;
+        const char* check = "-";
+        if (var->same_frames) {
+            check = (bench_hash == ref_hash) ? "ok" : "MISMATCH";
+            if (bench_hash != ref_hash) errors++;
+        }
+        if (frames == 0 && var->fn == run_bw) {
+            fprintf(tab, "  %-10s  (BK only)\n", var->name);
+            continue;
+        }
+        for (int i=0; i<opt_warmup; i++) var->fn(d, in);
+        std::vector<uint64_t> times;
+        uint64_t total = 0;
+        while ((int)times.size() < opt_reps || (total < BENCH_MIN_NS && times.size() < 1000)) {
+            uint64_t t0 = time_ns();
+            var->fn(d, in);
+            uint64_t t = time_ns() - t0;
+            times.push_back(t);
+            total += t;
+        }
+        std::sort(times.begin(), times.end());
+        double best = (double)times[0], median = (double)times[times.size()/2];
+        double mbs = best > 0 ? samples * 1e3 / best : 0;
+        double ns_sample = samples ? best / samples : 0;
+        double fps = best > 0 ? frames * 1e9 / best : 0;
+        fprintf(tab, "  %-10s %7u %6u %10.3f %10.3f %9.0f %10.3f %9.0f  %s\n", var->name, frames,
+            (uint32_t)times.size(), best/1e6, median/1e6, mbs, ns_sample, fps, check);
+        if (json) {
+            fprintf(json, "{\"label\":\"%s\",\"input\":\"%s\",\"mode\":\"%s\",\"samples\":%llu,\"variant\":\"%s\","
+                "\"frames\":%u,\"reps\":%u,\"best_ns\":%.0f,\"median_ns\":%.0f,\"bytes_per_s\":%.0f,"
+                "\"ns_per_sample\":%.4f,\"frames_per_s\":%.1f,\"frames_hash\":\"%016llx\",\"check\":\"%s\"}\n",
+                opt_label, in->name.c_str(), mode_names[in->mode], (unsigned long long)samples, var->name,
+                frames, (uint32_t)times.size(), best, median, mbs * 1e6, ns_sample, fps,
+                (unsigned long long)bench_hash, check);
+        }
+    }
+    return errors;
+}
+
+int main (int argc, char** argv)
+{
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) { usage(); return 0; }
+    if (parse_options(argc-1, argv+1) != 0) { usage(); return 1; }
+    if (opt_inputs.empty()) {
+        opt_inputs.push_back("test/bk_signal.bin");
+        opt_inputs.push_back("test/uknc_signal.bin");
+    }
+    FILE* json = NULL;
+    FILE* tab = stdout;
+    if (opt_out) {
+        if (strcmp(opt_out, "-") == 0) {
+            json = stdout;
+            tab = stderr;
+        } else if ((json = fopen(opt_out, "w")) == NULL) {
+            fprintf(stderr, "unable to create %s\n", opt_out);
+            return 1;
+        }
+    }
+    dec_state d;
+    if (dec_init(&d, MODE_BK) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        return 1;
+    }
+    int errors = 0;
+    for (size_t i=0; i<opt_inputs.size(); i++) {
+        bench_input in;
+        if (bench_load(&in, opt_inputs[i]) != 0) { errors++; continue; }
+        errors += bench_input_run(&in, &d, tab, json);
+        if (opt_synth_mb > 0) {
+            bench_input syn;
+            if (bench_synth(&syn, &in, (uint64_t)opt_synth_mb << 20) != 0) {
+                fprintf(stderr, "less than two vsync pulses in %s, no synthetic signal\n", opt_inputs[i]);
+                continue;
+            }
+            errors += bench_input_run(&syn, &d, tab, json);
+        }
+    }
+    if (json && json != stdout) fclose(json);
+    dec_free(&d);
+    return errors ? 1 : 0;
+}
@@ -7,273 +7,137 @@
 #include <windows.h>
 #include <process.h>
 #include <stdio.h>
-#include "lib/libusb.h"
+#include "fx2usb.h"
+#include "fx2dec.h"
+#include "fx2stat.h"
+#include "fx2rec.h"
+#include "fx2vid.h"
+#include "fx2img.h"
+#include "fx2scale.h"
+#include "fx2pace.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+#include "fx2sig.h"
+#include "fx2cfg.h"
+#include "fx2flt.h"
+#include "fx2pre.h"
+#include <dwmapi.h>
 
 #pragma comment(lib, "lib/libusb-1.0.lib")
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "winmm.lib")
-
-#define MODE_BK         0
-#define MODE_UKNC       1
-
-#define B_SCR_WIDTH     0x00300     // (BK0011M) 768 pix clk in line
-#define B_SCR_HEIGHT    0x00140     // (BK0011M) 320 lines
-#define B_SCR_FULL      0x3C000     // (BK0011M) 245760 pix clk in full screen
-
-#define U_SCR_WIDTH     0x00320     // (UKNC) 800 pix clk in line
-#define U_SCR_HEIGHT    0x00138     // (UKNC) 312 lines
-#define U_SCR_FULL      0x3CF00     // (UKNC) 249600 pix clk in full screen
-
-#define SCR_MAXBUF      0x40000     // max from both full screens plus some extra
-
-#define TR_CHUNK_SIZE   0x20000     // chunk size for async data transferring from fx2
-// sigrok sources say it should hold 10ms of data (and be aligned with 0x200 bytes)
-
-#define VID 0x04B4                  // (0xFFFF:0x2048) for y-salnikov's)
-#define PID 0x8613                  // 
-#define ENDPOINT 0x82
-
-// protocol commands
-#define CMD_START                       0xB1
-#define CMD_START_FLAGS_INV_CLK         0x01
+#pragma comment(lib, "dwmapi.lib")
 
 
 ////////////////////////////////////////////////////////////////////////////////
 // Data
 ////////////////////////////////////////////////////////////////////////////////
 
-    libusb_device_handle* device_h = NULL;
-    const char* fw_filename = "fx2lafw-cypress-fx2.fw";
-
-    volatile uint32_t* scr_buffers[8];
-    volatile uint32_t  scr_n_cur     = 0;    
-    uint32_t  scr_cur_addr  = 0;
-    uint32_t  scr_lsync_cnt = 0;
-    uint8_t   scr_show_sync = 0;
-
-    int scr_mode   = MODE_BK;     // default mode to BK
-    int scr_width  = B_SCR_WIDTH;
-    int scr_height = B_SCR_HEIGHT;
-    int scr_full   = B_SCR_FULL;
-
-    int stop = 0;                   // encountered an error somewhere
-    int nactive = 0;                // active transfers count
-    int handled_count = 0;          // count of processed usb bulk transfers
-    int errors_count = 0;           // count of not processed
-
-    // BK palettes
-    uint8_t palette = 1;
-    uint32_t palette_data[] = {
-        0x000000, 0x0000FF, 0x00FF00, 0xFF0000, // 0 - (special) black/white palette
-        0x000000, 0x0000FF, 0x00FF00, 0xFF0000, // 1 - std palette 0
-        0x000000, 0xFFFF00, 0xFF00FF, 0xFF0000, // .. etc
-        0x000000, 0x00FFFF, 0x0000FF, 0xFF00FF,
-        0x000000, 0x00FF00, 0x00FFFF, 0xFFFF00,
-        0x000000, 0xFF00FF, 0x00FFFF, 0xFFFFFF,
-        0x000000, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,
-        0x000000, 0xC00000, 0x900000, 0xFF0000,
-        0x000000, 0xC0FF00, 0x90FF00, 0xFFFF00,
-        0x000000, 0xC000FF, 0x9000FF, 0xFF00FF,
-        0x000000, 0x90FF00, 0x9000FF, 0x900000,
-        0x000000, 0xC0FF00, 0xC000FF, 0xC00000,
-        0x000000, 0x00FFFF, 0xFFFF00, 0xFF0000,
-        0x000000, 0xFF0000, 0x00FF00, 0x00FFFF,
-        0x000000, 0x00FFFF, 0xFFFF00, 0xFFFFFF,
-        0x000000, 0xFFFF00, 0x00FF00, 0xFFFFFF,
-        0x000000, 0x00FFFF, 0x00FF00, 0xFFFFFF
-    };
-
-    // UKNC palette
-    uint32_t palette_uknc[16] = {
-        0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080, 0x008080, 0x808080,
-        0x000000, 0xFF0000, 0x00FF00, 0xFFFF00, 0x0000FF, 0xFF00FF, 0x00FFFF, 0xFFFFFF
-    };
-
-    char error[1024];
-
-
-////////////////////////////////////////////////////////////////////////////////
-// FX2 code
-////////////////////////////////////////////////////////////////////////////////
-
-// read/write FX2 RAM (0x40 - write, 0xC0 - read)
-int fx2_ram_readwrite ( uint16_t addr, uint8_t* buf, uint16_t length, uint8_t command )
-{
-    int chunk_size = 0x1000;
-    while (length > 0)
-    {
-        if (length < chunk_size) chunk_size = length;
-        int res = libusb_control_transfer(device_h, command, 0xA0, addr, 0, buf, chunk_size, 1000);
-        if (res < 0) {
-            sprintf(error, "0x%X (%s) unable to perform operation 0x%X with FX2 (0x%X, 0x%X)", 
-                res, libusb_error_name(res), 
-                command, addr, chunk_size);
-            return res;            
-        }
-        addr += chunk_size;
-        buf += chunk_size;
-        length -= chunk_size;
-    }
-    return 0;
-}
-
-// write data to FX2 RAM 
-int fx2_ram_write ( uint16_t addr, uint8_t* buf, uint16_t length )
-{
-    return fx2_ram_readwrite(addr, buf, length, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT);
-}
-
-// read data from FX2 RAM
-int fx2_ram_read ( uint16_t addr, uint8_t* buf, uint16_t length )
-{
-    return fx2_ram_readwrite(addr, buf, length, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN );
-}
-
-// put fx2 to stop or run (write 1 or 0 to address 0xE600)
-int fx2_reset(struct libusb_device_handle *hdl, int is_stop)
-{
-    uint8_t buf[1];
-    buf[0] = is_stop ? 1 : 0;
-    return fx2_ram_write(0xE600, buf, 1);
-}
+    dec_state dec;                  // decoder and screen buffers ring
+    uint64_t  scr_t_usb[DEC_MAXBUF];  // completion time of transfer which finished the buffer
+    uint64_t  scr_t_pub[DEC_MAXBUF];  // time when buffer was published
+    uint64_t  cur_t_usb;            // completion time of transfer being decoded now
+
+    rec_state rec;                  // raw signal recording
+    const char* rec_filename = "signal.bin";
+    const char* rec_idx_filename = "signal.fx2c";
+
+    pre_ring  pre;                  // last seconds of raw signal, saved on demand
+    int pre_seconds = 10;           // (config) 0 - off
+    int pre_memory = 32;            // (config) MB
+    int pre_rle = 1;                // (config) compressed, dumps are rle files
+
+    vid_state vid;                  // video recording
+    const char* vid_filename = "video.y4m";
+    const char* gif_filename = "video.gif";
+
+    scale_state scl;                // presentation kernel output
+    uint32_t* bw_pix;               // (render thread) black & white copy of frame being painted
+    int scr_scale = 1;              // integer scale (every line is doubled on top of it)
+    int scr_scanlines = 0;          // darken every second output line
+    pace_state pace;                // which frame to paint at every display refresh
+
+    // decoder and view settings as they are in config (applied when decoder is up)
+    int scr_mode = MODE_BK;
+    int scr_palette = 1;
+    int scr_show_sync = 0;
+    int scr_buffers = DEC_NBUF;
+    int scr_pacing = PACE_BUFFERED;
+    int scr_centering = 1;          // calibrate picture shift on start and mode switch
+    int scr_offset_x = 0;           // picture shift (last calibration or as set)
+    int scr_offset_y = 0;
+    int scr_noise = 0;              // temporal noise filter depth, 3 or 5 (0 - off)
+    flt_state flt;                  // (decoder thread) noise filter, follows scr_noise and mode
+    uint32_t flt_look;              // (decoder thread) palette and sync view its frames were made with
+    int usb_priority = THREAD_PRIORITY_ABOVE_NORMAL;
+    int render_priority = THREAD_PRIORITY_NORMAL;
+
+    img_job shot;                   // screenshot
+    uint64_t shot_t_pub;
+
+    char lat_text[1024];           // latency report text
+    met_dumper met;                 // metrics log
+    const char* met_filename = "metrics.json";
+    const char* trace_filename = "trace.json";
+    sig_state sig;                  // live signal analysis of sampled transfers
+    std::atomic<int> sig_active(0);
+    std::atomic<int> sig_in_feed(0);
+    char sig_text[4096];
 
-// send start acquisition control
-int fx2_send_start ()
-{
-    uint8_t cbuf[3] = {CMD_START_FLAGS_INV_CLK, 0, 0};
-    int res = libusb_control_transfer(device_h, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT, CMD_START, 0, 0, cbuf, 3, 100);
-    if (res < 0) {
-        sprintf(error, "0x%X (%s) unable to start fx2 data polling", res, libusb_error_name(res));
-        return res;
-    }
-    return 0;
-}
-
-// read acquisition data (not async)
-int fx2_data_read ( uint8_t* buf, uint32_t length)
-{
-    int res, readed;
-    res = libusb_bulk_transfer(device_h, ENDPOINT, buf, length, &readed, 1000);
-    if (res < 0) {
-        sprintf(error, "0x%X (%s) unable to read fx2 data", res, libusb_error_name(res));
-        return res;
-    }
-    return 0;
-}
-
-
-////////////////////////////////////////////////////////////////////////////////
-// USB code
-////////////////////////////////////////////////////////////////////////////////
-
-// close all without even checking for errors
-void usb_close ()
-{
-    if (device_h) { 
-        libusb_release_interface(device_h, 0); 
-        libusb_close(device_h);
-        // libusb_exit(NULL);
-        device_h = 0; 
-    }
-}
-
-// init libusb, find FX2 device etc.
-int usb_init (uint16_t vid, uint16_t pid)
-{
-    usb_close();
-    libusb_init(NULL);
-    // libusb_set_option(NULL, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);   
-    device_h = libusb_open_device_with_vid_pid(NULL, vid, pid);
-    if (device_h == NULL) {
-        sprintf(error, "can't find usb device with VID:PID %04x:%04x (or 0xFFFF:0x2048)", VID, PID);
-        return 1;
-    }
-	int res = libusb_set_configuration(device_h, 1);
-    if (res != 0) {
-		sprintf(error, "0x%X (%s) can't set device configuration 1", res, libusb_error_name(res));
-        return 2;
-    }
-    res = libusb_claim_interface(device_h, 0);
-    if (res != 0) {
-		sprintf(error, "0x%X (%s) can't claim interface 0", res, libusb_error_name(res));
-        return 3;
-    }
-    return 0;
-}
-
-// write firmware to fx2 device (restart it)
-int usb_write_firmware ()
-{
-    // init usb with standard VID:PID for fx2
-    int res = usb_init(VID, PID); // 04B4:8613
-    if (res != 0) {
-        // not found, lets try y-salnikov's modified (and we don't need to change firmware then)
-        if (res == 1) res = usb_init(0xFFFF, 0x2048);
-        if (res == 0) error[0] = 0x00;
-        return res;
-    }
-    // stop device
-    res = fx2_reset(device_h, 1);
-    if (res !=0) return res;
-    // read firmware file and try to write to device RAM
-    FILE* f = fopen(fw_filename, "rb");
-    if (f == NULL) {
-        sprintf(error, "unable to open firmware file %s", fw_filename);
-        return 1;
-    }
-    uint8_t* buf = (uint8_t*) malloc(0x2000);
-    fread(buf, 1, 0x2000, f);
-    res = fx2_ram_write(0, buf, 0x2000);
-    fclose(f);
-    free(buf);
-    if (res != 0) return res;
-    // start device then wait some to reinit usb
-    res = fx2_reset(device_h, 0);
-    if (res != 0) return res;
-    Sleep(3000);
-    // init with y-salnikov's now
-    return usb_init(0xFFFF, 0x2048);
-}
 
 void LIBUSB_CALL cb_transfer_complete (libusb_transfer *t);
-
-// init bulk transfer struct and send it
-int add_transfer()
-{
-    uint8_t *buf = (uint8_t *) malloc(TR_CHUNK_SIZE);
-    struct libusb_transfer *t = libusb_alloc_transfer(0);
-    libusb_fill_bulk_transfer(t, device_h, ENDPOINT, buf, TR_CHUNK_SIZE, cb_transfer_complete, (void*)1, 100);
-    int res = libusb_submit_transfer(t);
-    if (res < 0) {
-        sprintf(error, "0x%X (%s) unable to submit usb data transfer", res, libusb_error_name(res));
-        return res;
-    }
-    nactive++;
-    return 0;
-}
+void scr_on_frame (dec_state* d, uint32_t n);
 
 // process usb events thread
 DWORD WINAPI thread_usb_events (LPVOID lpParam)
 {
     struct timeval zero_tv = {0, 0};
+    met_thread("usb");
+    trace_thread("usb");
     while (stop == 0) {
         libusb_handle_events_timeout(NULL, &zero_tv);
     }
     return 0;
 }
 
+// decoder completed screen buffer n
+void scr_on_frame (dec_state* d, uint32_t n)
+{
+    // filter is set up again here when it is switched or frame size changes
+    int depth = (scr_noise == 3 || scr_noise == 5) ? scr_noise : 0;
+    if (depth != flt.depth || (depth && flt.full != (uint32_t)d->full)) {
+        flt_free(&flt);
+        if (flt_init(&flt, depth, d->full) != 0) flt_free(&flt);
+    }
+    // colors of older frames do not match after palette or sync view switch
+    uint32_t look = d->palette | (uint32_t)d->show_sync << 8;
+    if (look != flt_look) flt_reset(&flt);
+    flt_look = look;
+    flt_frame(&flt, d->bufs[n]);
+    scr_t_usb[n] = cur_t_usb;
+    scr_t_pub[n] = time_ns();
+    lat_add(LAT_PUBLISH, scr_t_pub[n] - cur_t_usb);
+    met_add(MET_FRAMES, 1);
+    met_hist(MET_H_PUBLISH, scr_t_pub[n] - cur_t_usb);
+    trace_instant("publish", d->seq);
+    pace_frame(&pace, d->seq, scr_t_pub[n]);
+}
+
 ////////////////////////////////////////
 // callback function for bulk transfer
 //////////////////////////////////////
 
 void LIBUSB_CALL cb_transfer_complete (libusb_transfer *t)
 {
+    uint64_t t_usb = time_ns();
     nactive--;
     if (t == NULL) return;
     if (stop) return;
     if (t->actual_length == 0) {
         // it can be timeout or whatever
+        met_add(MET_EMPTY, 1);
+        trace_instant("empty transfer");
         // if (++errors_count > 10) {
         //     sprintf(error, "too many empty transfers (successed=%i)", handled_count);
         //     stop = 1;
@@ -283,63 +147,43 @@ void LIBUSB_CALL cb_transfer_complete (libusb_transfer *t)
     } else {
         ++handled_count;
     }
-    // process pixel data
-    volatile uint32_t* screen_buf = scr_buffers[scr_n_cur];
-    for (int i=0; i<t->actual_length; i++)
-    {
-        // byte of data
-        uint8_t b = t->buffer[i] ^ 0xFF;
-        // filter it just in case
-        b = (scr_mode==MODE_BK ? (b & 0x13) : (b & 0x1F));
-        // color dword
-        uint32_t dw = (scr_mode==MODE_BK ? (palette_data[(palette<<2) | (b&3)]) : palette_uknc[b&0xF]);
-        // sync presence (taken inverted in UKNC)
-        bool have_sync = (scr_mode==MODE_BK ? (b == 0x10) : (b == 0x00));        
-        if (have_sync) {
-            if (scr_show_sync) dw = dw | 0x808080;
-            scr_lsync_cnt++;
-        } else {
-            // BK mode
-            if (scr_mode == MODE_BK)
-            {
-                // sort of hsync, exact 0x38 low sync signals
-                // seems BK is stable without using hsync (UKNC is not!)
-                //if (scr_lsync_cnt == 0x38) {
-                //    scr_cur_addr = 0x300 * (scr_cur_addr / 0x300);
-                //} else
-                // sort of vsync, exact 0x50 low sync signals
-                if (scr_lsync_cnt == 0x50) {
-                    scr_cur_addr = B_SCR_FULL - 0x38 - B_SCR_WIDTH*10; // for centering
-                }
-            // UKNC mode
-            } else {
-                // sort of hsync, exact 0x40 low sync signals
-                if (scr_lsync_cnt == 0x40) {
-                    scr_cur_addr = U_SCR_WIDTH * (scr_cur_addr / U_SCR_WIDTH);
-                } else
-                // sort of vsync, exact 0x20 low sync signals
-                // to be 100% sure - change to >=0xC0 and adjust current addr with another value
-                if (scr_lsync_cnt == 0x20) {
-                    scr_cur_addr = U_SCR_FULL - 0x40 - U_SCR_WIDTH*9; // for centering
-                }
-            }
-            scr_lsync_cnt = 0;
-        }
-        screen_buf[scr_cur_addr++] = dw;
-        if (scr_cur_addr >= scr_full) {
-            scr_cur_addr = 0;
-            scr_n_cur = ++scr_n_cur & 0x07;
-            screen_buf = scr_buffers[scr_n_cur];
+    static uint64_t t_prev_usb = 0;
+    if (t_prev_usb) met_hist(MET_H_INTERVAL, t_usb - t_prev_usb);
+    t_prev_usb = t_usb;
+    met_add(MET_TRANSFERS, 1);
+    met_add(MET_BYTES, t->actual_length);
+    trace_instant("transfer", t->actual_length);
+    // raw signal to disk (stored inverted, same as test/*.bin)
+    rec_push(&rec, t->buffer, t->actual_length, 0xFF);
+    pre_push(&pre, t->buffer, t->actual_length, 0xFF);
+    // signal quality of every Nth transfer
+    if (sig_active.load() && (handled_count & (SIG_LIVE_EVERY-1)) == 0) {
+        sig_in_feed = 1;
+        if (sig_active.load()) {
+            sig_gap(&sig);
+            sig_feed(&sig, t->buffer, t->actual_length, 0xFF);
         }
+        sig_in_feed = 0;
     }
+    // process pixel data
+    uint64_t t_dec = time_ns();
+    cur_t_usb = t_usb;
+    trace_begin("decode", t->actual_length);
+    dec_bytes(&dec, t->buffer, t->actual_length, 0xFF);
+    trace_end("decode");
+    lat_add(LAT_DECODE, time_ns() - t_dec);
+    met_hist(MET_H_DECODE, time_ns() - t_dec);
     // resubmit transfer
+    trace_begin("resubmit");
     int res = libusb_submit_transfer(t);
+    trace_end("resubmit");
     if (res < 0) {
         sprintf(error, "0x%X (%s) unable to submit usb data transfer", res, libusb_error_name(res));
         stop = 1;
     } else {
         nactive++;
     }
+    met_gauge(MET_G_TRANSFERS, nactive);
 }
 
 
@@ -354,19 +198,67 @@ void LIBUSB_CALL cb_transfer_complete (libusb_transfer *t)
     HINSTANCE       hMainInstance;
     HWND            hMain, hError;
     HFONT           hFont;
-    HMENU           hMenuMode, hMenuOptions/*, hMenuSavebin*/;
+    HMENU           hMenuMode, hMenuView, hMenuOptions/*, hMenuSavebin*/;
     HANDLE          hUsbThread, hRenderThread;
 
     int W_X  = 300;
     int W_Y  = 200;
-    int W_DX = scr_width;
-    int W_DY = scr_height*2;
+    int W_DX = B_SCR_WIDTH;
+    int W_DY = B_SCR_HEIGHT*2;
+
+    const char* cfg_filename = "fx2bk.cfg";
+    const int thread_priorities[] = { -15, -2, -1, 0, 1, 2, 15 };    // SetThreadPriority levels
+    const int noise_depths[] = { 0, 3, 5 };
+    cfg_item cfg_items[] = {
+        { "chunk_size",      0, &tr_chunk_size,   0x200, 0x400000, "usb transfer size, bytes (multiple of 512, about 10 ms of signal)", NULL, 0 },
+        { "transfers",       0, &tr_count,        1, 64,           "usb transfers in flight", NULL, 0 },
+        { "frame_buffers",   0, &scr_buffers,     4, DEC_MAXBUF,   "decoder screen buffers ring (power of 2)", NULL, 0 },
+        { "usb_priority",    0, &usb_priority,    -15, 15,         "usb thread priority (-2..2, -15 - idle, 15 - time critical)", thread_priorities, 0 },
+        { "render_priority", 0, &render_priority, -15, 15,         "render thread priority (-2..2, -15 - idle, 15 - time critical)", thread_priorities, 0 },
+        { "window_x",        CFG_STATE, &W_X,     -32000, 32000,   "window position", NULL, 0 },
+        { "window_y",        CFG_STATE, &W_Y,     -32000, 32000,   "window position", NULL, 0 },
+        { "mode",            CFG_STATE, &scr_mode, 0, 1,           "0 - BK0011M, 1 - UKNC", NULL, 0 },
+        { "palette",         CFG_STATE, &scr_palette, 0, 15,       "BK palette, 0 - black & white", NULL, 0 },
+        { "show_sync",       CFG_STATE, &scr_show_sync, 0, 1,      "show sync signal", NULL, 0 },
+        { "scale",           CFG_STATE, &scr_scale, 1, 3,          "window scale", NULL, 0 },
+        { "scanlines",       CFG_STATE, &scr_scanlines, 0, 1,      "darken every second line", NULL, 0 },
+        { "pacing",          CFG_STATE, &scr_pacing, 0, 1,         "0 - paint frames as they come (low latency), 1 - paced to display refresh", NULL, 0 },
+        { "centering",       0,         &scr_centering, 0, 1,      "1 - calibrate picture shift from signal on start, 0 - take offset_x/y as they are", NULL, 0 },
+        { "offset_x",        CFG_STATE, &scr_offset_x, -400, 400,  "picture shift right, pixel clocks", NULL, 0 },
+        { "offset_y",        CFG_STATE, &scr_offset_y, -160, 160,  "picture shift down, lines", NULL, 0 },
+        { "pre_seconds",     0,         &pre_seconds, 0, 87,       "raw signal kept in memory for 'save last seconds', seconds (0 - off)", NULL, 0 },
+        { "pre_memory",      0,         &pre_memory, 1, 1024,      "memory for it, MB (holds less than pre_seconds if signal does not fit)", NULL, 0 },
+        { "pre_rle",         0,         &pre_rle, 0, 1,            "1 - run length compressed in memory, saved as .rle, 0 - plain samples, .bin", NULL, 0 },
+        { "noise_filter",    CFG_STATE, &scr_noise, 0, 5,          "temporal noise filter, majority of pixel over 3 or 5 frames (0 - off)", noise_depths, 0 },
+    };
+    const int cfg_count = sizeof(cfg_items) / sizeof(cfg_items[0]);
 
     const int IDM_SHOW_SYNC = 1;
     const int IDM_SAVE_SIG  = 2;
+    const int IDM_LATENCY   = 3;
     const int IDM_SAVESCR   = 4;
     const int IDM_BK0011M   = 5;
     const int IDM_UKNC      = 6;
+    const int IDM_SAVE_IDX  = 7;
+    const int IDM_REC_VIDEO = 8;
+    const int IDM_SAVESCR_PNG = 9;
+    const int IDM_SAVESCR_QOI = 10;
+    const int IDM_REC_GIF     = 11;
+    const int IDM_SCANLINES   = 12;
+    const int IDM_LOW_LATENCY = 13;
+    const int IDM_METRICS     = 14;
+    // 0x0F..0x1F are palettes (IDM_PALETTEBW..IDM_PALETTE15), no other item goes there
+    const int IDM_SCALE1      = 0x21;
+    const int IDM_SCALE2      = 0x22;
+    const int IDM_SCALE3      = 0x23;
+    const int IDM_TRACE       = 0x30;
+    const int IDM_SIGNAL      = 0x31;
+    const int IDM_CENTER      = 0x32;
+    const int IDM_FILTER3     = 0x33;
+    const int IDM_FILTER5     = 0x34;
+    const int IDM_SAVE_PRE    = 0x35;
+
+    const UINT WM_SHOT_DONE = WM_APP + 1;
 
     const int IDM_PALETTEBW  = 0x0F;
     const int IDM_PALETTE00  = 0x10;
@@ -391,38 +283,20 @@ void LIBUSB_CALL cb_transfer_complete (libusb_transfer *t)
     wchar_t     wError[1024];
     wchar_t     wcsTemp[256];
 
-    uint32_t    ntimes[1024];
-    uint32_t    ttimes[1024];
-    uint32_t    idx_times;
 
+// screenshot written in background, WM_SHOT_DONE tells the window when it's done
+void ShotDone (img_job* j)
+{
+    lat_add(LAT_EXPORT, time_ns() - shot_t_pub);
+    PostMessageW(hMain, WM_SHOT_DONE, 0, 0);
+}
 
-// obviously writes .bmp
-int WriteBmp()
+// take screenshot of last shown frame, returns 0 if writing started
+int SaveScreenshot (const char* fname)
 {
-    tagBITMAPFILEHEADER header;
-    tagBITMAPINFOHEADER info;
-    header.bfType = 0x4d42; // magic sequence 'BM'
-    header.bfSize = sizeof(tagBITMAPFILEHEADER);
-    header.bfOffBits = sizeof(tagBITMAPINFOHEADER) + sizeof(tagBITMAPFILEHEADER);
-    info.biSize = sizeof(tagBITMAPINFOHEADER);
-    info.biWidth = scr_width;
-    info.biHeight = scr_height*2;
-    info.biPlanes = 1;
-    info.biBitCount = 24;
-    info.biSizeImage = info.biWidth*info.biHeight;
-    info.biCompression = 0;
-    FILE* f = fopen("screenshot.bmp", "wb");
-    if (f == NULL) return 1;
-    fwrite(&header, 1, sizeof(header), f);
-    fwrite(&info, 1, sizeof(info), f);
-    for (int u=scr_full-scr_width; u>=0; u-=scr_width) 
-    {
-        uint32_t* data = (uint32_t*) scr_buffers[nLastBuf];
-        for (int v=0; v<scr_width; v++) fwrite(&data[u+v], 1, 3, f);
-        for (int v=0; v<scr_width; v++) fwrite(&data[u+v], 1, 3, f);
-    }
-    fclose(f);
-    return 0;
+    shot.on_done = ShotDone;
+    shot_t_pub = scr_t_pub[nLastBuf];
+    return img_save_async(&shot, &dec, nLastBuf, fname, 2);
 }
 
 
@@ -437,49 +311,77 @@ HWND helpCreateChild (LPCWSTR sclass, LPCWSTR caption, DWORD style, int x, int y
 
 
 // paint picture on main window
+// (scaled on cpu, so GDI only copies it 1:1)
 void PaintScreen (int nbuf)
 {
     if (stop == 1) return;
+    // black & white is made on a copy - video and screenshots read the same buffer
+    const uint32_t* pix = dec.bufs[nbuf];
+    if (dec.palette == 0 && dec.mode == MODE_BK) {
+        if (bw_pix == NULL) bw_pix = (uint32_t*) malloc(SCR_MAXBUF*sizeof(uint32_t));
+        if (bw_pix == NULL) return;
+        memcpy(bw_pix, pix, dec.full*sizeof(uint32_t));
+        dec_to_bw(bw_pix, dec.full);
+        pix = bw_pix;
+    }
+    if (scale_frame(&scl, pix, dec.width, dec.height, scr_scale, scr_scale*2, scr_scanlines ? 160 : 256) != 0) return;
     BITMAPINFO info;
     memset(&info, 0, sizeof(BITMAPINFO));
     info.bmiHeader.biBitCount = 32;
-    info.bmiHeader.biWidth = scr_width;
-    info.bmiHeader.biHeight = 0-scr_height;
+    info.bmiHeader.biWidth = scl.out_w;
+    info.bmiHeader.biHeight = 0-scl.out_h;
     info.bmiHeader.biPlanes = 1;
     info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
     info.bmiHeader.biSizeImage = 0;
     info.bmiHeader.biCompression = BI_RGB;
     HDC dc = GetDC(hMain);    
-    StretchDIBits(dc, 0, 0, scr_width, scr_height*2, 0, 0, scr_width, scr_height, (void *)(scr_buffers[nbuf]), &info, DIB_RGB_COLORS, SRCCOPY);
+    StretchDIBits(dc, 0, 0, scl.out_w, scl.out_h, 0, 0, scl.out_w, scl.out_h, (void *)(scl.out), &info, DIB_RGB_COLORS, SRCCOPY);
     ReleaseDC( hMain, dc );
 }
 
 
+// (helper) wait for next display refresh (vsync through compositor, 1 ms sleep if there is none)
+void WaitRefresh ()
+{
+    if (DwmFlush() != S_OK) Sleep(1);
+    trace_instant("vsync");
+}
+
 // render pic in separate thread
+// low latency - paint every frame as soon as it's complete,
+// otherwise paint at display refresh whatever pace_pick says is due
 DWORD WINAPI RenderThreadProc (LPVOID lpParam)
 {
+    uint64_t t_last = 0;
+    uint32_t seq_last = 0;
+    met_thread("render");
+    trace_thread("render");
     while (stop == 0) {
-        uint32_t n = scr_n_cur;
-        while (n == scr_n_cur) {}
-        nLastBuf = n;
-        volatile uint32_t *buf = scr_buffers[n];
-        // black & white mode?
-        if (palette == 0) {
-            for (uint32_t u=0; u<scr_full; u+=2) {
-                uint32_t b1 = (buf[u] & 0x00000F) ? 0xFFFFFF : 0x000000;
-                uint32_t b2 = (buf[u] & 0x000F00) ? 0xFFFFFF : 0x000000;
-                if (buf[u] & 0x0F0000) { b1=0xFFFFFF; b2=0xFFFFFF; }
-                buf[u] = b1;
-                buf[u+1] = b2;
-            }
+        uint32_t n, seq;
+        if (pace.mode == PACE_IMMEDIATE) {
+            n = dec.n_cur;
+            while (n == dec.n_cur && pace.mode == PACE_IMMEDIATE) {}
+            if (n == dec.n_cur) continue;
+            seq = dec.seq - 1;
+        } else {
+            WaitRefresh();
+            if (!pace_pick(&pace, time_ns(), &seq)) continue;
+            n = seq & (dec.nbuf-1);
         }
-        //
+        nLastBuf = n;
+        uint64_t t0 = time_ns();
+        met_gauge(MET_G_FRAME_LAG, dec.seq - 1 - seq);
+        if (t_last && seq - seq_last > 1) met_add(MET_DROPPED, seq - seq_last - 1);
+        seq_last = seq;
+        trace_begin("present", seq);
         PaintScreen(n);
-        //
-        SYSTEMTIME st; GetSystemTime(&st);
-        ntimes[idx_times] = n;
-        ttimes[idx_times] = st.wMilliseconds;
-        idx_times = ++idx_times & 1023;
+        uint64_t t = time_ns();
+        lat_add(LAT_PRESENT, t - scr_t_pub[n]);
+        lat_add(LAT_TOTAL, t - scr_t_usb[n]);
+        if (t_last) lat_add(LAT_FRAME, t - t_last);
+        met_hist(MET_H_PRESENT, t - t0);
+        trace_end("present");
+        t_last = t;
     }
     return 0;
 }
@@ -489,18 +391,13 @@ DWORD WINAPI RenderThreadProc (LPVOID lpParam)
 //
 int StartUsbProcess ()
 {
-    // allocate 8 buffers for receiving screens
-    for (int i=0; i<8; i++) 
-        scr_buffers[i] = (uint32_t*) malloc(SCR_MAXBUF*sizeof(uint32_t));
     // start usb 
     int res = usb_write_firmware();
     if (res != 0) return res;
     hUsbThread = CreateThread(NULL, 0, thread_usb_events, 0, 0, NULL);
-    SetThreadPriority(hUsbThread, THREAD_PRIORITY_ABOVE_NORMAL);
-    for (int i=0; i<4; i++) {
-        res = add_transfer();
-        if (res != 0) return res;
-    }
+    SetThreadPriority(hUsbThread, usb_priority);
+    res = add_transfers(cb_transfer_complete);
+    if (res != 0) return res;
     return fx2_send_start();
 }
 
@@ -509,21 +406,24 @@ int StartUsbProcess ()
 //
 void SetNewMode ()
 {
-    if (scr_mode == MODE_BK) {
+    // frame size changes - video recording can't go on
+    if (vid.active) {
+        vid_close(&vid);
+        CheckMenuItem(hMenuOptions, IDM_REC_VIDEO, MF_UNCHECKED);
+        CheckMenuItem(hMenuOptions, IDM_REC_GIF, MF_UNCHECKED);
+    }
+    dec_set_mode(&dec, dec.mode);
+    if (dec.mode == MODE_BK) {
         CheckMenuItem(hMenuMode, IDM_BK0011M, MF_CHECKED);
         CheckMenuItem(hMenuMode, IDM_UKNC, MF_UNCHECKED);
-        scr_width  = B_SCR_WIDTH;
-        scr_height = B_SCR_HEIGHT;
-        scr_full   = B_SCR_FULL;
     } else {
         CheckMenuItem(hMenuMode, IDM_BK0011M, MF_UNCHECKED);
         CheckMenuItem(hMenuMode, IDM_UKNC, MF_CHECKED);
-        scr_width  = U_SCR_WIDTH;
-        scr_height = U_SCR_HEIGHT;
-        scr_full   = U_SCR_FULL;
     }
-    W_DX = scr_width;
-    W_DY = scr_height*2;
+    for (int i=IDM_SCALE1; i<=IDM_SCALE3; i++)
+        CheckMenuItem(hMenuView, i, (i - IDM_SCALE1 + 1 == scr_scale) ? MF_CHECKED : MF_UNCHECKED);
+    W_DX = dec.width*scr_scale;
+    W_DY = dec.height*2*scr_scale;
     RECT rect = {W_X, W_Y, W_X+W_DX, W_Y+W_DY};
     DWORD style = WS_CAPTION | WS_MINIMIZEBOX | WS_SYSMENU | WS_VISIBLE;
     AdjustWindowRectEx(&rect, style, /*menu presence*/true, NULL);
@@ -542,43 +442,189 @@ LONG MainWndProc (HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
             switch (LOWORD(wparam)) {
                 // switch modes
                 case IDM_BK0011M:
-                    scr_mode = MODE_BK;
+                case IDM_UKNC:
+                    dec.mode = (LOWORD(wparam) == IDM_BK0011M) ? MODE_BK : MODE_UKNC;
+                    // shift of other machine means nothing here
+                    if (scr_centering) {
+                        dec_set_offset(&dec, 0, 0);
+                        dec_calibrate(&dec);
+                    }
                     SetNewMode();
                     break;
-                case IDM_UKNC:
-                    scr_mode = MODE_UKNC;
+                // window scale
+                case IDM_SCALE1:
+                case IDM_SCALE2:
+                case IDM_SCALE3:
+                    scr_scale = LOWORD(wparam) - IDM_SCALE1 + 1;
                     SetNewMode();
                     break;
+                case IDM_SCANLINES:
+                    scr_scanlines = 1 - scr_scanlines;
+                    CheckMenuItem(hMenuView, IDM_SCANLINES, scr_scanlines ? MF_CHECKED : MF_UNCHECKED);
+                    break;
+                // noise filter, decoder thread picks it up with next frame
+                case IDM_FILTER3:
+                case IDM_FILTER5: {
+                    int depth = (LOWORD(wparam) == IDM_FILTER3) ? 3 : 5;
+                    scr_noise = (scr_noise == depth) ? 0 : depth;
+                    CheckMenuItem(hMenuView, IDM_FILTER3, scr_noise == 3 ? MF_CHECKED : MF_UNCHECKED);
+                    CheckMenuItem(hMenuView, IDM_FILTER5, scr_noise == 5 ? MF_CHECKED : MF_UNCHECKED);
+                    break;
+                }
+                case IDM_LOW_LATENCY:
+                    pace.mode = (pace.mode == PACE_IMMEDIATE) ? PACE_BUFFERED : PACE_IMMEDIATE;
+                    CheckMenuItem(hMenuView, IDM_LOW_LATENCY, pace.mode == PACE_IMMEDIATE ? MF_CHECKED : MF_UNCHECKED);
+                    break;
                 // sync signal
                 case IDM_SHOW_SYNC:
-                    scr_show_sync = 1 - scr_show_sync;
-                    CheckMenuItem(hMenuOptions, IDM_SHOW_SYNC, scr_show_sync ? MF_CHECKED : MF_UNCHECKED);
+                    dec.show_sync = 1 - dec.show_sync;
+                    CheckMenuItem(hMenuOptions, IDM_SHOW_SYNC, dec.show_sync ? MF_CHECKED : MF_UNCHECKED);
+                    break;
+                // start/stop raw signal recording (plain or indexed)
+                case IDM_SAVE_SIG:
+                case IDM_SAVE_IDX:
+                    if (rec.active == 0) {
+                        int fmt = (LOWORD(wparam) == IDM_SAVE_IDX) ? REC_FX2C : REC_RAW;
+                        if (rec_start(&rec, fmt == REC_FX2C ? rec_idx_filename : rec_filename, fmt, dec.mode) != 0) {
+                            MessageBoxW(hMain, L"Unable to start signal recording", sErrorCaption, MB_OK);
+                            break;
+                        }
+                        CheckMenuItem(hMenuOptions, LOWORD(wparam), MF_CHECKED);
+                    } else {
+                        rec_stop(&rec);
+                        CheckMenuItem(hMenuOptions, IDM_SAVE_SIG, MF_UNCHECKED);
+                        CheckMenuItem(hMenuOptions, IDM_SAVE_IDX, MF_UNCHECKED);
+                        wsprintf(wcsTemp, L"Signal data saved to %s\n%u KB written, %u KB dropped in %u gaps%s%s",
+                            rec.format == REC_FX2C ? L"signal.fx2c" : L"signal.bin",
+                            (uint32_t)(rec.bytes_written >> 10), (uint32_t)(rec.bytes_dropped >> 10), rec.gaps,
+                            rec.gaps ? L" (listed in .gaps file)" : L"", rec.io_error ? L" (write error)" : L"");
+                        MessageBoxW(hMain, wcsTemp, L"Info", MB_OK);
+                    }
+                    break;
+                // signal that came before now, saved by writer thread
+                case IDM_SAVE_PRE: {
+                    if (pre_dump(&pre, pre_rle ? "signal_pre%03u.rle" : "signal_pre%03u.bin", dec.mode) == 0) {
+                        MessageBoxW(hMain, pre_seconds ? L"Previous dump is not written yet" : L"Signal ring is off (pre_seconds = 0)",
+                            sErrorCaption, MB_OK);
+                        break;
+                    }
+                    MessageBeep(MB_OK);
                     break;
-                //case IDM_SAVEBIN:
-                //    MessageBoxW(hMain, L"Signal data saved to signal.bin", L"Info", MB_OK);
-                //    break;
+                }
                 // save screen from current-1 buffer
                 case IDM_SAVESCR:
-                    WriteBmp();
-                    MessageBoxW(hMain, L"Screenshot written to file screenshot.bmp", L"Info", MB_OK);
+                case IDM_SAVESCR_PNG:
+                case IDM_SAVESCR_QOI: {
+                    UINT id = LOWORD(wparam);
+                    const char* fname = (id == IDM_SAVESCR_PNG) ? "screenshot.png" : (id == IDM_SAVESCR_QOI) ? "screenshot.qoi" : "screenshot.bmp";
+                    if (SaveScreenshot(fname) != 0)
+                        MessageBoxW(hMain, L"Unable to take screenshot now", sErrorCaption, MB_OK);
+                    break;
+                }
+                // start/stop video recording
+                case IDM_REC_VIDEO:
+                case IDM_REC_GIF:
+                    if (vid.active == 0) {
+                        int gif = (LOWORD(wparam) == IDM_REC_GIF);
+                        if (vid_open(&vid, gif ? gif_filename : vid_filename, gif ? VID_GIF : VID_Y4M, dec.width, dec.height) != 0) {
+                            vid_close(&vid);
+                            MessageBoxW(hMain, L"Unable to start video recording", sErrorCaption, MB_OK);
+                            break;
+                        }
+                        vid_start_live(&vid, &dec);
+                        CheckMenuItem(hMenuOptions, LOWORD(wparam), MF_CHECKED);
+                    } else {
+                        vid_close(&vid);
+                        CheckMenuItem(hMenuOptions, IDM_REC_VIDEO, MF_UNCHECKED);
+                        CheckMenuItem(hMenuOptions, IDM_REC_GIF, MF_UNCHECKED);
+                        wsprintf(wcsTemp, L"Video saved to %S\n%u frames written, %u skipped%s",
+                            vid.format == VID_GIF ? gif_filename : vid_filename,
+                            (uint32_t)vid.frames_written, (uint32_t)vid.frames_skipped,
+                            vid.io_error ? L" (write error)" : L"");
+                        MessageBoxW(hMain, wcsTemp, L"Info", MB_OK);
+                    }
+                    break;
+                // latency p50/p99/max per pipeline stage
+                case IDM_LATENCY:
+                    lat_report(lat_text, sizeof(lat_text));
+                    mbstowcs(wError, lat_text, 1024);
+                    MessageBoxW(hMain, wError, L"Latency", MB_OK);
+                    break;
+                // metrics as JSON lines once a second
+                case IDM_METRICS:
+                    if (met.f == NULL) {
+                        if (met_dump_start(&met, met_filename, 1000) == 0) {
+                            CheckMenuItem(hMenuOptions, IDM_METRICS, MF_CHECKED);
+                        } else {
+                            wsprintf(wcsTemp, L"Unable to open %S", met_filename);
+                            MessageBoxW(hMain, wcsTemp, sErrorCaption, MB_OK);
+                        }
+                    } else {
+                        met_dump_stop(&met);
+                        CheckMenuItem(hMenuOptions, IDM_METRICS, MF_UNCHECKED);
+                    }
+                    break;
+                // centering calibration over next fields
+                case IDM_CENTER:
+                    dec_calibrate(&dec);
+                    break;
+                // signal quality of sampled transfers, report when stopped
+                case IDM_SIGNAL:
+                    if (sig_active.load() == 0) {
+                        sig_init(&sig, dec.mode);
+                        sig_active = 1;
+                        CheckMenuItem(hMenuOptions, IDM_SIGNAL, MF_CHECKED);
+                    } else {
+                        sig_active = 0;
+                        while (sig_in_feed.load()) Sleep(0);
+                        CheckMenuItem(hMenuOptions, IDM_SIGNAL, MF_UNCHECKED);
+                        sig_report(&sig, sig_text, sizeof(sig_text));
+                        static wchar_t wSig[4096];
+                        mbstowcs(wSig, sig_text, 4096);
+                        MessageBoxW(hMain, wSig, L"Signal analysis", MB_OK);
+                    }
+                    break;
+                // timeline of all threads, written when stopped
+                case IDM_TRACE:
+                    if (trace_on.load() == 0) {
+                        trace_start();
+                        CheckMenuItem(hMenuOptions, IDM_TRACE, MF_CHECKED);
+                    } else {
+                        trace_stop();
+                        CheckMenuItem(hMenuOptions, IDM_TRACE, MF_UNCHECKED);
+                        int n = trace_dump(trace_filename);
+                        if (n < 0) wsprintf(wcsTemp, L"Unable to write %S", trace_filename);
+                        else wsprintf(wcsTemp, L"Timeline saved to %S\n%i events (open in ui.perfetto.dev)", trace_filename, n);
+                        MessageBoxW(hMain, wcsTemp, L"Trace", MB_OK);
+                    }
                     break;
             }
             // palettes menu
             if ((LOWORD(wparam) >= IDM_PALETTEBW) && (LOWORD(wparam) <= IDM_PALETTE15)) 
             {
-                palette = LOWORD(wparam) - IDM_PALETTEBW;
+                dec.palette = LOWORD(wparam) - IDM_PALETTEBW;
                 for (int i=IDM_PALETTEBW; i<=IDM_PALETTE15; i++) CheckMenuItem(hMenuOptions, i, MF_UNCHECKED);
                 CheckMenuItem(hMenuOptions, LOWORD(wparam), MF_CHECKED);
             }
             break;
+        // screenshot writer finished
+        case WM_SHOT_DONE:
+            if (shot.result != 0) {
+                MessageBoxW(hMain, L"Unable to write screenshot", sErrorCaption, MB_OK);
+            } else {
+                wsprintf(wcsTemp, L"Screenshot written to file %S (%u ms)", shot.fname, (uint32_t)(shot.t_encode / 1000000));
+                MessageBoxW(hMain, wcsTemp, L"Info", MB_OK);
+            }
+            return 0L;
         // minimize/maximize/resize
         case WM_SIZE: 
             if (wparam==SIZE_MINIMIZED) {}
             break;
         // move
         case WM_MOVE: 
-            W_X = (int) LOWORD(lparam);
-            W_Y = (int) HIWORD(lparam);
+            if (IsIconic(hwnd)) return 0L;
+            W_X = (int)(short) LOWORD(lparam);
+            W_Y = (int)(short) HIWORD(lparam);
             return 0L;
         // timer ticks - check device health and try to restart it if something happened
         case WM_TIMER:
@@ -586,7 +632,7 @@ LONG MainWndProc (HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
                 nactive = 0;
                 int res = usb_write_firmware();
                 if (res) return 0L;
-                for (int i=0; i<4; i++) add_transfer();
+                add_transfers(cb_transfer_complete);
                 fx2_send_start();
             }
             return 0L;
@@ -624,25 +670,54 @@ void InitWindows (void)
     hMenuMode = CreateMenu();
     AppendMenuW(hMenuMode, MF_STRING, IDM_BK0011M, L"BK0011M");
     AppendMenuW(hMenuMode, MF_STRING, IDM_UKNC, L"UKNC");
+    // view menu
+    hMenuView = CreateMenu();
+    AppendMenuW(hMenuView, MF_STRING, IDM_SCALE1, L"Scale x1");
+    AppendMenuW(hMenuView, MF_STRING, IDM_SCALE2, L"Scale x2");
+    AppendMenuW(hMenuView, MF_STRING, IDM_SCALE3, L"Scale x3");
+    AppendMenuW(hMenuView, MF_SEPARATOR, 0, 0);
+    AppendMenuW(hMenuView, MF_STRING, IDM_SCANLINES, L"Scanlines");
+    AppendMenuW(hMenuView, MF_STRING, IDM_LOW_LATENCY, L"Low latency (no frame pacing)");
+    AppendMenuW(hMenuView, MF_STRING, IDM_CENTER, L"Center picture (calibrate)");
+    AppendMenuW(hMenuView, MF_SEPARATOR, 0, 0);
+    AppendMenuW(hMenuView, MF_STRING, IDM_FILTER3, L"Noise filter (3 frames)");
+    AppendMenuW(hMenuView, MF_STRING, IDM_FILTER5, L"Noise filter (5 frames)");
+    CheckMenuItem(hMenuView, IDM_SCANLINES, scr_scanlines ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(hMenuView, IDM_FILTER3, scr_noise == 3 ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(hMenuView, IDM_FILTER5, scr_noise == 5 ? MF_CHECKED : MF_UNCHECKED);
+    CheckMenuItem(hMenuView, IDM_LOW_LATENCY, pace.mode == PACE_IMMEDIATE ? MF_CHECKED : MF_UNCHECKED);
     // option menu
     hMenuOptions = CreateMenu();
     AppendMenuW(hMenuOptions, MF_STRING, IDM_SHOW_SYNC, L"Show sync signal");
+    CheckMenuItem(hMenuOptions, IDM_SHOW_SYNC, dec.show_sync ? MF_CHECKED : MF_UNCHECKED);
     AppendMenuW(hMenuOptions, MF_SEPARATOR, 0, 0);
     AppendMenuW(hMenuOptions, MF_STRING, IDM_PALETTEBW, L"Black & white");
     for (int i=IDM_PALETTE00; i<=IDM_PALETTE15; i++) {
         wsprintf(wcsTemp, L"Palette %i", i-IDM_PALETTE00);
         AppendMenuW(hMenuOptions, MF_STRING, i, wcsTemp);
     }
-    CheckMenuItem(hMenuOptions, IDM_PALETTEBW+palette, MF_CHECKED);
+    CheckMenuItem(hMenuOptions, IDM_PALETTEBW+dec.palette, MF_CHECKED);
     AppendMenuW(hMenuOptions, MF_SEPARATOR, 0, 0);
-    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVESCR, L"Save screenshot");
-    // AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVE_SIG, L"Save signal binary");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVESCR, L"Save screenshot (BMP)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVESCR_PNG, L"Save screenshot (PNG)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVESCR_QOI, L"Save screenshot (QOI)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_LATENCY, L"Latency stats");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_METRICS, L"Metrics log (metrics.json)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_TRACE, L"Trace timeline (trace.json)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SIGNAL, L"Signal analysis");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVE_SIG, L"Save signal binary");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVE_IDX, L"Save signal indexed (.fx2c)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_SAVE_PRE, L"Save last seconds of signal\tF12");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_REC_VIDEO, L"Record video (.y4m)");
+    AppendMenuW(hMenuOptions, MF_STRING, IDM_REC_GIF, L"Record animation (.gif)");
     HMENU hMenubar = CreateMenu();
     AppendMenuW(hMenubar, MF_POPUP, (UINT_PTR)hMenuMode, L"Mode");
+    AppendMenuW(hMenubar, MF_POPUP, (UINT_PTR)hMenuView, L"View");
     AppendMenuW(hMenubar, MF_POPUP, (UINT_PTR)hMenuOptions, L"Options");
     SetMenu(hMain, hMenubar);
     // rendering
     hRenderThread = CreateThread(NULL, 0, RenderThreadProc, 0, 0, NULL);
+    SetThreadPriority(hRenderThread, render_priority);
     // TODO: use timer for check FX2 is alive and try to (re)start it if not
     SetTimer(hMain, 1/*Timer ID*/, 5000, NULL);
     // at last switch mode (BK or UKNC)
@@ -681,6 +756,29 @@ int WinMain (HINSTANCE this_inst, HINSTANCE prev_inst, LPSTR cmdline, int cmdsho
         ExitProcess(1);
     }
 
+    // settings from config file, then "name=value" arguments on top
+    if (cfg_load(cfg_items, cfg_count, cfg_filename, error) != 0 ||
+        cfg_args(cfg_items, cfg_count, __argc-1, __argv+1, error) != 0) {
+        mbstowcs(wError, error, 1024);
+        MessageBoxW(NULL, wError, sErrorCaption, MB_OK);
+        ExitProcess(1);
+    }
+    error[0] = 0;
+
+    // screen buffers
+    if (dec_init(&dec, scr_mode, scr_buffers) != 0) {
+        MessageBoxW(NULL, L"Unable to allocate screen buffers", sErrorCaption, MB_OK);
+        ExitProcess(1);
+    }
+    dec.palette = (uint8_t)scr_palette;
+    dec.show_sync = (uint8_t)scr_show_sync;
+    dec.on_frame = scr_on_frame;
+    dec_set_offset(&dec, scr_offset_x, scr_offset_y);
+    if (scr_centering) dec_calibrate(&dec);
+    pace_init(&pace, scr_pacing, 1.5, dec.nbuf);
+    if (pre_seconds > 0 && pre_start(&pre, pre_seconds, pre_memory, pre_rle) != 0)
+        MessageBoxW(NULL, L"Unable to allocate signal ring", sErrorCaption, MB_OK);
+
     // initialize window
     InitWindows();
     // start fx2 acquisition
@@ -689,6 +787,7 @@ int WinMain (HINSTANCE this_inst, HINSTANCE prev_inst, LPSTR cmdline, int cmdsho
     // message loop
     while (GetMessageW(&msg, (HWND)NULL, 0, 0))
     {
+        if (msg.message == WM_KEYDOWN && msg.wParam == VK_F12) SendMessageW(hMain, WM_COMMAND, IDM_SAVE_PRE, 0);
         // if (msg.message == WM_KEYDOWN) ...
         // if (msg.message == WM_KEYUP) ...
         DispatchMessageW(&msg);
@@ -702,12 +801,28 @@ int WinMain (HINSTANCE this_inst, HINSTANCE prev_inst, LPSTR cmdline, int cmdsho
     }
 
     // cleanup ... well - let's windows do it 
+    rec_stop(&rec);
+    vid_close(&vid);
+    met_dump_stop(&met);
+    if (trace_on.load()) {
+        trace_stop();
+        trace_dump(trace_filename);
+    }
+    img_job_free(&shot);
     stop = 1;
     timeEndPeriod(1);
     Sleep(100);
     usb_close();
-
-    // TODO: save config
+    pre_stop(&pre);
+
+    // window state back to config
+    scr_mode = dec.mode;
+    scr_palette = dec.palette;
+    scr_show_sync = dec.show_sync;
+    scr_pacing = pace.mode;
+    scr_offset_x = dec.ofs_x;
+    scr_offset_y = dec.ofs_y;
+    cfg_save(cfg_items, cfg_count, cfg_filename);
     return 0;
 }
 
@@ -753,126 +868,3 @@ int WinMain (HINSTANCE this_inst, HINSTANCE prev_inst, LPSTR cmdline, int cmdsho
         deviceContext->DrawImage(bitmap, D2D1_INTERPOLATION_MODE_LINEAR, D2D1_COMPOSITE_MODE_SOURCE_COPY);
         hr  = deviceContext->EndDraw();
 */
-
-/* 
-    Save video
-    ==========
-
-#include <mfapi.h>
-#include <mfidl.h>
-#include <Mfreadwrite.h>
-#include <mferror.h>
-#pragma comment(lib, "mfreadwrite")
-#pragma comment(lib, "mfplat")
-#pragma comment(lib, "mfuuid")
-
-template <class T> void SafeRelease(T **ppT)
-{
-    if (*ppT)
-    {
-        (*ppT)->Release();
-        *ppT = NULL;
-    }
-}
-
-
-// Format constants
-const UINT32 VIDEO_WIDTH = 800;
-const UINT32 VIDEO_HEIGHT = 312;
-const UINT32 VIDEO_FPS = 50;
-const UINT64 VIDEO_FRAME_DURATION = 10 * 1000 * 1000 / VIDEO_FPS;
-const UINT32 VIDEO_BIT_RATE = 800000;
-const GUID   VIDEO_ENCODING_FORMAT = MFVideoFormat_WMV3;
-const GUID   VIDEO_INPUT_FORMAT = MFVideoFormat_RGB32;
-const UINT32 VIDEO_PELS = VIDEO_WIDTH * VIDEO_HEIGHT;
-
-    IMFSinkWriter* pSinkWriter = NULL;
-    DWORD stream;
-
-HRESULT InitializeSinkWriter(IMFSinkWriter **ppWriter, DWORD *pStreamIndex)
-{
-    *ppWriter = NULL;
-    *pStreamIndex = NULL;
-    IMFSinkWriter   *pSinkWriter = NULL;
-    IMFMediaType    *pMediaTypeOut = NULL;   
-    IMFMediaType    *pMediaTypeIn = NULL;   
-    DWORD           streamIndex;
-    HRESULT hr = MFCreateSinkWriterFromURL(L"output.wmv", NULL, NULL, &pSinkWriter);
-    if (SUCCEEDED(hr)) hr = MFCreateMediaType(&pMediaTypeOut);   
-    if (SUCCEEDED(hr)) hr = pMediaTypeOut->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);     
-    if (SUCCEEDED(hr)) hr = pMediaTypeOut->SetGUID(MF_MT_SUBTYPE, VIDEO_ENCODING_FORMAT);   
-    if (SUCCEEDED(hr)) hr = pMediaTypeOut->SetUINT32(MF_MT_AVG_BITRATE, VIDEO_BIT_RATE);   
-    if (SUCCEEDED(hr)) hr = pMediaTypeOut->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);   
-    if (SUCCEEDED(hr)) hr = MFSetAttributeSize(pMediaTypeOut, MF_MT_FRAME_SIZE, VIDEO_WIDTH, VIDEO_HEIGHT);   
-    if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(pMediaTypeOut, MF_MT_FRAME_RATE, VIDEO_FPS, 1);   
-    if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(pMediaTypeOut, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);   
-    if (SUCCEEDED(hr)) hr = pSinkWriter->AddStream(pMediaTypeOut, &streamIndex);   
-    if (SUCCEEDED(hr)) hr = MFCreateMediaType(&pMediaTypeIn);   
-    if (SUCCEEDED(hr)) hr = pMediaTypeIn->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);   
-    if (SUCCEEDED(hr)) hr = pMediaTypeIn->SetGUID(MF_MT_SUBTYPE, VIDEO_INPUT_FORMAT);     
-    if (SUCCEEDED(hr)) hr = pMediaTypeIn->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);   
-    if (SUCCEEDED(hr)) hr = MFSetAttributeSize(pMediaTypeIn, MF_MT_FRAME_SIZE, VIDEO_WIDTH, VIDEO_HEIGHT);   
-    if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(pMediaTypeIn, MF_MT_FRAME_RATE, VIDEO_FPS, 1);   
-    if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(pMediaTypeIn, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);   
-    if (SUCCEEDED(hr)) hr = pSinkWriter->SetInputMediaType(streamIndex, pMediaTypeIn, NULL);   
-    if (SUCCEEDED(hr)) hr = pSinkWriter->BeginWriting();
-    if (SUCCEEDED(hr))
-    {
-        *ppWriter = pSinkWriter;
-        (*ppWriter)->AddRef();
-        *pStreamIndex = streamIndex;
-    }
-    SafeRelease(&pSinkWriter);
-    SafeRelease(&pMediaTypeOut);
-    SafeRelease(&pMediaTypeIn);
-    return hr;
-}
-
-HRESULT WriteFrame(IMFSinkWriter *pWriter, DWORD streamIndex, const LONGLONG& rtStart, int n)
-{
-    IMFSample *pSample = NULL;
-    IMFMediaBuffer *pBuffer = NULL;
-    const LONG cbWidth = 4 * VIDEO_WIDTH;
-    const DWORD cbBuffer = cbWidth * VIDEO_HEIGHT;
-    BYTE *pData = NULL;
-    // Create a new memory buffer.
-    HRESULT hr = MFCreateMemoryBuffer(cbBuffer, &pBuffer);
-    // Lock the buffer and copy the video frame to the buffer.
-    if (SUCCEEDED(hr)) hr = pBuffer->Lock(&pData, NULL, NULL);
-    if (SUCCEEDED(hr))
-        hr = MFCopyImage(
-            pData,                      // Destination buffer.
-            cbWidth,                    // Destination stride.
-            (BYTE*)scr_buffers[n],      // First row in source image.
-            cbWidth,                    // Source stride.
-            cbWidth,                    // Image width in bytes.
-            VIDEO_HEIGHT                // Image height in pixels.
-            );
-    if (pBuffer) pBuffer->Unlock();
-    // Set the data length of the buffer.
-    if (SUCCEEDED(hr)) hr = pBuffer->SetCurrentLength(cbBuffer);
-    // Create a media sample and add the buffer to the sample.
-    if (SUCCEEDED(hr)) hr = MFCreateSample(&pSample);
-    if (SUCCEEDED(hr)) hr = pSample->AddBuffer(pBuffer);
-    if (SUCCEEDED(hr)) hr = pSample->SetSampleTime(rtStart);
-    if (SUCCEEDED(hr)) hr = pSample->SetSampleDuration(VIDEO_FRAME_DURATION);
-    if (SUCCEEDED(hr)) hr = pWriter->WriteSample(streamIndex, pSample);
-    SafeRelease(&pSample);
-    SafeRelease(&pBuffer);
-    return hr;
-}
-
-    HRESULT hr = MFStartup(MF_VERSION);
-    hr = InitializeSinkWriter(&pSinkWriter, &stream);
-    if (FAILED(hr)) {
-        exit(1);
-    }
-
-    ... WriteFrame ...
-
-    hr = pSinkWriter->Finalize();
-    SafeRelease(&pSinkWriter);
-    MFShutdown();
-
-*/
-
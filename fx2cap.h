@@ -0,0 +1,942 @@
+// capture files
+//
+// raw - plain samples, already inverted (test/*.bin)
+// rle - file header, then blocks of (value, run length) pairs:
+//       block header {raw_len, enc_len, crc32 of payload, type}, payload
+//       payload is pairs of value byte + LEB128 varint (run length - 1),
+//       block is stored as is when pairs are not shorter than raw data
+// fx2c - seekable container: file header, rle blocks (fixed raw size each),
+//       then index - block file offsets and frames table - and footer
+//       frame N is found in O(1): footer -> frames table -> block table
+
+#ifndef FX2CAP_H
+#define FX2CAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include "fx2dec.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define cap_fseek(f, off)   _fseeki64(f, (int64_t)(off), SEEK_SET)
+#define cap_ftell(f)        ((uint64_t)_ftelli64(f))
+#else
+#define cap_fseek(f, off)   fseeko(f, (off_t)(off), SEEK_SET)
+#define cap_ftell(f)        ((uint64_t)ftello(f))
+#endif
+
+#define RLE_MAGIC       0x454C5246  // 'FRLE'
+#define RLE_VERSION     1
+#define RLE_BLOCK_RAW   0x100000    // raw samples per block
+#define RLE_MAX_ENC     (RLE_BLOCK_RAW + 16)
+
+#define RLE_TYPE_STORED 0
+#define RLE_TYPE_RUNS   1
+
+#pragma pack(push, 1)
+struct rle_file_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t  mode;                  // MODE_BK / MODE_UKNC
+    uint8_t  flags;
+    uint32_t block_raw;             // raw samples per block (last one can be shorter)
+    uint32_t reserved;
+};
+struct rle_block_hdr {
+    uint32_t raw_len;
+    uint32_t enc_len;
+    uint32_t crc;                   // crc32 of payload
+    uint32_t type;
+};
+
+#define CONT_MAGIC      0x43325846  // 'FX2C'
+#define CONT_IDX_MAGIC  0x49325846  // 'FX2I'
+#define CONT_VERSION    1
+#define CONT_SYNTH_TIME 0x01        // flags: timestamps computed from sample clock
+#define CONT_DEC_SEQ    0x02        // flags: frame seq and dec_frames count as sequential decoding does
+#define SAMPLE_HZ       12000000    // fx2 sampling clock (IFCLK)
+#define USB_CHUNK       0x20000     // usb transfer size, as TR_CHUNK_SIZE of fx2usb.h
+
+struct cont_file_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t  mode;
+    uint8_t  flags;
+    uint32_t block_raw;             // raw samples per block (all but last)
+    uint32_t dec_frames;            // frames sequential decoding of whole file completes (CONT_DEC_SEQ)
+    uint64_t t0_ns;                 // host time of first sample
+    uint64_t reserved2;
+};
+struct cont_frame {
+    uint64_t raw_off;               // offset of first sample after vsync pulse starting the field
+    uint64_t t_ns;                  // host time of that sample
+    uint64_t hash;                  // hash64 of raw samples up to next frame (see cont_hash_*)
+    uint32_t seq;                   // number of frame cont_decode_frame gives in sequential decoding
+                                    // (default centering, CONT_DEC_SEQ) or index entry number (older files)
+    uint32_t len;                   // raw samples up to next frame
+};
+struct cont_footer {
+    uint32_t magic;
+    uint32_t nblocks;
+    uint32_t nframes;
+    uint32_t crc;                   // crc32 of index (block offsets + frames table)
+    uint64_t index_off;             // file offset of block offsets table
+    uint64_t raw_total;             // raw samples in file
+};
+#pragma pack(pop)
+
+
+// index of lowest set bit (v != 0)
+static inline int bit_ctz64 (uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, v);
+    return (int)i;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+// crc32 (ethernet polynomial)
+static uint32_t crc32_buf (const uint8_t* p, size_t len, uint32_t crc = 0)
+{
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i=0; i<256; i++) {
+            uint32_t c = i;
+            for (int k=0; k<8; k++) c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i=0; i<len; i++) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// fast 64-bit hash (fnv-1a over 64-bit words) for frame integrity checks
+static uint64_t hash64 (const void* data, size_t len, uint64_t h = 0xCBF29CE484222325ull)
+{
+    const uint8_t* p = (const uint8_t*) data;
+    size_t i = 0;
+    for (; i+8<=len; i+=8) {
+        uint64_t q; memcpy(&q, p+i, 8);
+        h = (h ^ q) * 0x100000001B3ull;
+        h ^= h >> 29;
+    }
+    for (; i<len; i++) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h;
+}
+
+// length of run of equal samples starting at p (n > 0)
+static inline uint32_t rle_run_len (const uint8_t* p, uint32_t n)
+{
+    uint64_t pat = 0x0101010101010101ull * p[0];
+    uint32_t k = 1;
+    while (k+8 <= n) {
+        uint64_t q; memcpy(&q, p+k, 8);
+        q ^= pat;
+        if (q) return k + (bit_ctz64(q) >> 3);
+        k += 8;
+    }
+    while (k < n && p[k] == p[0]) k++;
+    return k;
+}
+
+// encode samples to pairs, returns encoded length
+// or 0 if result would not be shorter than source (dst must hold len bytes)
+static uint32_t rle_encode (const uint8_t* src, uint32_t len, uint8_t* dst)
+{
+    uint32_t o = 0;
+    uint32_t i = 0;
+    while (i < len) {
+        uint32_t run = rle_run_len(src+i, len-i);
+        if (o + 6 > len) return 0;
+        dst[o++] = src[i];
+        uint32_t v = run - 1;
+        while (v >= 0x80) { dst[o++] = (uint8_t)(v | 0x80); v >>= 7; }
+        dst[o++] = (uint8_t)v;
+        i += run;
+    }
+    return (o < len) ? o : 0;
+}
+
+// (helper) read varint, returns new position or 0 on broken data
+static inline uint32_t rle_varint (const uint8_t* p, uint32_t pos, uint32_t len, uint32_t* v)
+{
+    uint32_t r = 0;
+    for (int shift=0; shift<35; shift+=7) {
+        if (pos >= len) return 0;
+        uint8_t b = p[pos++];
+        r |= (uint32_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) { *v = r; return pos; }
+    }
+    return 0;
+}
+
+// feed pairs directly to decoder (no expanding to bytes), returns raw samples count
+static uint32_t rle_feed (dec_state* d, const uint8_t* enc, uint32_t enc_len)
+{
+    uint32_t pos = 0, total = 0;
+    while (pos < enc_len) {
+        uint8_t value = enc[pos++];
+        uint32_t run;
+        pos = rle_varint(enc, pos, enc_len, &run);
+        if (pos == 0) break;
+        dec_run(d, value, run + 1);
+        total += run + 1;
+    }
+    return total;
+}
+
+// expand pairs to samples, returns samples count (dst must hold raw_len bytes)
+static uint32_t rle_expand (const uint8_t* enc, uint32_t enc_len, uint8_t* dst, uint32_t raw_len)
+{
+    uint32_t pos = 0, total = 0;
+    while (pos < enc_len) {
+        uint8_t value = enc[pos++];
+        uint32_t run;
+        pos = rle_varint(enc, pos, enc_len, &run);
+        if (pos == 0 || total + run + 1 > raw_len) break;
+        memset(dst + total, value, run + 1);
+        total += run + 1;
+    }
+    return total;
+}
+
+// write rle file header, returns 0 if ok
+static int rle_write_header (FILE* f, int mode)
+{
+    rle_file_hdr h;
+    memset(&h, 0, sizeof(h));
+    h.magic = RLE_MAGIC;
+    h.version = RLE_VERSION;
+    h.mode = (uint8_t)mode;
+    h.block_raw = RLE_BLOCK_RAW;
+    return fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : 1;
+}
+
+// encode and write one block (len <= RLE_BLOCK_RAW), scratch must hold RLE_MAX_ENC
+// returns bytes written to file or 0 on error
+static uint32_t rle_write_block (FILE* f, const uint8_t* src, uint32_t len, uint8_t* scratch)
+{
+    rle_block_hdr h;
+    h.raw_len = len;
+    h.enc_len = rle_encode(src, len, scratch);
+    h.type = RLE_TYPE_RUNS;
+    const uint8_t* payload = scratch;
+    if (h.enc_len == 0) {
+        h.enc_len = len;
+        h.type = RLE_TYPE_STORED;
+        payload = src;
+    }
+    h.crc = crc32_buf(payload, h.enc_len);
+    if (fwrite(&h, sizeof(h), 1, f) != 1) return 0;
+    if (fwrite(payload, 1, h.enc_len, f) != h.enc_len) return 0;
+    return sizeof(h) + h.enc_len;
+}
+
+// read and check rle file header, returns 0 if ok
+static int rle_read_header (FILE* f, rle_file_hdr* h)
+{
+    if (fread(h, sizeof(rle_file_hdr), 1, f) != 1) return 1;
+    if (h->magic != RLE_MAGIC || h->version != RLE_VERSION) return 2;
+    if (h->block_raw == 0 || h->block_raw > RLE_BLOCK_RAW) return 3;
+    return 0;
+}
+
+// read next block payload (buf must hold RLE_MAX_ENC)
+// returns 1 if block is read, 0 at end of file, <0 on broken block
+static int rle_read_block (FILE* f, rle_block_hdr* h, uint8_t* buf)
+{
+    if (fread(h, sizeof(rle_block_hdr), 1, f) != 1) return 0;
+    if (h->raw_len > RLE_BLOCK_RAW || h->enc_len > RLE_MAX_ENC) return -1;
+    if (h->type == RLE_TYPE_STORED && h->enc_len != h->raw_len) return -1;
+    if (fread(buf, 1, h->enc_len, f) != h->enc_len) return -2;
+    if (crc32_buf(buf, h->enc_len) != h->crc) return -3;
+    return 1;
+}
+
+// feed block payload to decoder
+static void rle_feed_block (dec_state* d, const rle_block_hdr* h, const uint8_t* buf)
+{
+    if (h->type == RLE_TYPE_STORED) dec_bytes(d, buf, h->raw_len, 0);
+    else rle_feed(d, buf, h->enc_len);
+}
+
+// guess mode of raw samples by counting vsync pulses of both machines
+static int cap_guess_mode (const uint8_t* p, uint32_t len)
+{
+    uint32_t bk_cnt = 0, uk_cnt = 0, bk_vs = 0, uk_vs = 0;
+    for (uint32_t i=0; i<len; i++) {
+        if ((p[i] & 0x13) == 0x10) bk_cnt++; else { if (bk_cnt == 0x50) bk_vs++; bk_cnt = 0; }
+        if ((p[i] & 0x1F) == 0x00) uk_cnt++; else { if (uk_cnt == 0x20) uk_vs++; uk_cnt = 0; }
+    }
+    return (uk_vs > bk_vs) ? MODE_UKNC : MODE_BK;
+}
+
+// capture reader - raw or rle file, fed to decoder chunk by chunk
+#define CAP_RAW         0
+#define CAP_RLE         1
+#define CAP_CONT        2
+
+struct cap_reader {
+    FILE*     f;
+    int       type;                 // CAP_RAW / CAP_RLE / CAP_CONT
+    int       mode;
+    uint8_t*  buf;                  // RLE_MAX_ENC bytes
+    uint64_t  raw_pos;              // samples passed so far
+    rle_block_hdr blk;              // last rle block
+    uint64_t  end_off;              // (fx2c) where blocks end
+};
+
+static void cap_close (cap_reader* c)
+{
+    if (c->f) fclose(c->f);
+    free(c->buf);
+    c->f = NULL;
+    c->buf = NULL;
+}
+
+// open capture (mode < 0 - take it from file or guess), returns 0 if ok
+static int cap_open (cap_reader* c, const char* fname, int mode)
+{
+    memset(c, 0, sizeof(cap_reader));
+    c->f = fopen(fname, "rb");
+    if (c->f == NULL) return 1;
+    c->buf = (uint8_t*) malloc(RLE_MAX_ENC);
+    if (c->buf == NULL) { cap_close(c); return 2; }
+    rle_file_hdr h;
+    if (rle_read_header(c->f, &h) == 0) {
+        c->type = CAP_RLE;
+        c->mode = (mode < 0) ? h.mode : mode;
+        return 0;
+    }
+    // container - blocks are same as in rle up to index
+    cont_file_hdr ch;
+    cont_footer ft;
+    fseek(c->f, 0, SEEK_SET);
+    if (fread(&ch, sizeof(ch), 1, c->f) == 1 && ch.magic == CONT_MAGIC) {
+        fseek(c->f, -(long)sizeof(cont_footer), SEEK_END);
+        if (fread(&ft, sizeof(ft), 1, c->f) != 1 || ft.magic != CONT_IDX_MAGIC) { cap_close(c); return 3; }
+        c->type = CAP_CONT;
+        c->mode = (mode < 0) ? ch.mode : mode;
+        c->end_off = ft.index_off;
+        cap_fseek(c->f, sizeof(cont_file_hdr));
+        return 0;
+    }
+    // raw samples, take a look at beginning to know the mode
+    c->type = CAP_RAW;
+    fseek(c->f, 0, SEEK_SET);
+    uint32_t n = (uint32_t) fread(c->buf, 1, RLE_BLOCK_RAW, c->f);
+    c->mode = (mode < 0) ? cap_guess_mode(c->buf, n) : mode;
+    fseek(c->f, 0, SEEK_SET);
+    return 0;
+}
+
+// read next chunk as plain samples (dst must hold RLE_BLOCK_RAW bytes)
+// returns samples count, 0 at end, <0 on broken data
+static int cap_read (cap_reader* c, uint8_t* dst)
+{
+    uint32_t n;
+    if (c->type == CAP_RAW) {
+        n = (uint32_t) fread(dst, 1, RLE_BLOCK_RAW, c->f);
+    } else {
+        if (c->type == CAP_CONT && cap_ftell(c->f) >= c->end_off) return 0;
+        int res = rle_read_block(c->f, &c->blk, c->buf);
+        if (res <= 0) return res;
+        if (c->blk.type == RLE_TYPE_STORED) {
+            memcpy(dst, c->buf, c->blk.raw_len);
+            n = c->blk.raw_len;
+        } else {
+            n = rle_expand(c->buf, c->blk.enc_len, dst, c->blk.raw_len);
+            if (n != c->blk.raw_len) return -4;
+        }
+    }
+    c->raw_pos += n;
+    return (int) n;
+}
+
+// feed next chunk to decoder (rle runs go directly to decoder)
+// returns samples count, 0 at end, <0 on broken data
+static int cap_feed (cap_reader* c, dec_state* d)
+{
+    uint32_t n;
+    if (c->type == CAP_RAW) {
+        n = (uint32_t) fread(c->buf, 1, RLE_BLOCK_RAW, c->f);
+        dec_bytes(d, c->buf, n, 0);
+    } else {
+        if (c->type == CAP_CONT && cap_ftell(c->f) >= c->end_off) return 0;
+        int res = rle_read_block(c->f, &c->blk, c->buf);
+        if (res <= 0) return res;
+        rle_feed_block(d, &c->blk, c->buf);
+        n = c->blk.raw_len;
+    }
+    c->raw_pos += n;
+    return (int) n;
+}
+
+// file name from pattern with number (frame, event, dump) - pattern is not a printf
+// format, it must have exactly one %u (width and 0 flag allowed, like %05u) and may
+// have %% for a percent sign, returns 0 if ok (1 - bad pattern or name too long)
+static int cap_name (char* out, size_t size, const char* pattern, uint32_t n)
+{
+    int convs = 0;
+    size_t o = 0;
+    for (const char* p = pattern; *p; p++) {
+        char piece[32] = { *p, 0 };
+        if (*p == '%' && p[1] == '%') {
+            p++;
+        } else if (*p == '%') {
+            p++;
+            int zero = (*p == '0');
+            if (zero) p++;
+            int width = 0;
+            for (; *p >= '0' && *p <= '9'; p++) {
+                width = width*10 + (*p - '0');
+                if (width > 20) return 1;
+            }
+            if (*p != 'u' || convs++) return 1;
+            snprintf(piece, sizeof(piece), zero ? "%0*u" : "%*u", width, n);
+        }
+        size_t len = strlen(piece);
+        if (o + len >= size) return 1;
+        memcpy(out + o, piece, len);
+        o += len;
+    }
+    out[o] = 0;
+    return (convs == 1) ? 0 : 1;
+}
+
+// pattern is good for cap_name
+static inline int cap_name_ok (const char* pattern)
+{
+    char name[512];
+    return cap_name(name, sizeof(name), pattern, 0) == 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// fx2c container
+////////////////////////////////////////////////////////////////////////////////
+
+// frame hash is hash64 chained over pieces of frame split at block boundaries,
+// so writer and verifier get same value without holding whole frame in memory
+
+// index entries start at vsync pulses, sequential decoding counts frames from the
+// first sample (leading partial field is frame 0, a field without vsync may complete
+// one more) - writer follows decoder address (dec_walk) so seq of every entry is
+// number of picture it gives in sequential decoding, cont_decode_seq goes the other way
+
+struct cont_writer {
+    FILE*     f;
+    int       mode;
+    uint8_t*  blk;                  // current block raw samples
+    uint32_t  blk_fill;
+    uint8_t*  enc;
+    uint64_t  raw_pos;              // samples written to blocks
+    uint64_t  file_pos;
+    cont_file_hdr hdr;
+    vs_scan   scan;
+    dec_state walk;                 // decoder address only, counts frames of sequential decoding
+    std::vector<uint64_t>   blocks; // file offsets of blocks
+    std::vector<cont_frame> frames;
+    uint64_t  last_t_ns;            // host time of last sample pushed
+    int       error;
+};
+
+// (helper) host time of sample at raw offset off
+static uint64_t cont_sample_time (cont_writer* w, uint64_t off, uint64_t end, uint64_t t_end)
+{
+    if (w->hdr.flags & CONT_SYNTH_TIME) return w->hdr.t0_ns + off * 1000000000ull / SAMPLE_HZ;
+    return t_end - (end - off) * 1000000000ull / SAMPLE_HZ;
+}
+
+// (helper) hash samples [from, to) of current block into frames they belong to
+static void cont_hash_block (cont_writer* w, uint64_t blk_off, uint32_t len)
+{
+    // frames overlapping this block are at the end of table
+    size_t i = w->frames.size();
+    while (i > 0 && w->frames[i-1].raw_off > blk_off) i--;
+    if (i > 0) i--;
+    for (; i<w->frames.size(); i++) {
+        cont_frame* fr = &w->frames[i];
+        uint64_t a = fr->raw_off > blk_off ? fr->raw_off : blk_off;
+        uint64_t b = (i+1 < w->frames.size()) ? w->frames[i+1].raw_off : blk_off + len;
+        if (b > blk_off + len) b = blk_off + len;
+        if (a >= b) continue;
+        fr->hash = hash64(w->blk + (a - blk_off), (size_t)(b - a), fr->hash);
+    }
+}
+
+// (helper) encode and write current block
+static void cont_flush_block (cont_writer* w)
+{
+    if (w->blk_fill == 0) return;
+    cont_hash_block(w, w->raw_pos - w->blk_fill, w->blk_fill);
+    w->blocks.push_back(w->file_pos);
+    uint32_t n = rle_write_block(w->f, w->blk, w->blk_fill, w->enc);
+    if (n == 0) w->error = 1;
+    w->file_pos += n;
+    w->blk_fill = 0;
+}
+
+// create container, t0_ns = 0 means no host times (computed from sample clock)
+static int cont_create (cont_writer* w, const char* fname, int mode, uint64_t t0_ns)
+{
+    w->f = fopen(fname, "wb");
+    if (w->f == NULL) return 1;
+    w->mode = mode;
+    w->blk = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    w->enc = (uint8_t*) malloc(RLE_MAX_ENC);
+    w->blk_fill = 0;
+    w->raw_pos = 0;
+    w->error = 0;
+    w->blocks.clear();
+    w->frames.clear();
+    memset(&w->scan, 0, sizeof(vs_scan));
+    w->scan.mode = mode;
+    memset(&w->walk, 0, sizeof(dec_state));
+    dec_set_mode(&w->walk, mode);
+    memset(&w->hdr, 0, sizeof(cont_file_hdr));
+    w->hdr.magic = CONT_MAGIC;
+    w->hdr.version = CONT_VERSION;
+    w->hdr.mode = (uint8_t)mode;
+    w->hdr.flags = (t0_ns ? 0 : CONT_SYNTH_TIME) | CONT_DEC_SEQ;
+    w->hdr.block_raw = RLE_BLOCK_RAW;
+    w->hdr.t0_ns = t0_ns;
+    w->last_t_ns = t0_ns;
+    if (fwrite(&w->hdr, sizeof(cont_file_hdr), 1, w->f) != 1) w->error = 1;
+    w->file_pos = sizeof(cont_file_hdr);
+    return w->error;
+}
+
+// append samples (already inverted), t_ns - host time of the last one (ignored for synthetic times)
+static void cont_write (cont_writer* w, const uint8_t* p, uint32_t len, uint64_t t_ns)
+{
+    uint64_t end = w->raw_pos + len;
+    if (t_ns) w->last_t_ns = t_ns;
+    while (len > 0) {
+        uint32_t n = RLE_BLOCK_RAW - w->blk_fill;
+        if (n > len) n = len;
+        // index fields starting in this piece
+        uint64_t vs[64];
+        uint32_t found;
+        uint32_t done = 0;
+        while (done < n) {
+            uint32_t part = n - done;
+            if (part > 0x10000) part = 0x10000;     // can't be more than 64 fields in part
+            found = vs_scan_feed(&w->scan, p + done, part, vs, 64);
+            uint32_t walked = 0;
+            for (uint32_t k=0; k<found; k++) {
+                // frame being decoded at vsync is finished by a fresh decoder as its
+                // first buffer, so the second one (picture of entry) is the next frame
+                uint32_t at = (uint32_t)(vs[k] - w->raw_pos);
+                dec_walk(&w->walk, p + done + walked, at - walked);
+                walked = at;
+                cont_frame fr;
+                fr.raw_off = vs[k];
+                fr.t_ns = cont_sample_time(w, vs[k], end, w->last_t_ns);
+                fr.hash = 0xCBF29CE484222325ull;
+                fr.seq = w->walk.seq + 1;
+                fr.len = 0;
+                w->frames.push_back(fr);
+            }
+            dec_walk(&w->walk, p + done + walked, part - walked);
+            memcpy(w->blk + w->blk_fill, p + done, part);
+            w->blk_fill += part;
+            w->raw_pos += part;
+            done += part;
+        }
+        p += n;
+        len -= n;
+        if (w->blk_fill == RLE_BLOCK_RAW) cont_flush_block(w);
+    }
+}
+
+// flush last block, write index and footer, returns 0 if ok
+static int cont_close (cont_writer* w)
+{
+    if (w->f == NULL) return 1;
+    cont_flush_block(w);
+    for (size_t i=0; i<w->frames.size(); i++) {
+        uint64_t next = (i+1 < w->frames.size()) ? w->frames[i+1].raw_off : w->raw_pos;
+        w->frames[i].len = (uint32_t)(next - w->frames[i].raw_off);
+    }
+    cont_footer ft;
+    ft.magic = CONT_IDX_MAGIC;
+    ft.nblocks = (uint32_t) w->blocks.size();
+    ft.nframes = (uint32_t) w->frames.size();
+    ft.index_off = w->file_pos;
+    ft.raw_total = w->raw_pos;
+    ft.crc = crc32_buf((const uint8_t*) w->blocks.data(), w->blocks.size()*sizeof(uint64_t));
+    ft.crc = crc32_buf((const uint8_t*) w->frames.data(), w->frames.size()*sizeof(cont_frame), ft.crc);
+    if (ft.nblocks && fwrite(w->blocks.data(), sizeof(uint64_t), ft.nblocks, w->f) != ft.nblocks) w->error = 1;
+    if (ft.nframes && fwrite(w->frames.data(), sizeof(cont_frame), ft.nframes, w->f) != ft.nframes) w->error = 1;
+    if (fwrite(&ft, sizeof(ft), 1, w->f) != 1) w->error = 1;
+    // frames count is known only now
+    w->hdr.dec_frames = w->walk.seq;
+    if (fseek(w->f, 0, SEEK_SET) != 0 || fwrite(&w->hdr, sizeof(cont_file_hdr), 1, w->f) != 1) w->error = 1;
+    if (fclose(w->f) != 0) w->error = 1;
+    w->f = NULL;
+    free(w->blk);
+    free(w->enc);
+    w->blk = w->enc = NULL;
+    return w->error;
+}
+
+// container opened for random access
+struct cont_reader {
+    FILE*     f;
+    cont_file_hdr hdr;
+    cont_footer   ft;
+    uint8_t*  enc;
+    uint8_t*  raw;                  // last expanded block
+    int64_t   raw_blk;              // its number (-1 none)
+};
+
+static void cont_close_reader (cont_reader* c)
+{
+    if (c->f) fclose(c->f);
+    free(c->enc);
+    free(c->raw);
+    c->f = NULL;
+    c->enc = c->raw = NULL;
+}
+
+// open container and read its footer, returns 0 if ok
+static int cont_open (cont_reader* c, const char* fname)
+{
+    memset(c, 0, sizeof(cont_reader));
+    c->raw_blk = -1;
+    c->f = fopen(fname, "rb");
+    if (c->f == NULL) return 1;
+    if (fread(&c->hdr, sizeof(cont_file_hdr), 1, c->f) != 1 || c->hdr.magic != CONT_MAGIC
+        || c->hdr.version != CONT_VERSION || c->hdr.block_raw == 0 || c->hdr.block_raw > RLE_BLOCK_RAW) {
+        cont_close_reader(c);
+        return 2;
+    }
+    fseek(c->f, -(long)sizeof(cont_footer), SEEK_END);
+    if (fread(&c->ft, sizeof(cont_footer), 1, c->f) != 1 || c->ft.magic != CONT_IDX_MAGIC) {
+        cont_close_reader(c);
+        return 3;
+    }
+    c->enc = (uint8_t*) malloc(RLE_MAX_ENC);
+    c->raw = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    return 0;
+}
+
+// read frame N index entry - O(1), returns 0 if ok
+static int cont_get_frame (cont_reader* c, uint32_t n, cont_frame* fr)
+{
+    if (n >= c->ft.nframes) return 1;
+    cap_fseek(c->f, c->ft.index_off + c->ft.nblocks*sizeof(uint64_t) + (uint64_t)n*sizeof(cont_frame));
+    return fread(fr, sizeof(cont_frame), 1, c->f) == 1 ? 0 : 2;
+}
+
+// read and expand block N (cached), returns raw samples count or <0 on error
+static int cont_get_block (cont_reader* c, uint32_t n)
+{
+    if (n >= c->ft.nblocks) return -1;
+    if (c->raw_blk == (int64_t)n) {
+        return (int)((n+1 < c->ft.nblocks) ? c->hdr.block_raw : c->ft.raw_total - (uint64_t)n*c->hdr.block_raw);
+    }
+    uint64_t off;
+    cap_fseek(c->f, c->ft.index_off + (uint64_t)n*sizeof(uint64_t));
+    if (fread(&off, sizeof(off), 1, c->f) != 1) return -2;
+    cap_fseek(c->f, off);
+    rle_block_hdr h;
+    int res = rle_read_block(c->f, &h, c->enc);
+    if (res <= 0) return -3;
+    uint32_t len = h.raw_len;
+    if (h.type == RLE_TYPE_STORED) memcpy(c->raw, c->enc, len);
+    else if (rle_expand(c->enc, h.enc_len, c->raw, h.raw_len) != len) return -4;
+    c->raw_blk = n;
+    return (int) len;
+}
+
+// read raw samples [off, off+len) into dst, returns samples read
+static uint32_t cont_read_raw (cont_reader* c, uint64_t off, uint8_t* dst, uint32_t len)
+{
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t blk = (uint32_t)((off + done) / c->hdr.block_raw);
+        int n = cont_get_block(c, blk);
+        if (n <= 0) break;
+        uint32_t in_blk = (uint32_t)((off + done) - (uint64_t)blk*c->hdr.block_raw);
+        if (in_blk >= (uint32_t)n) break;
+        uint32_t k = (uint32_t)n - in_blk;
+        if (k > len - done) k = len - done;
+        memcpy(dst + done, c->raw + in_blk, k);
+        done += k;
+    }
+    return done;
+}
+
+// decode single frame N to screen buffer (fresh decoder is fed from end of vsync
+// pulse of the frame until buffer showing it is complete), returns buffer index or <0
+static int cont_decode_frame (cont_reader* c, dec_state* d, uint32_t n, uint8_t* tmp)
+{
+    cont_frame fr;
+    if (cont_get_frame(c, n, &fr) != 0) return -1;
+    d->n_cur = 0; d->seq = 0; d->cur_addr = 0;
+    d->lsync_cnt = dec_vsync_len(d->mode);
+    // picture of the field ends a bit after next vsync (centering offset)
+    uint64_t off = fr.raw_off;
+    uint64_t end = fr.raw_off + fr.len + d->full;
+    if (end > c->ft.raw_total) end = c->ft.raw_total;
+    while (off < end && d->seq < 2) {
+        uint32_t k = (end - off > RLE_BLOCK_RAW) ? RLE_BLOCK_RAW : (uint32_t)(end - off);
+        k = cont_read_raw(c, off, tmp, k);
+        if (k == 0) return -2;
+        dec_bytes(d, tmp, k, 0);
+        off += k;
+    }
+    // first buffer is what was before vsync, second one is the frame
+    return (d->seq >= 2) ? 1 : -3;
+}
+
+// frames of sequential decoding (frame numbers of cont_decode_seq)
+static uint32_t cont_dec_frames (const cont_reader* c)
+{
+    return (c->hdr.flags & CONT_DEC_SEQ) ? c->hdr.dec_frames : c->ft.nframes;
+}
+
+// decode frame k of sequential decoding to screen buffer - decoder starts at the last
+// index entry with seq <= k (at first sample if there is none, leading frames have no
+// entry) and goes on until frame k is complete, returns buffer index or <0
+// (-3 - capture ends before frame k), containers without CONT_DEC_SEQ count index entries
+static int cont_decode_seq (cont_reader* c, dec_state* d, uint32_t k, uint8_t* tmp)
+{
+    if (!(c->hdr.flags & CONT_DEC_SEQ)) return cont_decode_frame(c, d, k, tmp);
+    // entries seq are growing
+    uint32_t lo = 0, hi = c->ft.nframes;
+    cont_frame fr;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cont_get_frame(c, mid, &fr) != 0) return -1;
+        if (fr.seq <= k) lo = mid + 1;
+        else hi = mid;
+    }
+    uint64_t off = 0;
+    uint32_t need = k;              // local frame number of k
+    d->n_cur = 0; d->seq = 0; d->cur_addr = 0; d->lsync_cnt = 0;
+    if (lo > 0) {
+        if (cont_get_frame(c, lo - 1, &fr) != 0) return -1;
+        off = fr.raw_off;
+        need = k - fr.seq + 1;
+        d->lsync_cnt = dec_vsync_len(d->mode);
+    }
+    // pieces of a screen publish at most two frames, so ring keeps frame k
+    while (off < c->ft.raw_total && d->seq <= need) {
+        uint32_t n = (c->ft.raw_total - off > (uint64_t)d->full) ? d->full : (uint32_t)(c->ft.raw_total - off);
+        n = cont_read_raw(c, off, tmp, n);
+        if (n == 0) return -2;
+        dec_bytes(d, tmp, n, 0);
+        off += n;
+    }
+    return (d->seq > need) ? (int)(need & (d->nbuf-1)) : -3;
+}
+
+// check block crcs, index crc and frame hashes (no decoding)
+// returns 0 if all is ok, bad blocks and frames counts are returned too
+static int cont_verify (cont_reader* c, uint32_t* bad_blocks, uint32_t* bad_frames)
+{
+    *bad_blocks = 0;
+    *bad_frames = 0;
+    std::vector<uint64_t>   blocks(c->ft.nblocks);
+    std::vector<cont_frame> frames(c->ft.nframes);
+    std::vector<uint64_t>   hashes(c->ft.nframes, 0xCBF29CE484222325ull);
+    cap_fseek(c->f, c->ft.index_off);
+    if (c->ft.nblocks && fread(blocks.data(), sizeof(uint64_t), c->ft.nblocks, c->f) != c->ft.nblocks) return 1;
+    if (c->ft.nframes && fread(frames.data(), sizeof(cont_frame), c->ft.nframes, c->f) != c->ft.nframes) return 1;
+    uint32_t crc = crc32_buf((const uint8_t*) blocks.data(), blocks.size()*sizeof(uint64_t));
+    crc = crc32_buf((const uint8_t*) frames.data(), frames.size()*sizeof(cont_frame), crc);
+    if (crc != c->ft.crc) return 2;
+    size_t fi = 0;
+    for (uint32_t b=0; b<c->ft.nblocks; b++) {
+        int n = cont_get_block(c, b);
+        if (n <= 0) { (*bad_blocks)++; continue; }
+        uint64_t blk_off = (uint64_t)b * c->hdr.block_raw;
+        // same pieces as cont_hash_block
+        while (fi+1 < frames.size() && frames[fi+1].raw_off <= blk_off) fi++;
+        for (size_t i=fi; i<frames.size() && frames[i].raw_off < blk_off + n; i++) {
+            uint64_t a = frames[i].raw_off > blk_off ? frames[i].raw_off : blk_off;
+            uint64_t e = frames[i].raw_off + frames[i].len;
+            if (e > blk_off + n) e = blk_off + n;
+            if (a >= e) continue;
+            hashes[i] = hash64(c->raw + (a - blk_off), (size_t)(e - a), hashes[i]);
+        }
+    }
+    for (size_t i=0; i<frames.size(); i++) if (hashes[i] != frames[i].hash) (*bad_frames)++;
+    return (*bad_blocks || *bad_frames) ? 3 : 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// memory mapped replay
+////////////////////////////////////////////////////////////////////////////////
+
+// file is mapped by sliding views, so memory stays bounded for any file size
+// and samples are fed to decoder straight from page cache (no read buffers)
+
+#define MAP_VIEW        0x4000000   // 64MB view (multiple of windows allocation granularity)
+
+struct cap_map {
+    uint64_t  size;
+    uint64_t  view_off;             // file offset of current view
+    size_t    view_len;
+    uint8_t*  view;
+#ifdef _WIN32
+    HANDLE    fh;
+    HANDLE    hmap;
+#else
+    int       fd;
+#endif
+};
+
+// (helper) drop current view
+static void map_unview (cap_map* m)
+{
+    if (m->view == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m->view);
+#else
+    // pages already decoded are not needed anymore
+    madvise(m->view, m->view_len, MADV_DONTNEED);
+    munmap(m->view, m->view_len);
+#endif
+    m->view = NULL;
+    m->view_len = 0;
+}
+
+// open file for mapping, returns 0 if ok
+static int map_open (cap_map* m, const char* fname)
+{
+    memset(m, 0, sizeof(cap_map));
+#ifdef _WIN32
+    m->fh = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m->fh == INVALID_HANDLE_VALUE) return 1;
+    LARGE_INTEGER sz;
+    GetFileSizeEx(m->fh, &sz);
+    m->size = (uint64_t) sz.QuadPart;
+    m->hmap = m->size ? CreateFileMappingA(m->fh, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    if (m->size && m->hmap == NULL) { CloseHandle(m->fh); return 2; }
+#else
+    m->fd = open(fname, O_RDONLY);
+    if (m->fd < 0) return 1;
+    struct stat st;
+    if (fstat(m->fd, &st) != 0) { close(m->fd); return 2; }
+    m->size = (uint64_t) st.st_size;
+#endif
+    return 0;
+}
+
+// (helper) map view starting at aligned offset, returns 0 if ok
+static int map_view_at (cap_map* m, uint64_t view_off)
+{
+    map_unview(m);
+    m->view_off = view_off;
+    m->view_len = (m->size - view_off > MAP_VIEW) ? MAP_VIEW : (size_t)(m->size - view_off);
+#ifdef _WIN32
+    m->view = (uint8_t*) MapViewOfFile(m->hmap, FILE_MAP_READ, (DWORD)(view_off >> 32), (DWORD)view_off, m->view_len);
+#else
+    void* p = mmap(NULL, m->view_len, PROT_READ, MAP_SHARED, m->fd, (off_t)view_off);
+    m->view = (p == MAP_FAILED) ? NULL : (uint8_t*) p;
+    if (m->view) madvise(m->view, m->view_len, MADV_SEQUENTIAL);
+#endif
+    if (m->view == NULL) { m->view_len = 0; return 1; }
+    return 0;
+}
+
+// map view covering file offset off, returns pointer to off and bytes available in *len
+// (NULL at end of file or on error)
+static const uint8_t* map_at (cap_map* m, uint64_t off, size_t* len)
+{
+    *len = 0;
+    if (off >= m->size) return NULL;
+    if (m->view == NULL || off < m->view_off || off >= m->view_off + m->view_len) {
+        if (map_view_at(m, off & ~(uint64_t)(MAP_VIEW - 1)) != 0) return NULL;
+    }
+    *len = m->view_len - (size_t)(off - m->view_off);
+    return m->view + (off - m->view_off);
+}
+
+// map range [off, off+need) as one piece (need <= MAP_VIEW/2), NULL if file is shorter
+static const uint8_t* map_range (cap_map* m, uint64_t off, size_t need)
+{
+    if (off + need > m->size || need > MAP_VIEW/2) return NULL;
+    size_t len;
+    const uint8_t* p = map_at(m, off, &len);
+    if (p != NULL && len >= need) return p;
+    // range crosses end of view - shift view by half
+    if (map_view_at(m, off & ~(uint64_t)(MAP_VIEW/2 - 1)) != 0) return NULL;
+    return m->view + (off - m->view_off);
+}
+
+static void map_close (cap_map* m)
+{
+    map_unview(m);
+#ifdef _WIN32
+    if (m->hmap) CloseHandle(m->hmap);
+    CloseHandle(m->fh);
+#else
+    close(m->fd);
+#endif
+}
+
+// decode whole capture (raw, rle or fx2c) from mapped file
+// returns samples decoded, *error is set on broken blocks
+static uint64_t map_replay (cap_map* m, dec_state* d, int* error)
+{
+    *error = 0;
+    size_t len;
+    const uint8_t* p = map_at(m, 0, &len);
+    if (p == NULL) return 0;
+    uint32_t magic = (len >= 4) ? *(const uint32_t*)p : 0;
+    uint64_t total = 0;
+    if (magic != RLE_MAGIC && magic != CONT_MAGIC) {
+        // raw samples - feed views as they are
+        uint64_t off = 0;
+        while ((p = map_at(m, off, &len)) != NULL) {
+            dec_bytes(d, p, (uint32_t)len, 0);
+            off += len;
+        }
+        return off;
+    }
+    // rle blocks - runs are fed from mapped payload
+    uint64_t off = (magic == RLE_MAGIC) ? sizeof(rle_file_hdr) : sizeof(cont_file_hdr);
+    uint64_t end = m->size;
+    if (magic == CONT_MAGIC) {
+        const cont_footer* ft = (const cont_footer*) map_range(m, m->size - sizeof(cont_footer), sizeof(cont_footer));
+        if (ft == NULL || ft->magic != CONT_IDX_MAGIC) { *error = 1; return 0; }
+        end = ft->index_off;
+    }
+    while (off + sizeof(rle_block_hdr) <= end) {
+        const rle_block_hdr* h = (const rle_block_hdr*) map_range(m, off, sizeof(rle_block_hdr));
+        if (h == NULL || h->raw_len > RLE_BLOCK_RAW || h->enc_len > RLE_MAX_ENC) { *error = 1; break; }
+        rle_block_hdr blk = *h;
+        const uint8_t* payload = map_range(m, off + sizeof(rle_block_hdr), blk.enc_len);
+        if (payload == NULL || crc32_buf(payload, blk.enc_len) != blk.crc) { *error = 1; break; }
+        rle_feed_block(d, &blk, payload);
+        total += blk.raw_len;
+        off += sizeof(rle_block_hdr) + blk.enc_len;
+    }
+    return total;
+}
+
+#endif
@@ -0,0 +1,153 @@
+// configuration file - "name = value" lines (decimal or 0x hex), # starts a comment
+// front end describes its settings as table of cfg_item (variable, range or list of values), loads file
+// before pipeline starts and applies command line overrides "name=value" on top
+// cfg_save writes every setting back: window state (CFG_STATE) as it is now, tuning
+// knobs as they were in file - an override on command line is for one run only
+// (header only, shared by fx2bk.cpp and fx2head.cpp)
+
+#ifndef FX2CFG_H
+#define FX2CFG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CFG_STATE       1           // (flag) saved as it is on exit
+
+#define CFG_ERR_SIZE    256         // err buffers hold that much at least
+
+struct cfg_item {
+    const char* name;
+    int       flags;                // CFG_STATE
+    int*      val;
+    int       min;
+    int       max;
+    const char* comment;
+    const int* only;                // values allowed, ascending, last is max (NULL - any in range)
+    int       file_val;             // as in file (default if it is not there)
+};
+
+
+// (helper) trim spaces around s in place
+static char* cfg_trim (char* s)
+{
+    while (*s == ' ' || *s == '\t') s++;
+    size_t n = strlen(s);
+    while (n > 0 && (s[n-1] == ' ' || s[n-1] == '\t' || s[n-1] == '\r' || s[n-1] == '\n')) s[--n] = 0;
+    return s;
+}
+
+// (helper) allowed values as text, "min..max" or list
+static void cfg_range (const cfg_item* it, char* o, int size)
+{
+    if (it->only == NULL) { snprintf(o, size, "%i..%i", it->min, it->max); return; }
+    int len = 0;
+    for (int k=0; len < size; k++) {
+        len += snprintf(o+len, size-len, k ? ", %i" : "%i", it->only[k]);
+        if (it->only[k] >= it->max) break;
+    }
+}
+
+// set setting by name from text, returns 0 if ok
+static int cfg_set (cfg_item* items, int n, const char* name, const char* value, char* err)
+{
+    for (int i=0; i<n; i++) {
+        cfg_item* it = &items[i];
+        if (strcmp(it->name, name) != 0) continue;
+        char* end;
+        long v = strtol(value, &end, 0);
+        if (end == value || *end != 0) {
+            snprintf(err, CFG_ERR_SIZE, "%.64s: '%.64s' is not a number", name, value);
+            return 1;
+        }
+        int ok = (v >= it->min && v <= it->max);
+        if (ok && it->only) {
+            int k = 0;
+            while (it->only[k] < v && it->only[k] < it->max) k++;
+            ok = (it->only[k] == v);
+        }
+        if (!ok) {
+            char range[128];
+            cfg_range(it, range, sizeof(range));
+            snprintf(err, CFG_ERR_SIZE, it->only ? "%.64s: %li is not one of %s" : "%.64s: %li is out of range %s", name, v, range);
+            return 1;
+        }
+        *it->val = (int)v;
+        return 0;
+    }
+    snprintf(err, CFG_ERR_SIZE, "unknown setting %.64s", name);
+    return 1;
+}
+
+// load settings from file (no file - defaults stay), returns 0 if ok
+static int cfg_load (cfg_item* items, int n, const char* fname, char* err)
+{
+    for (int i=0; i<n; i++) items[i].file_val = *items[i].val;
+    FILE* f = fopen(fname, "r");
+    if (f == NULL) return 0;
+    char line[256], msg[CFG_ERR_SIZE];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = 0;
+        char* name = cfg_trim(line);
+        if (*name == 0) continue;
+        char* eq = strchr(name, '=');
+        if (eq == NULL) {
+            snprintf(err, CFG_ERR_SIZE, "%s:%i: no '=' in line", fname, lineno);
+            fclose(f);
+            return 1;
+        }
+        *eq = 0;
+        char* value = cfg_trim(eq + 1);
+        name = cfg_trim(name);
+        if (cfg_set(items, n, name, value, msg) != 0) {
+            snprintf(err, CFG_ERR_SIZE, "%.64s:%i: %.160s", fname, lineno, msg);
+            fclose(f);
+            return 1;
+        }
+        for (int i=0; i<n; i++)
+            if (strcmp(items[i].name, name) == 0) items[i].file_val = *items[i].val;
+    }
+    fclose(f);
+    return 0;
+}
+
+// apply "name=value" overrides, returns 0 if ok
+static int cfg_args (cfg_item* items, int n, int argc, char** argv, char* err)
+{
+    char arg[256];
+    for (int i=0; i<argc; i++) {
+        strncpy(arg, argv[i], sizeof(arg)-1);
+        arg[sizeof(arg)-1] = 0;
+        char* eq = strchr(arg, '=');
+        if (eq == NULL) {
+            snprintf(err, CFG_ERR_SIZE, "unknown argument %.64s (name=value expected)", arg);
+            return 1;
+        }
+        *eq = 0;
+        if (cfg_set(items, n, arg, eq + 1, err) != 0) return 1;
+    }
+    return 0;
+}
+
+// write settings to file, returns 0 if ok
+static int cfg_save (const cfg_item* items, int n, const char* fname)
+{
+    FILE* f = fopen(fname, "w");
+    if (f == NULL) return 1;
+    for (int i=0; i<n; i++) {
+        const cfg_item* it = &items[i];
+        int v = (it->flags & CFG_STATE) ? *it->val : it->file_val;
+        char range[128];
+        cfg_range(it, range, sizeof(range));
+        fprintf(f, "# %s (%s)\n%s = %i\n", it->comment, range, it->name, v);
+    }
+    int err = ferror(f);
+    fclose(f);
+    return err;
+}
+
+#endif
@@ -0,0 +1,401 @@
+// BK0011M / UKNC video signal decoder
+// (header only, shared by fx2bk.cpp and fx2tool.cpp)
+//
+// input is a stream of 8-bit samples (one per pixel clock), bits are:
+// BK   - 0,1 data, 4 sync
+// UKNC - 0..3 color, 4 sync (inverted)
+// live usb data comes inverted, capture files (test/*.bin) are stored already inverted back
+
+#ifndef FX2DEC_H
+#define FX2DEC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MODE_BK         0
+#define MODE_UKNC       1
+
+#define B_SCR_WIDTH     0x00300     // (BK0011M) 768 pix clk in line
+#define B_SCR_HEIGHT    0x00140     // (BK0011M) 320 lines
+#define B_SCR_FULL      0x3C000     // (BK0011M) 245760 pix clk in full screen
+
+#define U_SCR_WIDTH     0x00320     // (UKNC) 800 pix clk in line
+#define U_SCR_HEIGHT    0x00138     // (UKNC) 312 lines
+#define U_SCR_FULL      0x3CF00     // (UKNC) 249600 pix clk in full screen
+
+#define SCR_MAXBUF      0x40000     // max from both full screens plus some extra
+
+#define B_ACT_WIDTH     0x00200     // (BK0011M) 512 pix clk of active video in line
+#define B_ACT_HEIGHT    0x00100     // (BK0011M) 256 lines of active video
+#define U_ACT_WIDTH     0x00280     // (UKNC) 640 pix clk of active video in line
+#define U_ACT_HEIGHT    0x00120     // (UKNC) 288 lines of active video
+
+#define DEC_CAL_FIELDS  25          // fields centering calibration looks at by default
+#define DEC_CAL_SKIP    1           // field skipped first (decoding may start mid-field)
+#define DEC_CAL_TOL_X   8           // picture may be that much off centered active area
+#define DEC_CAL_TOL_Y   4           // before calibration moves it
+
+#define DEC_NBUF        8           // screen buffers in ring by default (power of 2)
+#define DEC_MAXBUF      32          // most buffers ring can have
+
+    // BK palettes
+    uint32_t palette_data[] = {
+        0x000000, 0x0000FF, 0x00FF00, 0xFF0000, // 0 - (special) black/white palette
+        0x000000, 0x0000FF, 0x00FF00, 0xFF0000, // 1 - std palette 0
+        0x000000, 0xFFFF00, 0xFF00FF, 0xFF0000, // .. etc
+        0x000000, 0x00FFFF, 0x0000FF, 0xFF00FF,
+        0x000000, 0x00FF00, 0x00FFFF, 0xFFFF00,
+        0x000000, 0xFF00FF, 0x00FFFF, 0xFFFFFF,
+        0x000000, 0xFFFFFF, 0xFFFFFF, 0xFFFFFF,
+        0x000000, 0xC00000, 0x900000, 0xFF0000,
+        0x000000, 0xC0FF00, 0x90FF00, 0xFFFF00,
+        0x000000, 0xC000FF, 0x9000FF, 0xFF00FF,
+        0x000000, 0x90FF00, 0x9000FF, 0x900000,
+        0x000000, 0xC0FF00, 0xC000FF, 0xC00000,
+        0x000000, 0x00FFFF, 0xFFFF00, 0xFF0000,
+        0x000000, 0xFF0000, 0x00FF00, 0x00FFFF,
+        0x000000, 0x00FFFF, 0xFFFF00, 0xFFFFFF,
+        0x000000, 0xFFFF00, 0x00FF00, 0xFFFFFF,
+        0x000000, 0x00FFFF, 0x00FF00, 0xFFFFFF
+    };
+
+    // UKNC palette
+    uint32_t palette_uknc[16] = {
+        0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080, 0x008080, 0x808080,
+        0x000000, 0xFF0000, 0x00FF00, 0xFFFF00, 0x0000FF, 0xFF00FF, 0x00FFFF, 0xFFFFFF
+    };
+
+struct dec_state;
+typedef void (*dec_frame_fn)(dec_state* d, uint32_t n);
+
+struct dec_state {
+    int       mode;
+    int       width;
+    int       height;
+    int       full;
+    uint32_t* bufs[DEC_MAXBUF];
+    uint32_t  nbuf;                 // buffers in ring (power of 2), frame k is in buffer k & (nbuf-1)
+    volatile uint32_t n_cur;        // buffer being filled now
+    volatile uint32_t seq;          // count of completed frames
+    uint32_t  cur_addr;
+    uint32_t  lsync_cnt;
+    uint8_t   show_sync;
+    uint8_t   palette;
+    dec_frame_fn on_frame;          // (optional) called when buffer n is complete, before switching
+    void*     user;
+    // centering - picture shift from default, address after vsync and x after hsync (UKNC) of it
+    int       ofs_x, ofs_y;
+    uint32_t  vs_addr;
+    int       hs_x;
+    // centering calibration (dec_calibrate), done on complete frames, nothing per sample
+    volatile int cal_request;       // fields to look at, taken by decoder on next frame
+    int       cal_left;             // fields left, 0 - not calibrating
+    int       cal_skip;
+    int       cal_x0, cal_x1;       // box of lit pixels seen so far
+    int       cal_y0, cal_y1;
+    volatile int cal_done;          // calibrations done (result in ofs_x, ofs_y, cal_lit)
+    int       cal_lit;              // last one saw lit pixels (0 - blank screen, shift kept)
+};
+
+
+// picture shift from default centering, pixel clocks right and lines down (clamped
+// to half of screen) - applies from next vsync
+static void dec_set_offset (dec_state* d, int x, int y)
+{
+    if (x < -d->width/2) x = -d->width/2;
+    if (x > d->width/2) x = d->width/2;
+    if (y < -d->height/2) y = -d->height/2;
+    if (y > d->height/2) y = d->height/2;
+    d->ofs_x = x;
+    d->ofs_y = y;
+    // default: picture starts a hsync and 10 (BK) or 9 (UKNC) lines after vsync
+    int64_t a = (d->mode == MODE_BK) ? B_SCR_FULL - 0x38 - B_SCR_WIDTH*10 : U_SCR_FULL - 0x40 - U_SCR_WIDTH*9;
+    a += x + (int64_t)y * d->width;
+    a %= d->full;
+    if (a < 0) a += d->full;
+    d->vs_addr = (uint32_t)a;
+    d->hs_x = x;
+}
+
+
+// sets mode BK or UKNC (screen width and others), keeps picture shift
+static void dec_set_mode (dec_state* d, int mode)
+{
+    d->mode = mode;
+    if (mode == MODE_BK) {
+        d->width  = B_SCR_WIDTH;
+        d->height = B_SCR_HEIGHT;
+        d->full   = B_SCR_FULL;
+    } else {
+        d->width  = U_SCR_WIDTH;
+        d->height = U_SCR_HEIGHT;
+        d->full   = U_SCR_FULL;
+    }
+    dec_set_offset(d, d->ofs_x, d->ofs_y);
+}
+
+// allocate ring of nbuf screen buffers (rounded down to power of 2, 4..DEC_MAXBUF), returns 0 if ok
+static int dec_init (dec_state* d, int mode, int nbuf = DEC_NBUF)
+{
+    memset(d, 0, sizeof(dec_state));
+    d->palette = 1;
+    d->nbuf = 4;
+    while ((int)d->nbuf*2 <= nbuf && d->nbuf < DEC_MAXBUF) d->nbuf *= 2;
+    for (uint32_t i=0; i<d->nbuf; i++) {
+        d->bufs[i] = (uint32_t*) calloc(SCR_MAXBUF, sizeof(uint32_t));
+        if (d->bufs[i] == NULL) return 1;
+    }
+    dec_set_mode(d, mode);
+    return 0;
+}
+
+static void dec_free (dec_state* d)
+{
+    for (int i=0; i<DEC_MAXBUF; i++) { free(d->bufs[i]); d->bufs[i] = NULL; }
+}
+
+// start centering calibration (any thread) - decoder looks at lit pixels of next fields
+// relative to sync and moves picture the least so they are in active area centered
+// on screen (a bigger box is centered itself), a blank screen keeps shift as it is
+// (full screen picture or text from top left corner gives exact result)
+static void dec_calibrate (dec_state* d, int fields = DEC_CAL_FIELDS)
+{
+    d->cal_request = (fields < 1) ? 1 : fields;
+}
+
+// (helper) shift of box lo..hi moving it the least into window of size act centered on
+// screen of size full, with tolerance, or centering it if it is bigger
+static inline int dec_cal_shift (int lo, int hi, int act, int full, int tol)
+{
+    if (hi - lo + 1 >= act) return (full - (hi - lo + 1)) / 2 - lo;
+    int w0 = (full - act) / 2 - tol, w1 = (full + act) / 2 - 1 + tol;
+    if (lo < w0) return w0 - lo;
+    if (hi > w1) return w1 - hi;
+    return 0;
+}
+
+// (helper) calibration over complete buffer n
+static void dec_cal_frame (dec_state* d, uint32_t n)
+{
+    if (d->cal_request) {
+        d->cal_left = d->cal_request;
+        d->cal_skip = DEC_CAL_SKIP;
+        d->cal_request = 0;
+        d->cal_x0 = d->cal_y0 = 0x7FFFFFFF;
+        d->cal_x1 = d->cal_y1 = -1;
+    }
+    if (d->cal_skip > 0) { d->cal_skip--; return; }
+    // lit - not black (sync shown on black is 0x808080)
+    const uint32_t* buf = d->bufs[n];
+    for (int y=0; y<d->height; y++) {
+        const uint32_t* p = buf + (size_t)y * d->width;
+        int x0 = 0, x1 = d->width - 1;
+        while (x0 <= x1 && ((p[x0] & 0xFFFFFF) == 0 || (p[x0] & 0xFFFFFF) == 0x808080)) x0++;
+        if (x0 > x1) continue;
+        while ((p[x1] & 0xFFFFFF) == 0 || (p[x1] & 0xFFFFFF) == 0x808080) x1--;
+        if (x0 < d->cal_x0) d->cal_x0 = x0;
+        if (x1 > d->cal_x1) d->cal_x1 = x1;
+        if (y < d->cal_y0) d->cal_y0 = y;
+        if (y > d->cal_y1) d->cal_y1 = y;
+    }
+    if (--d->cal_left > 0) return;
+    d->cal_lit = (d->cal_x1 >= 0);
+    if (d->cal_lit) {
+        int aw = (d->mode == MODE_BK) ? B_ACT_WIDTH : U_ACT_WIDTH;
+        int ah = (d->mode == MODE_BK) ? B_ACT_HEIGHT : U_ACT_HEIGHT;
+        dec_set_offset(d, d->ofs_x + dec_cal_shift(d->cal_x0, d->cal_x1, aw, d->width, DEC_CAL_TOL_X),
+            d->ofs_y + dec_cal_shift(d->cal_y0, d->cal_y1, ah, d->height, DEC_CAL_TOL_Y));
+    }
+    d->cal_done = d->cal_done + 1;
+}
+
+// current buffer is complete - switch to next one
+static inline void dec_publish (dec_state* d)
+{
+    d->cur_addr = 0;
+    if (d->cal_left > 0 || d->cal_request) dec_cal_frame(d, d->n_cur);
+    if (d->on_frame) d->on_frame(d, d->n_cur);
+    d->n_cur = (d->n_cur + 1) & (d->nbuf-1);
+    d->seq = d->seq + 1;
+}
+
+// sync pulses length analysis, adjusts current address
+static inline uint32_t dec_sync (const dec_state* d, uint32_t lsync_cnt, uint32_t addr)
+{
+    // BK mode
+    if (d->mode == MODE_BK)
+    {
+        // sort of hsync, exact 0x38 low sync signals
+        // seems BK is stable without using hsync (UKNC is not!)
+        //if (lsync_cnt == 0x38) {
+        //    addr = 0x300 * (addr / 0x300);
+        //} else
+        // sort of vsync, exact 0x50 low sync signals
+        if (lsync_cnt == 0x50) {
+            addr = d->vs_addr;      // for centering (dec_set_offset)
+        }
+    // UKNC mode
+    } else {
+        // sort of hsync, exact 0x40 low sync signals
+        if (lsync_cnt == 0x40) {
+            int64_t a = (int64_t)addr - d->hs_x;
+            a = (a > 0) ? a - a % U_SCR_WIDTH + d->hs_x : d->hs_x;
+            addr = (uint32_t)((a < 0) ? a + U_SCR_WIDTH : a);
+        } else
+        // sort of vsync, exact 0x20 low sync signals
+        // to be 100% sure - change to >=0xC0 and adjust current addr with another value
+        if (lsync_cnt == 0x20) {
+            addr = d->vs_addr;      // for centering (dec_set_offset)
+        }
+    }
+    return addr;
+}
+
+// (helper) sync moved address forward - pixels skipped are black, so frame doesn't
+// keep what ring buffer had from an older one (picture depends on signal only)
+static inline void dec_skip (uint32_t* screen_buf, uint32_t from, uint32_t to)
+{
+    for (uint32_t a=from; a<to; a++) screen_buf[a] = 0x000000;
+}
+
+// decode samples (xor'ed with inv first: 0xFF for live usb data, 0 for capture files)
+static void dec_bytes (dec_state* d, const uint8_t* buf, uint32_t len, uint8_t inv)
+{
+    uint32_t* screen_buf = d->bufs[d->n_cur];
+    uint32_t addr = d->cur_addr;
+    uint32_t lsync_cnt = d->lsync_cnt;
+    for (uint32_t i=0; i<len; i++)
+    {
+        // byte of data
+        uint8_t b = buf[i] ^ inv;
+        // filter it just in case
+        b = (d->mode==MODE_BK ? (b & 0x13) : (b & 0x1F));
+        // color dword
+        uint32_t dw = (d->mode==MODE_BK ? (palette_data[(d->palette<<2) | (b&3)]) : palette_uknc[b&0xF]);
+        // sync presence (taken inverted in UKNC)
+        bool have_sync = (d->mode==MODE_BK ? (b == 0x10) : (b == 0x00));
+        if (have_sync) {
+            if (d->show_sync) dw = dw | 0x808080;
+            lsync_cnt++;
+        } else {
+            uint32_t a = dec_sync(d, lsync_cnt, addr);
+            if (a > addr) dec_skip(screen_buf, addr, a);
+            addr = a;
+            lsync_cnt = 0;
+        }
+        screen_buf[addr++] = dw;
+        if (addr >= (uint32_t)d->full) {
+            d->lsync_cnt = lsync_cnt;
+            dec_publish(d);
+            addr = 0;
+            screen_buf = d->bufs[d->n_cur];
+        }
+    }
+    d->cur_addr = addr;
+    d->lsync_cnt = lsync_cnt;
+}
+
+// decode run of count equal samples (already inverted) - same result as dec_bytes
+// over expanded run, but pixels are filled without per-sample work
+static void dec_run (dec_state* d, uint8_t v, uint32_t count)
+{
+    if (count == 0) return;
+    uint8_t b = (d->mode==MODE_BK ? (v & 0x13) : (v & 0x1F));
+    uint32_t dw = (d->mode==MODE_BK ? (palette_data[(d->palette<<2) | (b&3)]) : palette_uknc[b&0xF]);
+    bool have_sync = (d->mode==MODE_BK ? (b == 0x10) : (b == 0x00));
+    if (have_sync) {
+        if (d->show_sync) dw = dw | 0x808080;
+        d->lsync_cnt += count;
+    } else {
+        // only first sample of run can see sync pulse end
+        uint32_t a = dec_sync(d, d->lsync_cnt, d->cur_addr);
+        if (a > d->cur_addr) dec_skip(d->bufs[d->n_cur], d->cur_addr, a);
+        d->cur_addr = a;
+        d->lsync_cnt = 0;
+    }
+    while (count > 0) {
+        uint32_t* screen_buf = d->bufs[d->n_cur];
+        uint32_t addr = d->cur_addr;
+        uint32_t n = (addr < (uint32_t)d->full) ? d->full - addr : 1;
+        if (n > count) n = count;
+        for (uint32_t k=0; k<n; k++) screen_buf[addr+k] = dw;
+        d->cur_addr = addr + n;
+        count -= n;
+        if (d->cur_addr >= (uint32_t)d->full) dec_publish(d);
+    }
+}
+
+// follow decoder address over samples (already inverted) without touching pixels -
+// d->seq counts frames as dec_bytes would, d needs only dec_set_mode (no buffers)
+static void dec_walk (dec_state* d, const uint8_t* buf, uint32_t len)
+{
+    uint8_t  mask = (d->mode == MODE_BK) ? 0x13 : 0x1F;
+    uint8_t  sync = (d->mode == MODE_BK) ? 0x10 : 0x00;
+    uint32_t addr = d->cur_addr;
+    uint32_t lsync_cnt = d->lsync_cnt;
+    for (uint32_t i=0; i<len; i++) {
+        if ((buf[i] & mask) == sync) {
+            lsync_cnt++;
+        } else {
+            addr = dec_sync(d, lsync_cnt, addr);
+            lsync_cnt = 0;
+        }
+        if (++addr >= (uint32_t)d->full) {
+            addr = 0;
+            d->seq = d->seq + 1;
+        }
+    }
+    d->cur_addr = addr;
+    d->lsync_cnt = lsync_cnt;
+}
+
+// black & white palette (BK) - every 2-bit pixel becomes two pixels of its bits
+static void dec_to_bw (uint32_t* buf, uint32_t full)
+{
+    for (uint32_t u=0; u<full; u+=2) {
+        uint32_t b1 = (buf[u] & 0x00000F) ? 0xFFFFFF : 0x000000;
+        uint32_t b2 = (buf[u] & 0x000F00) ? 0xFFFFFF : 0x000000;
+        if (buf[u] & 0x0F0000) { b1=0xFFFFFF; b2=0xFFFFFF; }
+        buf[u] = b1;
+        buf[u+1] = b2;
+    }
+}
+
+// length of sync pulse taken as vsync
+static inline uint32_t dec_vsync_len (int mode)
+{
+    return (mode == MODE_BK) ? 0x50 : 0x20;
+}
+
+// vsync pulses scanner (no decoding) - finds where every field starts
+struct vs_scan {
+    int       mode;
+    uint32_t  cnt;                  // current sync run length
+    uint64_t  pos;                  // samples passed
+};
+
+// scan samples (already inverted), stores offsets of first samples after vsync pulses to out
+// (fresh decoder with lsync_cnt = dec_vsync_len() fed from there starts the field)
+// returns count of pulses found (not more than max_out)
+static uint32_t vs_scan_feed (vs_scan* s, const uint8_t* p, uint32_t len, uint64_t* out, uint32_t max_out)
+{
+    uint32_t found = 0;
+    uint8_t  mask  = (s->mode == MODE_BK) ? 0x13 : 0x1F;
+    uint8_t  sync  = (s->mode == MODE_BK) ? 0x10 : 0x00;
+    uint32_t vlen  = dec_vsync_len(s->mode);
+    uint32_t cnt = s->cnt;
+    for (uint32_t i=0; i<len; i++) {
+        if ((p[i] & mask) == sync) {
+            cnt++;
+        } else {
+            if (cnt == vlen && found < max_out) out[found++] = s->pos + i;
+            cnt = 0;
+        }
+    }
+    s->cnt = cnt;
+    s->pos += len;
+    return found;
+}
+
+#endif
@@ -0,0 +1,116 @@
+// offscreen framebuffer - presentation target without any windowing system
+// sink thread takes every completed frame from decoder ring in order, copies it to
+// the framebuffer and hands it to on_frame (dump, hash, stream ...)
+// replay can hold decoding until sink catches up (fb_wait), live acquisition never
+// waits - frames sink could not take in time are counted as skipped
+
+#ifndef FX2FB_H
+#define FX2FB_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fx2dec.h"
+#include "fx2stat.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+
+struct fb_state;
+typedef void (*fb_frame_fn)(fb_state* fb, uint32_t seq);
+
+struct fb_state {
+    dec_state* d;
+    uint32_t* pix;                  // framebuffer (d->width x d->height)
+    uint32_t  next_seq;             // next frame to take
+    uint64_t  t_first;              // time first frame was presented
+    uint64_t  t_last;
+    uint64_t  cpu;                  // sink thread cpu time, ns
+    std::thread th;
+    std::atomic<int> active;
+    std::atomic<uint32_t> frames;   // frames presented
+    std::atomic<uint32_t> skipped;
+    fb_frame_fn on_frame;           // (optional) sinks
+    void*     user;
+};
+
+
+// (thread) present frames as they come
+static void fb_thread_proc (fb_state* fb)
+{
+    dec_state* d = fb->d;
+    uint64_t cpu0 = cpu_ns(0);
+    met_thread("present");
+    trace_thread("present");
+    for (;;) {
+        uint32_t seq = d->seq;
+        if (fb->next_seq == seq) {
+            if (fb->active.load() == 0) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        // frame k is in buffer k % nbuf, safe while less than nbuf-1 newer ones are done
+        if (seq - fb->next_seq > d->nbuf - 2) {
+            fb->skipped += seq - 1 - fb->next_seq;
+            met_add(MET_DROPPED, seq - 1 - fb->next_seq);
+            fb->next_seq = seq - 1;
+        }
+        uint32_t k = fb->next_seq;
+        uint64_t t0 = time_ns();
+        met_gauge(MET_G_FRAME_LAG, seq - 1 - k);
+        trace_begin("present", k);
+        memcpy(fb->pix, d->bufs[k & (d->nbuf-1)], d->full*sizeof(uint32_t));
+        fb->next_seq = k + 1;
+        if (d->seq - k > d->nbuf - 2) {
+            fb->skipped++;                  // overwritten while copying
+            met_add(MET_DROPPED, 1);
+            trace_end("present");
+            continue;
+        }
+        if (d->palette == 0 && d->mode == MODE_BK) dec_to_bw(fb->pix, d->full);
+        if (fb->on_frame) fb->on_frame(fb, k);
+        fb->t_last = time_ns();
+        met_hist(MET_H_PRESENT, fb->t_last - t0);
+        trace_end("present");
+        if (fb->frames++ == 0) fb->t_first = fb->t_last;
+        fb->cpu = cpu_ns(0) - cpu0;
+    }
+    fb->cpu = cpu_ns(0) - cpu0;
+}
+
+// allocate framebuffer and start presenting frames completed from now on, returns 0 if ok
+static int fb_start (fb_state* fb, dec_state* d)
+{
+    fb->d = d;
+    fb->pix = (uint32_t*) malloc(SCR_MAXBUF*sizeof(uint32_t));
+    if (fb->pix == NULL) return 1;
+    fb->next_seq = d->seq;
+    fb->t_first = fb->t_last = 0;
+    fb->cpu = 0;
+    fb->frames = 0;
+    fb->skipped = 0;
+    fb->active = 1;
+    fb->th = std::thread(fb_thread_proc, fb);
+    return 0;
+}
+
+// (producer, from decoder on_frame) wait until sink is far enough from buffer
+// about to be reused - no frame is skipped then
+static void fb_wait (fb_state* fb)
+{
+    while (fb->active.load() && fb->d->seq + 1 - fb->next_seq > fb->d->nbuf - 2)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+// present what is left and stop
+static void fb_stop (fb_state* fb)
+{
+    fb->active = 0;
+    if (fb->th.joinable()) fb->th.join();
+    free(fb->pix);
+    fb->pix = NULL;
+}
+
+#endif
@@ -0,0 +1,179 @@
+// temporal noise filter - per pixel majority over last 3 or 5 frames, against single
+// sample sparkle of marginal signals (it spoils screenshots and blows up recordings)
+// every frame is mapped to 8-bit palette indices (decoder makes a few dozen colors at
+// most) into a ring of depth index frames; a pixel takes the value most of them agree
+// on (2 of 3, 3 of 5), otherwise it stays as in newest frame, and only pixels that came
+// out different are written back to the frame in place
+// SSE2 compares 16 packed indices per step, plain C elsewhere (flt_frame_ref is the
+// reference); memory is depth bytes per pixel (5 x 250 KB at most)
+// (header only, used from decoder on_frame of fx2bk.cpp, fx2head.cpp and fx2tool.cpp)
+
+#ifndef FX2FLT_H
+#define FX2FLT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "fx2dec.h"
+#include "fx2stat.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLT_SSE2
+#include <emmintrin.h>
+#endif
+
+#define FLT_MAXDEPTH    5
+#define FLT_MAXCOL      256
+#define FLT_MAP         1024        // color map slots (power of 2)
+
+struct flt_state {
+    int       depth;                // 3 or 5, 0 - off
+    uint32_t  full;                 // pixels in frame
+    uint8_t*  ring[FLT_MAXDEPTH];   // index frames, newest is (hist-1) % depth
+    uint8_t*  out;                  // filtered indices
+    uint32_t  hist;                 // frames taken since reset
+    uint32_t  frames;               // frames taken
+    uint32_t  pal[FLT_MAXCOL];      // index -> color
+    int       npal;
+    uint32_t  map_key[FLT_MAP];     // color | 0x80000000 -> index
+    uint8_t   map_val[FLT_MAP];
+    uint64_t  changed;              // pixels filtered out
+    uint64_t  ns;                   // time spent
+};
+
+
+// set depth (3 or 5, anything else is off) for frames of full pixels, returns 0 if ok
+static int flt_init (flt_state* f, int depth, uint32_t full)
+{
+    memset(f, 0, sizeof(flt_state));
+    if (depth != 3 && depth != 5) return 0;
+    f->depth = depth;
+    f->full = full;
+    for (int i=0; i<=depth; i++) {
+        uint8_t* p = (uint8_t*) malloc(full + 16);
+        if (p == NULL) return 1;
+        if (i < depth) f->ring[i] = p; else f->out = p;
+    }
+    return 0;
+}
+
+static void flt_free (flt_state* f)
+{
+    for (int i=0; i<FLT_MAXDEPTH; i++) { free(f->ring[i]); f->ring[i] = NULL; }
+    free(f->out);
+    f->out = NULL;
+    f->depth = 0;
+}
+
+// frames before this one are not related (mode or palette switch, seek)
+static void flt_reset (flt_state* f)
+{
+    f->hist = 0;
+}
+
+// (helper) color -> index, new colors are appended
+static inline uint8_t flt_index (flt_state* f, uint32_t color)
+{
+    uint32_t key = color | 0x80000000;
+    uint32_t h = (color * 0x9E3779B1u) >> 22;
+    while (f->map_key[h] != 0) {
+        if (f->map_key[h] == key) return f->map_val[h];
+        h = (h + 1) & (FLT_MAP-1);
+    }
+    if (f->npal >= FLT_MAXCOL) return FLT_MAXCOL - 1;   // can't happen with decoder colors
+    f->map_key[h] = key;
+    f->map_val[h] = (uint8_t)f->npal;
+    f->pal[f->npal] = color;
+    return (uint8_t)f->npal++;
+}
+
+// (helper) majority of i-th pixel of frames r (r[0] newest), plain C
+static inline uint8_t flt_major (const uint8_t* const* r, int depth, uint32_t i)
+{
+    uint8_t n = r[0][i], a = r[1][i], b = r[2][i];
+    if (depth == 3) return (a == b) ? a : n;
+    uint8_t c = r[3][i], d = r[4][i];
+    if ((a == n) + (a == b) + (a == c) + (a == d) >= 2) return a;
+    if ((b == n) + (b == a) + (b == c) + (b == d) >= 2) return b;
+    return n;
+}
+
+// reference - majority of frames r into out, plain C
+static void flt_frame_ref (const uint8_t* const* r, int depth, uint32_t full, uint8_t* out)
+{
+    for (uint32_t i=0; i<full; i++) out[i] = flt_major(r, depth, i);
+}
+
+// (helper) majority of frames r into out, 16 pixels per step
+static void flt_majority (const uint8_t* const* r, int depth, uint32_t full, uint8_t* out)
+{
+    uint32_t i = 0;
+#ifdef FLT_SSE2
+    const __m128i m1 = _mm_set1_epi8(-1);   // sum of two or more -1 masks is below it
+    for (; i+16<=full; i+=16) {
+        __m128i n = _mm_loadu_si128((const __m128i*)(r[0]+i));
+        __m128i a = _mm_loadu_si128((const __m128i*)(r[1]+i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(r[2]+i));
+        __m128i res;
+        if (depth == 3) {
+            // a == b ? a : n
+            __m128i m = _mm_cmpeq_epi8(a, b);
+            res = _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, n));
+        } else {
+            __m128i c = _mm_loadu_si128((const __m128i*)(r[3]+i));
+            __m128i d = _mm_loadu_si128((const __m128i*)(r[4]+i));
+            __m128i ab = _mm_cmpeq_epi8(a, b);
+            // equal ones count as -1, 2 more of same value make majority
+            __m128i sa = _mm_add_epi8(_mm_add_epi8(_mm_cmpeq_epi8(a, n), ab),
+                                      _mm_add_epi8(_mm_cmpeq_epi8(a, c), _mm_cmpeq_epi8(a, d)));
+            __m128i sb = _mm_add_epi8(_mm_add_epi8(_mm_cmpeq_epi8(b, n), ab),
+                                      _mm_add_epi8(_mm_cmpeq_epi8(b, c), _mm_cmpeq_epi8(b, d)));
+            __m128i ma = _mm_cmplt_epi8(sa, m1);
+            __m128i mb = _mm_andnot_si128(ma, _mm_cmplt_epi8(sb, m1));
+            res = _mm_or_si128(_mm_or_si128(_mm_and_si128(ma, a), _mm_and_si128(mb, b)),
+                               _mm_andnot_si128(_mm_or_si128(ma, mb), n));
+        }
+        _mm_storeu_si128((__m128i*)(out+i), res);
+    }
+#endif
+    for (; i<full; i++) out[i] = flt_major(r, depth, i);
+}
+
+// filter frame of f->full pixels in place (first depth-1 frames after reset only fill
+// history), returns pixels changed
+static uint32_t flt_frame (flt_state* f, uint32_t* pix)
+{
+    if (f->depth == 0) return 0;
+    uint64_t t0 = time_ns();
+    // map newest frame, pixels come in runs
+    uint8_t* q = f->ring[f->hist % f->depth];
+    uint32_t last = pix[0] ^ 1;
+    uint8_t last_i = 0;
+    for (uint32_t i=0; i<f->full; i++) {
+        if (pix[i] != last) { last = pix[i]; last_i = flt_index(f, last); }
+        q[i] = last_i;
+    }
+    f->hist++;
+    f->frames++;
+    uint32_t changed = 0;
+    if (f->hist >= (uint32_t)f->depth) {
+        const uint8_t* r[FLT_MAXDEPTH];
+        for (int k=0; k<f->depth; k++) r[k] = f->ring[(f->hist - 1 - k) % f->depth];
+        flt_majority(r, f->depth, f->full, f->out);
+        // write back what differs from newest, 8 pixels per compare
+        const uint8_t* o = f->out;
+        for (uint32_t i=0; i<f->full; i+=8) {
+            uint64_t x, y;
+            memcpy(&x, o+i, 8);
+            memcpy(&y, q+i, 8);
+            if (x == y) continue;
+            for (uint32_t k=i; k<i+8 && k<f->full; k++)
+                if (o[k] != q[k]) { pix[k] = f->pal[o[k]]; changed++; }
+        }
+        f->changed += changed;
+    }
+    f->ns += time_ns() - t0;
+    return changed;
+}
+
+#endif
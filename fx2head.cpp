@@ -0,0 +1,664 @@
+// compile:
+//   linux:   g++ -O2 -pthread fx2head.cpp -o fx2head -lusb-1.0
+//            g++ -O2 -pthread -DFX2_NO_USB fx2head.cpp -o fx2head   (replay only, no libusb)
+//   windows: cl /O2 /EHsc fx2head.cpp
+//
+// headless front end - no window, frames go to offscreen framebuffer (fx2fb.h)
+// from live FX2 acquisition or replayed capture file, and from there to sinks:
+//   hash of all presented frames, image dumps, video/animation stream
+// prints frames/s and cpu time per frame when done (Ctrl+C, -n or -t), optionally
+// pipeline metrics as JSON lines every second (fx2met.h) and timeline of all threads
+// as Chrome trace JSON (fx2trace.h)
+// with -S decoder ring lives in named shared memory (fx2shm.h) and other processes
+// read frames from there in place (fx2tool watch), so it can run as capture daemon
+// -W serves frames on local tcp port (fx2net.h): browser viewer at http://127.0.0.1:port/,
+// websocket or plain tcp stream of keyframe and changed lines (fx2tool netwatch)
+// -x reads screen text of every frame with font file (fx2txt.h) and prints it when it
+// changes, for test scripts waiting for a prompt or an error message
+// -C records only when screen changes (fx2trig.h): stream (-o, new file for every event
+// if name has %u) and dumps (-d, frame that made event) get frames of events with pre/post
+// roll, for overnight sessions
+// -P keeps last seconds of raw signal in memory (fx2pre.h) and saves them to capture file
+// on every -C event or SIGUSR1, without stopping acquisition
+// noise_filter=3|5 takes every pixel as most of last 3 or 5 frames agree (fx2flt.h) before
+// frames reach any sink, against single sample sparkle of a marginal signal
+// pipeline knobs (usb transfer size and count, screen buffers ring, picture centering) come
+// from -c config file (fx2cfg.h, same names as fx2bk.cfg) and name=value arguments
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fx2dec.h"
+#include "fx2cap.h"
+#include "fx2stat.h"
+#include "fx2fb.h"
+#include "fx2img.h"
+#include "fx2vid.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+#include "fx2sig.h"
+#include "fx2cfg.h"
+#include "fx2shm.h"
+#include "fx2net.h"
+#include "fx2txt.h"
+#include "fx2flt.h"
+#include "fx2trig.h"
+#include "fx2pre.h"
+#ifndef FX2_NO_USB
+#include "fx2usb.h"
+#ifdef _WIN32
+#pragma comment(lib, "lib/libusb-1.0.lib")
+#endif
+#else
+    int stop = 0;
+    char error[1024];
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Options
+////////////////////////////////////////////////////////////////////////////////
+
+    int   opt_mode = -1;            // -m, <0 - BK live, from file or guess for replay
+    int   opt_palette = 1;          // -p
+    int   opt_show_sync = 0;        // -s
+    const char* opt_replay = NULL;  // -r, capture file instead of device
+    int   opt_realtime = 0;         // -rt, replay at 12 MHz sample rate
+    uint32_t opt_frames = 0;        // -n, stop after frames presented (0 - no limit)
+    double opt_seconds = 0;         // -t, stop after seconds (0 - no limit)
+    const char* opt_dump = NULL;    // -d, image file name pattern
+    int   opt_every = 50;           // -e, dump every Nth frame
+    const char* opt_out = NULL;     // -o, video stream output
+    int   opt_video = VID_Y4M;      // -f
+    int   opt_quiet = 0;            // -q, no per second status
+    const char* opt_metrics = NULL; // -M, metrics JSON output
+    int   opt_metrics_ms = 1000;    // -Mi, metrics dump interval
+    const char* opt_trace = NULL;   // -T, timeline output
+    int   opt_analyze = 0;          // -A, signal quality report
+    const char* opt_config = NULL;  // -c, config file
+    const char* opt_shm = NULL;     // -S, shared memory ring name
+    int   opt_port = 0;             // -W, stream server port
+    const char* opt_font = NULL;    // -x, font file of text extraction
+    int   opt_trigger = 0;          // -C, changed lines which start recording (0 - record all)
+    int   opt_pre = 25;             // -C, frames before change
+    int   opt_post = 50;            // -C, frames after last change
+    const char* opt_pre_dump = NULL; // -P, signal dump file name pattern
+    int   opt_pre_seconds = 10;     // (config) signal kept for -P
+    int   opt_pre_memory = 32;      // (config) MB
+    int   opt_pre_rle = 1;          // (config) compressed
+    int   opt_buffers = DEC_NBUF;   // (config) screen buffers ring
+    int   opt_centering = 1;        // (config) calibrate picture shift over first fields
+    int   opt_offset_x = 0;         // (config) picture shift
+    int   opt_offset_y = 0;
+    int   opt_noise = 0;            // (config) temporal noise filter depth
+    char* opt_sets[32];             // name=value overrides of config
+    int   opt_nsets = 0;
+
+    const int noise_depths[] = { 0, 3, 5 };
+    cfg_item cfg_items[] = {
+#ifndef FX2_NO_USB
+        { "chunk_size",    0, &tr_chunk_size, 0x200, 0x400000, "usb transfer size, bytes (multiple of 512, about 10 ms of signal)", NULL, 0 },
+        { "transfers",     0, &tr_count,      1, 64,           "usb transfers in flight", NULL, 0 },
+#endif
+        { "frame_buffers", 0, &opt_buffers,   4, DEC_MAXBUF,   "decoder screen buffers ring (power of 2)", NULL, 0 },
+        { "centering",     0, &opt_centering, 0, 1,            "1 - calibrate picture shift from signal on start, 0 - take offset_x/y as they are", NULL, 0 },
+        { "offset_x",      0, &opt_offset_x,  -400, 400,       "picture shift right, pixel clocks", NULL, 0 },
+        { "offset_y",      0, &opt_offset_y,  -160, 160,       "picture shift down, lines", NULL, 0 },
+        { "pre_seconds",   0, &opt_pre_seconds, 1, 87,         "raw signal kept in memory for -P dumps, seconds", NULL, 0 },
+        { "pre_memory",    0, &opt_pre_memory, 1, 1024,        "memory for it, MB (holds less than pre_seconds if signal does not fit)", NULL, 0 },
+        { "pre_rle",       0, &opt_pre_rle,   0, 1,            "1 - run length compressed in memory, dumps are rle files, 0 - plain samples", NULL, 0 },
+        { "noise_filter",  0, &opt_noise,     0, 5,            "temporal noise filter, majority of pixel over 3 or 5 frames (0 - off)", noise_depths, 0 },
+    };
+    const int cfg_count = sizeof(cfg_items) / sizeof(cfg_items[0]);
+
+    const char* mode_names[2] = { "BK", "UKNC" };
+
+
+void usage ()
+{
+    printf("usage: fx2head [options]\n"
+        "  -m bk|uknc       mode (BK by default, replay takes it from file)\n"
+        "  -p 0..15         BK palette (0 - black & white)\n"
+        "  -s               show sync\n"
+        "  -r <capture>     replay capture file instead of live FX2 acquisition\n"
+        "  -rt              replay in real time (as fast as possible by default)\n"
+        "  -n <frames>      stop after frames\n"
+        "  -t <seconds>     stop after seconds\n"
+        "  -d <pattern>     dump frames to images, like frame%%05u.png (.bmp, .qoi)\n"
+        "  -e <every>       dump every Nth frame (50)\n"
+        "  -o <out|-|\"|cmd\"> stream frames to video file, stdout or pipe\n"
+        "  -f y4m|raw|gif|apng  stream format\n"
+        "  -q               no status line every second\n"
+        "  -M <file|->      dump pipeline metrics as JSON lines to file or stdout\n"
+        "  -Mi <ms>         metrics dump interval (1000)\n"
+        "  -T <file>        record timeline of all threads, Chrome trace JSON (ui.perfetto.dev)\n"
+        "  -A               signal quality report (every 4th transfer live, whole replay)\n"
+        "  -S <name>        publish frames to shared memory ring for other processes (/fx2, Local\\fx2)\n"
+        "  -W <port>        serve frames on 127.0.0.1:port (browser viewer, websocket or plain tcp stream)\n"
+        "  -x <font.txt>    read screen text with font, print it when it changes (stderr if video goes to stdout)\n"
+        "  -C <lines>[,pre[,post]]  record (-o, -d) only when that many lines change, with pre/post roll frames\n"
+        "                   (25, 50); -o name with %%u - file per event, -d - frame that made event\n"
+        "  -P <name%%u.rle>  keep last seconds of raw signal (pre_seconds), save it on every -C event or SIGUSR1\n"
+        "  -c <file>        config file (chunk_size, transfers, frame_buffers, centering, offset_x/y, pre_*, noise_filter = value lines)\n"
+        "  name=value       config setting for this run, over the file\n");
+}
+
+// returns 0 if ok
+int parse_options (int argc, char** argv)
+{
+    for (int i=0; i<argc; i++) {
+        const char* a = argv[i];
+        int more = (i+1 < argc);
+        if (strcmp(a, "-m") == 0 && more) {
+            i++;
+            if (strcmp(argv[i], "bk") == 0) opt_mode = MODE_BK;
+            else if (strcmp(argv[i], "uknc") == 0) opt_mode = MODE_UKNC;
+            else { fprintf(stderr, "unknown mode %s\n", argv[i]); return 1; }
+        } else if (strcmp(a, "-p") == 0 && more) {
+            opt_palette = atoi(argv[++i]) & 0x0F;
+        } else if (strcmp(a, "-s") == 0) {
+            opt_show_sync = 1;
+        } else if (strcmp(a, "-r") == 0 && more) {
+            opt_replay = argv[++i];
+        } else if (strcmp(a, "-rt") == 0) {
+            opt_realtime = 1;
+        } else if (strcmp(a, "-n") == 0 && more) {
+            opt_frames = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(a, "-t") == 0 && more) {
+            opt_seconds = atof(argv[++i]);
+        } else if (strcmp(a, "-d") == 0 && more) {
+            opt_dump = argv[++i];
+        } else if (strcmp(a, "-e") == 0 && more) {
+            opt_every = atoi(argv[++i]);
+            if (opt_every < 1) opt_every = 1;
+        } else if (strcmp(a, "-o") == 0 && more) {
+            opt_out = argv[++i];
+        } else if (strcmp(a, "-f") == 0 && more) {
+            i++;
+            if (strcmp(argv[i], "y4m") == 0) opt_video = VID_Y4M;
+            else if (strcmp(argv[i], "raw") == 0) opt_video = VID_RAW;
+            else if (strcmp(argv[i], "gif") == 0) opt_video = VID_GIF;
+            else if (strcmp(argv[i], "apng") == 0) opt_video = VID_APNG;
+            else { fprintf(stderr, "unknown stream format %s\n", argv[i]); return 1; }
+        } else if (strcmp(a, "-q") == 0) {
+            opt_quiet = 1;
+        } else if (strcmp(a, "-M") == 0 && i+1 < argc) {
+            opt_metrics = argv[++i];
+        } else if (strcmp(a, "-Mi") == 0 && i+1 < argc) {
+            opt_metrics_ms = atoi(argv[++i]);
+        } else if (strcmp(a, "-T") == 0 && i+1 < argc) {
+            opt_trace = argv[++i];
+        } else if (strcmp(a, "-A") == 0) {
+            opt_analyze = 1;
+        } else if (strcmp(a, "-S") == 0 && more) {
+            opt_shm = argv[++i];
+        } else if (strcmp(a, "-W") == 0 && more) {
+            opt_port = atoi(argv[++i]);
+        } else if (strcmp(a, "-x") == 0 && more) {
+            opt_font = argv[++i];
+        } else if (strcmp(a, "-C") == 0 && more) {
+            if (sscanf(argv[++i], "%i,%i,%i", &opt_trigger, &opt_pre, &opt_post) < 1 || opt_trigger < 1) {
+                fprintf(stderr, "bad change trigger %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(a, "-P") == 0 && more) {
+            opt_pre_dump = argv[++i];
+        } else if (strcmp(a, "-c") == 0 && more) {
+            opt_config = argv[++i];
+        } else if (a[0] != '-' && strchr(a, '=') && opt_nsets < 32) {
+            opt_sets[opt_nsets++] = argv[i];
+        } else {
+            fprintf(stderr, "unknown option %s\n", a);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Pipeline
+////////////////////////////////////////////////////////////////////////////////
+
+    dec_state dec;                  // decoder and screen buffers ring
+    fb_state  fb;                   // offscreen framebuffer
+    vid_state vid;                  // (-o) stream sink
+    std::vector<uint8_t> dump_buf;  // (-d) encoded image
+    uint64_t  frames_hash;          // hash of all presented frames
+    uint32_t  dump_count;
+    met_dumper met;                 // (-M) metrics dump
+    sig_state sig;                  // (-A) signal analysis
+    shm_ring  shm;                  // (-S) shared memory ring
+    net_server net;                 // (-W) stream server
+    txt_font  font;                 // (-x) text extraction
+    txt_screen screen;
+    FILE*     text_out;
+    uint64_t  text_ns;              // spent reading text
+    uint32_t  text_changes;
+    flt_state noise;                // (config) temporal noise filter
+    trg_state trig;                 // (-C) change trigger
+    int       out_per_event;        // (-C) new stream file for every event
+    uint32_t  stream_frames;        // (-o) frames streamed (all files)
+    pre_ring  pre;                  // (-P) last seconds of raw signal
+    volatile int pre_request = 0;   // SIGUSR1
+    int       stream_error;
+    uint64_t  t_chunk;              // completion of transfer (or replay chunk) being decoded
+    uint64_t  t_prev_chunk;
+    volatile int quit = 0;          // Ctrl+C or limits reached
+
+
+// (sink thread) dump frame k to image
+void dump_frame (const uint32_t* pix, uint32_t k)
+{
+    char fname[512];
+    cap_name(fname, sizeof(fname), opt_dump, k);
+    if (img_write(fname, img_format_by_name(fname), pix, dec.width, dec.height, 2, dump_buf) != 0)
+        fprintf(stderr, "unable to write %s\n", fname);
+    else
+        dump_count++;
+}
+
+// (sink thread) frame to stream
+void stream_frame (const uint32_t* pix)
+{
+    if (vid.f == NULL) return;
+    vid_frame(&vid, pix);
+    stream_frames++;
+}
+
+// (any thread) save signal ring to next dump file
+void pre_save ()
+{
+    uint32_t n = pre_dump(&pre, opt_pre_dump, dec.mode);
+    if (n == 0 || opt_quiet) return;
+    char fname[512];
+    cap_name(fname, sizeof(fname), opt_pre_dump, n);
+    fprintf(stderr, "signal: last %.1f s to %s\n", pre_span(&pre), fname);
+}
+
+// (sink thread) frame k changed screen, event starts
+void trig_on_start (trg_state* t, const uint32_t* pix, uint32_t k)
+{
+    if (!opt_quiet) fprintf(stderr, "event %u: change at frame %u, %u lines\n", t->events, k, t->changed_lines);
+    if (opt_pre_dump) pre_save();
+    if (opt_dump) dump_frame(pix, k);
+    if (opt_out && out_per_event) {
+        char fname[512];
+        cap_name(fname, sizeof(fname), opt_out, t->events);
+        if (vid_open(&vid, fname, opt_video, dec.width, dec.height) != 0) {
+            fprintf(stderr, "unable to open stream output %s\n", fname);
+            vid_close(&vid);
+            stream_error = 1;
+        }
+    }
+}
+
+void trig_on_frame (trg_state*, const uint32_t* pix, uint32_t)
+{
+    stream_frame(pix);
+}
+
+// (sink thread) k was last frame of event
+void trig_on_stop (trg_state* t, uint32_t k)
+{
+    if (!opt_quiet) fprintf(stderr, "event %u: ends at frame %u\n", t->events, k);
+    if (opt_out && out_per_event) {
+        vid_close(&vid);
+        stream_error |= vid.io_error;
+    }
+}
+
+// (sink thread) frame k is in framebuffer
+void fb_on_frame (fb_state* f, uint32_t k)
+{
+    const dec_state* d = f->d;
+    frames_hash = hash64(f->pix, d->full*sizeof(uint32_t), frames_hash);
+    if (opt_trigger) {
+        trg_frame(&trig, f->pix, k);
+    } else {
+        if (opt_dump && k % opt_every == 0) dump_frame(f->pix, k);
+        stream_frame(f->pix);
+    }
+    if (opt_font) {
+        uint64_t h = screen.hash;
+        uint64_t t0 = time_ns();
+        txt_read(&font, f->pix, d->width, d->height, &screen);
+        text_ns += time_ns() - t0;
+        if (screen.hash != h || text_changes == 0) {
+            fprintf(text_out, "frame %u text:\n", k);
+            txt_print(&screen, text_out);
+            fflush(text_out);
+            text_changes++;
+        }
+    }
+    if (opt_frames && f->frames + 1 >= opt_frames) quit = 1;
+}
+
+// (decoder) frame published, replay must not run over the sink
+void dec_on_frame (dec_state* d, uint32_t n)
+{
+    met_add(MET_FRAMES, 1);
+    met_hist(MET_H_PUBLISH, time_ns() - t_chunk);
+    trace_instant("publish", d->seq);
+    flt_frame(&noise, d->bufs[n]);
+    if (opt_shm) shm_publish(&shm, d, n);
+    if (opt_port) net_publish(&net, n);
+    if (opt_replay && !opt_realtime) {
+        trace_begin("wait sink");
+        fb_wait(&fb);
+        trace_end("wait sink");
+    }
+}
+
+// (helper) count chunk of samples which came at t
+void chunk_count (uint64_t t, uint32_t len)
+{
+    if (t_prev_chunk) met_hist(MET_H_INTERVAL, t - t_prev_chunk);
+    t_prev_chunk = t;
+    met_add(MET_TRANSFERS, 1);
+    met_add(MET_BYTES, len);
+}
+
+void on_signal (int sig)
+{
+#ifdef SIGUSR1
+    if (sig == SIGUSR1) {
+        pre_request = 1;
+        return;
+    }
+#endif
+    quit = 1;
+}
+
+#ifndef FX2_NO_USB
+// usb transfer done - decode and resubmit
+void LIBUSB_CALL cb_transfer_complete (libusb_transfer *t)
+{
+    nactive--;
+    if (t == NULL || stop) return;
+    if (t->actual_length == 0) {
+        met_add(MET_EMPTY, 1);
+        trace_instant("empty transfer");
+        return;
+    }
+    ++handled_count;
+    if (opt_analyze && (handled_count & (SIG_LIVE_EVERY-1)) == 0) {
+        sig_gap(&sig);
+        sig_feed(&sig, t->buffer, t->actual_length, 0xFF);
+    }
+    t_chunk = time_ns();
+    chunk_count(t_chunk, t->actual_length);
+    pre_push(&pre, t->buffer, t->actual_length, 0xFF);
+    trace_instant("transfer", t->actual_length);
+    trace_begin("decode", t->actual_length);
+    dec_bytes(&dec, t->buffer, t->actual_length, 0xFF);
+    trace_end("decode");
+    met_hist(MET_H_DECODE, time_ns() - t_chunk);
+    trace_begin("resubmit");
+    int res = libusb_submit_transfer(t);
+    trace_end("resubmit");
+    if (res < 0) {
+        sprintf(error, "0x%X (%s) unable to submit usb data transfer", res, libusb_error_name(res));
+        stop = 1;
+    } else {
+        nactive++;
+    }
+    met_gauge(MET_G_TRANSFERS, nactive);
+}
+
+// (thread) usb events
+void usb_events_proc ()
+{
+    struct timeval tv = {0, 100000};
+    met_thread("usb");
+    trace_thread("usb");
+    while (stop == 0) libusb_handle_events_timeout(NULL, &tv);
+}
+#endif
+
+// (thread) decode capture file, optionally paced to real time
+void replay_proc (cap_reader* c)
+{
+    uint64_t t0 = time_ns();
+    int n = 0;
+    std::vector<uint8_t> samples((opt_analyze || opt_pre_dump) ? RLE_BLOCK_RAW : 0);
+    met_thread("replay");
+    trace_thread("replay");
+    for (;;) {
+        // chunk size is known after it is decoded (includes waiting for sink if not real time)
+        t_chunk = time_ns();
+        trace_begin("read+decode");
+        if (quit) n = 0;
+        else if (!opt_analyze && !opt_pre_dump) n = cap_feed(c, &dec);
+        else if ((n = cap_read(c, samples.data())) > 0) {
+            // analysis and signal ring need plain samples, rle is expanded first
+            if (opt_analyze) sig_feed(&sig, samples.data(), n, 0);
+            pre_push(&pre, samples.data(), n, 0);
+            dec_bytes(&dec, samples.data(), n, 0);
+        }
+        trace_end("read+decode");
+        if (n <= 0) break;
+        met_hist(MET_H_DECODE, time_ns() - t_chunk);
+        chunk_count(t_chunk, n);
+        if (opt_realtime) {
+            uint64_t due = t0 + c->raw_pos * 1000000000ull / SAMPLE_HZ;
+            uint64_t now = time_ns();
+            if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        }
+    }
+    if (n < 0) sprintf(error, "broken block at sample %llu of %s", (unsigned long long)c->raw_pos, opt_replay);
+    stop = 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+int main (int argc, char** argv)
+{
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) { usage(); return 0; }
+    if (parse_options(argc-1, argv+1) != 0) { usage(); return 1; }
+    if ((opt_config && cfg_load(cfg_items, cfg_count, opt_config, error) != 0) ||
+        cfg_args(cfg_items, cfg_count, opt_nsets, opt_sets, error) != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    // file names with a number need exactly one %u (cap_name)
+    out_per_event = opt_trigger && opt_out && strchr(opt_out, '%') && opt_out[0] != '|';
+    const char* bad_name = NULL;
+    if (opt_dump && !cap_name_ok(opt_dump)) bad_name = opt_dump;
+    if (opt_pre_dump && !cap_name_ok(opt_pre_dump)) bad_name = opt_pre_dump;
+    if (out_per_event && !cap_name_ok(opt_out)) bad_name = opt_out;
+    if (bad_name) {
+        fprintf(stderr, "bad file name %s, needs one number %%u, like frame%%05u.png\n", bad_name);
+        return 1;
+    }
+    error[0] = 0;
+    cap_reader c;
+    memset(&c, 0, sizeof(c));
+    int mode = (opt_mode < 0) ? MODE_BK : opt_mode;
+    if (opt_replay) {
+        if (cap_open(&c, opt_replay, opt_mode) != 0) {
+            fprintf(stderr, "unable to open capture %s\n", opt_replay);
+            return 1;
+        }
+        mode = c.mode;
+    }
+#ifdef FX2_NO_USB
+    else {
+        fprintf(stderr, "built without usb support, use -r <capture>\n");
+        return 1;
+    }
+#endif
+    if (dec_init(&dec, mode, opt_buffers) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        return 1;
+    }
+    dec.palette = (uint8_t)opt_palette;
+    dec.show_sync = (uint8_t)opt_show_sync;
+    dec_set_offset(&dec, opt_offset_x, opt_offset_y);
+    if (opt_centering) dec_calibrate(&dec);
+    if (flt_init(&noise, opt_noise, dec.full) != 0) {
+        fprintf(stderr, "unable to allocate noise filter\n");
+        return 1;
+    }
+    if (opt_trigger && trg_init(&trig, dec.width, dec.height, opt_trigger, opt_pre, opt_post) != 0) {
+        fprintf(stderr, "unable to allocate change trigger\n");
+        return 1;
+    }
+    trig.on_start = trig_on_start;
+    trig.on_frame = trig_on_frame;
+    trig.on_stop = trig_on_stop;
+    if (opt_pre_dump && pre_start(&pre, opt_pre_seconds, opt_pre_memory, opt_pre_rle) != 0) {
+        fprintf(stderr, "unable to allocate signal ring\n");
+        return 1;
+    }
+    if (opt_out && !out_per_event && vid_open(&vid, opt_out, opt_video, dec.width, dec.height) != 0) {
+        fprintf(stderr, "unable to open stream output %s\n", opt_out);
+        return 1;
+    }
+    fb.on_frame = fb_on_frame;
+    dec.on_frame = dec_on_frame;
+    met_reset();
+    sig_init(&sig, dec.mode);
+    if (opt_trace) trace_start();
+    if (opt_metrics && met_dump_start(&met, opt_metrics, opt_metrics_ms) != 0) {
+        fprintf(stderr, "unable to open metrics output %s\n", opt_metrics);
+        return 1;
+    }
+    if (opt_shm) {
+        int res = shm_create(&shm, opt_shm, &dec);
+        if (res != 0) {
+            fprintf(stderr, res == 2 ? "shared memory %s is in use by running producer\n" :
+                "unable to create shared memory %s\n", opt_shm);
+            return 1;
+        }
+    }
+    if (opt_font && txt_load(&font, opt_font, error) != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+    text_out = (opt_out && strcmp(opt_out, "-") == 0) ? stderr : stdout;
+    if (opt_port && net_start(&net, &dec, opt_port) != 0) {
+        fprintf(stderr, "unable to listen on port %i\n", opt_port);
+        return 1;
+    }
+    if (fb_start(&fb, &dec) != 0) {
+        fprintf(stderr, "unable to allocate framebuffer\n");
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+#ifdef SIGUSR1
+    signal(SIGUSR1, on_signal);
+#endif
+    uint64_t t0 = time_ns();
+    uint64_t cpu0 = cpu_ns(1);
+    std::thread th;
+    if (opt_replay) {
+        th = std::thread(replay_proc, &c);
+    }
+#ifndef FX2_NO_USB
+    else {
+        int res = usb_write_firmware();
+        if (res == 0) res = add_transfers(cb_transfer_complete);
+        if (res == 0) res = fx2_send_start();
+        if (res != 0) {
+            fprintf(stderr, "%s\n", error[0] ? error : "unable to start acquisition");
+            stop = 1;
+        } else {
+            th = std::thread(usb_events_proc);
+        }
+    }
+#endif
+    // status once a second until done
+    uint32_t last_frames = 0;
+    uint64_t t_status = t0;
+    while (!quit && !stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t t = time_ns();
+        if (opt_seconds > 0 && t - t0 >= opt_seconds*1e9) quit = 1;
+        if (pre_request) {
+            pre_request = 0;
+            if (opt_pre_dump) pre_save();
+        }
+#ifndef FX2_NO_USB
+        if (!opt_replay && nactive <= 0) {
+            sprintf(error, "no active usb transfers left");
+            stop = 1;
+        }
+#endif
+        if (!opt_quiet && t - t_status >= 1000000000ull) {
+            uint32_t fr = fb.frames;
+            fprintf(stderr, "%u frames, %.1f frames/s, %u skipped", fr, (fr - last_frames)*1e9/(t - t_status), (uint32_t)fb.skipped);
+            if (opt_port) fprintf(stderr, ", %i clients", net_clients(&net));
+            fprintf(stderr, "\n");
+            last_frames = fr;
+            t_status = t;
+        }
+    }
+    stop = 1;
+    if (th.joinable()) th.join();
+    fb_stop(&fb);
+    net_stop(&net);
+    met_dump_stop(&met);
+    if (opt_trace) {
+        trace_stop();
+        int nev = trace_dump(opt_trace);
+        if (nev < 0) fprintf(stderr, "unable to write %s\n", opt_trace);
+        else if (!opt_quiet) fprintf(stderr, "%i trace events written to %s\n", nev, opt_trace);
+    }
+    uint64_t t = time_ns() - t0;
+    uint64_t cpu = cpu_ns(1) - cpu0;
+#ifndef FX2_NO_USB
+    usb_close();
+#endif
+    if (opt_trigger) trg_finish(&trig);
+    if (opt_out) vid_close(&vid);
+    stream_error |= vid.io_error;
+    pre_stop(&pre);
+    if (opt_replay) cap_close(&c);
+    if (opt_shm) shm_close(&shm, &dec);
+    if (error[0]) fprintf(stderr, "%s\n", error);
+    // summary
+    uint32_t fr = fb.frames;
+    double span = (fr > 1) ? (fb.t_last - fb.t_first) / 1e9 : 0.0;
+    printf("%s %s: %u frames presented, %u skipped, %.3f s, %.1f frames/s\n",
+        opt_replay ? opt_replay : "fx2", mode_names[dec.mode], fr, (uint32_t)fb.skipped, t/1e9,
+        span > 0 ? (fr - 1) / span : 0.0);
+    printf("cpu per frame: %.3f ms total, %.3f ms present and sinks (%.1f%% of one core)\n",
+        fr ? cpu/1e6/fr : 0.0, fr ? fb.cpu/1e6/fr : 0.0, t ? cpu*100.0/t : 0.0);
+    if (opt_dump) printf("%u images dumped\n", dump_count);
+    if (opt_out) printf("%u frames streamed to %s%s\n", stream_frames, opt_out, stream_error ? " (write error)" : "");
+    if (opt_trigger)
+        printf("trigger: %u events (%i+ lines changed, %i frames pre-roll, %i post-roll), %u frames recorded (%.1f%%),"
+            " %.3f ms per frame\n", trig.events, trig.lines, trig.pre, trig.post, trig.frames_out,
+            trig.frames_in ? trig.frames_out*100.0/trig.frames_in : 0.0, trig.frames_in ? trig.ns/1e6/trig.frames_in : 0.0);
+    printf("frames hash %016llx\n", (unsigned long long)frames_hash);
+    if (opt_centering)
+        printf("centering: %s, picture shift %i,%i\n", dec.cal_done == 0 ? "not done (too few fields)" :
+            dec.cal_lit ? "calibrated" : "blank screen, kept", dec.ofs_x, dec.ofs_y);
+    if (opt_port) net_report(&net, stdout);
+    if (opt_pre_dump)
+        printf("signal ring: %u dumps%s, %u asked while busy, last %.1f s in %.1f KB (%.1f ms), %.1f MB lost while pinned\n",
+            (uint32_t)pre.dumps, pre.io_error ? " (write error)" : "", (uint32_t)pre.busy, pre.last_samples / (double)SAMPLE_HZ,
+            pre.last_bytes / 1024.0, pre.last_ns / 1e6, pre.bytes_lost / 1048576.0);
+    if (noise.depth)
+        printf("noise filter: %i frames, %llu pixels changed, %.3f ms per frame\n", noise.depth,
+            (unsigned long long)noise.changed, noise.frames ? noise.ns/1e6/noise.frames : 0.0);
+    if (opt_font) printf("text: %u changes, %.3f ms per frame\n", text_changes, fr ? text_ns/1e6/fr : 0.0);
+    if (opt_analyze) {
+        std::vector<char> text(8192);
+        sig_report(&sig, text.data(), (int)text.size());
+        printf("signal: %s", text.data());
+    }
+    flt_free(&noise);
+    trg_free(&trig);
+    dec_free(&dec);
+    return (error[0] || stream_error || pre.io_error) ? 1 : 0;
+}
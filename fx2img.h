@@ -0,0 +1,390 @@
+// still images - screenshots of decoded frames to BMP, PNG or QOI
+// whole file is encoded into one memory buffer and written with a single fwrite,
+// img_save_async() does it on its own thread from a stable snapshot of the frame
+// (PNG uses one fixed huffman deflate block - no zlib needed, screen data compresses well anyway)
+
+#ifndef FX2IMG_H
+#define FX2IMG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "fx2dec.h"
+#include "fx2cap.h"
+#include "fx2stat.h"
+
+#define IMG_BMP         0
+#define IMG_PNG         1
+#define IMG_QOI         2
+
+// format by file name extension (BMP if unknown)
+static int img_format_by_name (const char* fname)
+{
+    const char* ext = strrchr(fname, '.');
+    if (ext == NULL) return IMG_BMP;
+    if (strcmp(ext, ".png") == 0 || strcmp(ext, ".PNG") == 0) return IMG_PNG;
+    if (strcmp(ext, ".qoi") == 0 || strcmp(ext, ".QOI") == 0) return IMG_QOI;
+    return IMG_BMP;
+}
+
+// copy completed buffer n of decoder ring to dst, returns 0 if decoder did not
+// touch it while copying (buffers before n_cur+2 may be taken over any moment)
+static int img_snapshot (dec_state* d, uint32_t n, uint32_t* dst)
+{
+    uint32_t seq = d->seq;
+    uint32_t ahead = (n - d->n_cur) & (d->nbuf-1);  // frames until decoder writes to n
+    if (ahead < 2) return 1;
+    memcpy(dst, d->bufs[n], d->full*sizeof(uint32_t));
+    if (d->seq - seq >= ahead - 1) return 1;
+    return 0;
+}
+
+// (helper) little / big endian stores
+static inline void img_le16 (std::vector<uint8_t>& o, uint32_t v) { o.push_back(v & 0xFF); o.push_back((v >> 8) & 0xFF); }
+static inline void img_le32 (std::vector<uint8_t>& o, uint32_t v) { img_le16(o, v & 0xFFFF); img_le16(o, v >> 16); }
+static inline void img_be32 (std::vector<uint8_t>& o, uint32_t v)
+{
+    o.push_back(v >> 24); o.push_back((v >> 16) & 0xFF); o.push_back((v >> 8) & 0xFF); o.push_back(v & 0xFF);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// BMP (24 bit, bottom-up)
+////////////////////////////////////////////////////////////////////////////////
+
+// every source line is repeated sy times (2 - as shown on screen)
+static void img_encode_bmp (const uint32_t* pix, int w, int h, int sy, std::vector<uint8_t>& o)
+{
+    uint32_t stride = (w*3 + 3) & ~3;
+    uint32_t size = 54 + stride*h*sy;
+    o.clear();
+    o.reserve(size);
+    o.push_back('B'); o.push_back('M');
+    img_le32(o, size); img_le32(o, 0); img_le32(o, 54);
+    img_le32(o, 40); img_le32(o, w); img_le32(o, h*sy);
+    img_le16(o, 1); img_le16(o, 24);
+    img_le32(o, 0); img_le32(o, stride*h*sy);
+    img_le32(o, 2835); img_le32(o, 2835); img_le32(o, 0); img_le32(o, 0);
+    o.resize(size);
+    uint8_t* dst = &o[54];
+    for (int y=h-1; y>=0; y--) {
+        const uint32_t* src = pix + y*w;
+        uint8_t* row = dst;
+        for (int x=0; x<w; x++) {
+            uint32_t c = src[x];
+            row[x*3+0] = c & 0xFF;
+            row[x*3+1] = (c >> 8) & 0xFF;
+            row[x*3+2] = (c >> 16) & 0xFF;
+        }
+        memset(row + w*3, 0, stride - w*3);
+        dst += stride;
+        for (int k=1; k<sy; k++, dst += stride) memcpy(dst, row, stride);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// PNG (8 bit RGB, deflate with fixed huffman codes)
+////////////////////////////////////////////////////////////////////////////////
+
+    static const uint16_t dfl_len_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t dfl_len_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+struct dfl_bits {
+    std::vector<uint8_t>* o;
+    uint64_t  acc;
+    int       cnt;
+};
+
+static inline void dfl_put (dfl_bits* b, uint32_t bits, int n)
+{
+    b->acc |= (uint64_t)bits << b->cnt;
+    b->cnt += n;
+    while (b->cnt >= 8) {
+        b->o->push_back(b->acc & 0xFF);
+        b->acc >>= 8;
+        b->cnt -= 8;
+    }
+}
+
+// (helper) huffman codes go msb first
+static inline uint32_t dfl_rev (uint32_t code, int n)
+{
+    uint32_t r = 0;
+    for (int i=0; i<n; i++) { r = (r << 1) | (code & 1); code >>= 1; }
+    return r;
+}
+
+// fixed literal/length code of symbol, already reversed
+static void dfl_put_sym (dfl_bits* b, uint32_t s)
+{
+    static uint16_t code[288];
+    static uint8_t  bits[288];
+    if (bits[0] == 0) {
+        for (uint32_t i=0; i<288; i++) {
+            if (i < 144)      { bits[i] = 8; code[i] = dfl_rev(0x30 + i, 8); }
+            else if (i < 256) { bits[i] = 9; code[i] = dfl_rev(0x190 + i - 144, 9); }
+            else if (i < 280) { bits[i] = 7; code[i] = dfl_rev(i - 256, 7); }
+            else              { bits[i] = 8; code[i] = dfl_rev(0xC0 + i - 280, 8); }
+        }
+    }
+    dfl_put(b, code[s], bits[s]);
+}
+
+// match of len 3..258 at distance 1..32768
+static void dfl_put_match (dfl_bits* b, uint32_t len, uint32_t dist)
+{
+    int lc = 28;
+    while (dfl_len_base[lc] > len) lc--;
+    dfl_put_sym(b, 257 + lc);
+    if (dfl_len_extra[lc]) dfl_put(b, len - dfl_len_base[lc], dfl_len_extra[lc]);
+    uint32_t d1 = dist - 1;
+    if (d1 < 4) {
+        dfl_put(b, dfl_rev(d1, 5), 5);
+    } else {
+        int l = 2;
+        while (d1 >> (l+1)) l++;
+        uint32_t dc = 2*l + ((d1 >> (l-1)) & 1);
+        int extra = l - 1;
+        dfl_put(b, dfl_rev(dc, 5), 5);
+        dfl_put(b, d1 & ((1u << extra) - 1), extra);
+    }
+}
+
+// zlib stream of data - greedy matching against one hash candidate and the
+// same position one line above (row bytes), single fixed huffman block
+static void dfl_zlib (const uint8_t* p, uint32_t len, uint32_t row, std::vector<uint8_t>& o)
+{
+    const int HBITS = 15;
+    std::vector<int32_t> head(1 << HBITS, -1);
+    o.push_back(0x78); o.push_back(0x01);
+    dfl_bits b = { &o, 0, 0 };
+    dfl_put(&b, 1, 1);                      // final block
+    dfl_put(&b, 1, 2);                      // fixed huffman
+    uint32_t i = 0;
+    while (i < len) {
+        uint32_t best = 0, dist = 0;
+        if (i + 4 <= len) {
+            uint32_t q; memcpy(&q, p + i, 4);
+            uint32_t h = (q * 2654435761u) >> (32 - HBITS);
+            uint32_t cand[2] = { (uint32_t)head[h], i - row };
+            head[h] = (int32_t)i;
+            uint32_t maxlen = (len - i < 258) ? len - i : 258;
+            for (int k=0; k<2; k++) {
+                uint32_t c = cand[k];
+                if (c >= i || i - c > 32768) continue;
+                uint32_t m = 0;
+                while (m < maxlen && p[c+m] == p[i+m]) m++;
+                if (m > best) { best = m; dist = i - c; }
+            }
+        }
+        if (best >= 4) {
+            dfl_put_match(&b, best, dist);
+            i += best;
+        } else {
+            dfl_put_sym(&b, p[i]);
+            i++;
+        }
+    }
+    dfl_put_sym(&b, 256);
+    if (b.cnt > 0) dfl_put(&b, 0, 8 - b.cnt);
+    // adler32
+    uint32_t s1 = 1, s2 = 0;
+    for (uint32_t k=0; k<len; ) {
+        uint32_t n = (len - k < 5552) ? len - k : 5552;
+        for (uint32_t e=k+n; k<e; k++) { s1 += p[k]; s2 += s1; }
+        s1 %= 65521; s2 %= 65521;
+    }
+    img_be32(o, (s2 << 16) | s1);
+}
+
+// (helper) png chunk, crc over type and data
+static void png_chunk (std::vector<uint8_t>& o, const char* type, const uint8_t* data, uint32_t len)
+{
+    img_be32(o, len);
+    size_t start = o.size();
+    o.insert(o.end(), type, type + 4);
+    if (len) o.insert(o.end(), data, data + len);
+    img_be32(o, crc32_buf(&o[start], len + 4));
+}
+
+static void img_encode_png (const uint32_t* pix, int w, int h, int sy, std::vector<uint8_t>& o)
+{
+    // filtered scanlines - filter byte 0 (none) and R,G,B
+    uint32_t row = 1 + w*3;
+    std::vector<uint8_t> raw((size_t)row*h*sy);
+    uint8_t* dst = &raw[0];
+    for (int y=0; y<h; y++) {
+        const uint32_t* src = pix + y*w;
+        uint8_t* line = dst;
+        line[0] = 0;
+        for (int x=0; x<w; x++) {
+            uint32_t c = src[x];
+            line[1+x*3+0] = (c >> 16) & 0xFF;
+            line[1+x*3+1] = (c >> 8) & 0xFF;
+            line[1+x*3+2] = c & 0xFF;
+        }
+        dst += row;
+        for (int k=1; k<sy; k++, dst += row) memcpy(dst, line, row);
+    }
+    std::vector<uint8_t> z;
+    z.reserve(raw.size() / 8);
+    dfl_zlib(&raw[0], (uint32_t)raw.size(), row, z);
+    o.clear();
+    o.reserve(z.size() + 64);
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    o.insert(o.end(), sig, sig + 8);
+    std::vector<uint8_t> ihdr;
+    img_be32(ihdr, w); img_be32(ihdr, h*sy);
+    ihdr.push_back(8); ihdr.push_back(2); ihdr.push_back(0); ihdr.push_back(0); ihdr.push_back(0);
+    png_chunk(o, "IHDR", &ihdr[0], (uint32_t)ihdr.size());
+    png_chunk(o, "IDAT", &z[0], (uint32_t)z.size());
+    png_chunk(o, "IEND", NULL, 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// QOI (3 channels)
+////////////////////////////////////////////////////////////////////////////////
+
+static void img_encode_qoi (const uint32_t* pix, int w, int h, int sy, std::vector<uint8_t>& o)
+{
+    o.clear();
+    o.reserve(14 + (size_t)w*h*sy/4 + 8);
+    o.push_back('q'); o.push_back('o'); o.push_back('i'); o.push_back('f');
+    img_be32(o, w); img_be32(o, h*sy);
+    o.push_back(3); o.push_back(0);
+    uint32_t index[64];
+    memset(index, 0xFF, sizeof(index));     // no entry (decoder has alpha 0 there)
+    uint32_t prev = 0;                      // r,g,b = 0, alpha 255 (not stored)
+    int run = 0;
+    for (int y=0; y<h; y++) for (int k=0; k<sy; k++) {
+        const uint32_t* src = pix + y*w;
+        for (int x=0; x<w; x++) {
+            uint32_t c = src[x] & 0xFFFFFF;
+            if (c == prev) {
+                if (++run == 62) { o.push_back(0xC0 | (run-1)); run = 0; }
+                continue;
+            }
+            if (run) { o.push_back(0xC0 | (run-1)); run = 0; }
+            int r = c >> 16, g = (c >> 8) & 0xFF, b = c & 0xFF;
+            int h6 = (r*3 + g*5 + b*7 + 255*11) & 63;
+            if (index[h6] == c) {
+                o.push_back(h6);
+            } else {
+                index[h6] = c;
+                int8_t dr = (int8_t)(r - (prev >> 16));
+                int8_t dg = (int8_t)(g - ((prev >> 8) & 0xFF));
+                int8_t db = (int8_t)(b - (prev & 0xFF));
+                int8_t dr_dg = dr - dg, db_dg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                    o.push_back(0x40 | ((dr+2) << 4) | ((dg+2) << 2) | (db+2));
+                } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                    o.push_back(0x80 | (dg+32));
+                    o.push_back(((dr_dg+8) << 4) | (db_dg+8));
+                } else {
+                    o.push_back(0xFE); o.push_back(r); o.push_back(g); o.push_back(b);
+                }
+            }
+            prev = c;
+        }
+    }
+    if (run) o.push_back(0xC0 | (run-1));
+    for (int i=0; i<7; i++) o.push_back(0);
+    o.push_back(1);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Writing
+////////////////////////////////////////////////////////////////////////////////
+
+static void img_encode (int format, const uint32_t* pix, int w, int h, int sy, std::vector<uint8_t>& o)
+{
+    if (format == IMG_PNG) img_encode_png(pix, w, h, sy, o);
+    else if (format == IMG_QOI) img_encode_qoi(pix, w, h, sy, o);
+    else img_encode_bmp(pix, w, h, sy, o);
+}
+
+// encode and write file at once, returns 0 if ok
+static int img_write (const char* fname, int format, const uint32_t* pix, int w, int h, int sy, std::vector<uint8_t>& o)
+{
+    img_encode(format, pix, w, h, sy, o);
+    FILE* f = fopen(fname, "wb");
+    if (f == NULL) return 1;
+    size_t n = fwrite(&o[0], 1, o.size(), f);
+    if (fclose(f) != 0 || n != o.size()) return 2;
+    return 0;
+}
+
+struct img_job;
+typedef void (*img_done_fn)(img_job* j);
+
+// screenshot written in background
+struct img_job {
+    uint32_t* pix;                  // snapshot of frame
+    int       width;
+    int       height;
+    int       sy;
+    int       format;
+    char      fname[260];
+    std::vector<uint8_t> out;
+    std::thread th;
+    std::atomic<int> busy;
+    int       result;               // img_write() result
+    uint64_t  t_encode;             // ns spent encoding and writing
+    img_done_fn on_done;            // (optional) called on writer thread when done
+    void*     user;
+};
+
+// (thread) encode and write the snapshot
+static void img_job_proc (img_job* j)
+{
+    uint64_t t0 = time_ns();
+    j->result = img_write(j->fname, j->format, j->pix, j->width, j->height, j->sy, j->out);
+    j->t_encode = time_ns() - t0;
+    j->busy = 0;
+    if (j->on_done) j->on_done(j);
+}
+
+// take stable snapshot of buffer n (or the newest complete frame if n is being
+// overwritten) and write it to fname in background, returns 0 if started
+static int img_save_async (img_job* j, dec_state* d, uint32_t n, const char* fname, int sy)
+{
+    if (j->busy.load()) return 1;
+    if (j->th.joinable()) j->th.join();
+    if (j->pix == NULL) {
+        j->pix = (uint32_t*) malloc(SCR_MAXBUF*sizeof(uint32_t));
+        if (j->pix == NULL) return 2;
+    }
+    int res = img_snapshot(d, n, j->pix);
+    for (int i=0; i<4 && res != 0; i++) res = img_snapshot(d, (d->n_cur - 1) & (d->nbuf-1), j->pix);
+    if (res != 0) return 3;
+    if (d->palette == 0 && d->mode == MODE_BK) dec_to_bw(j->pix, d->full);
+    j->width = d->width;
+    j->height = d->height;
+    j->sy = sy;
+    j->format = img_format_by_name(fname);
+    strncpy(j->fname, fname, sizeof(j->fname) - 1);
+    j->fname[sizeof(j->fname) - 1] = 0;
+    j->busy = 1;
+    j->th = std::thread(img_job_proc, j);
+    return 0;
+}
+
+// wait for writing and free snapshot
+static void img_job_free (img_job* j)
+{
+    if (j->th.joinable()) j->th.join();
+    free(j->pix);
+    j->pix = NULL;
+}
+
+#endif
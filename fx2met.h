@@ -0,0 +1,268 @@
+// metrics registry - counters, gauges and latency histograms of the whole pipeline
+// every thread writes to its own slot (no shared cache lines on the hot path),
+// readers sum slots up; histograms have fixed log-linear buckets (ns, 4 per octave)
+// met_dump_start appends one JSON object per line to file or stdout periodically
+// build with -DFX2_NO_METRICS to compile recording out (to measure its overhead)
+
+#ifndef FX2MET_H
+#define FX2MET_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fx2stat.h"
+
+// counters
+#define MET_TRANSFERS       0       // usb transfers (or replay chunks) decoded
+#define MET_EMPTY           1       // transfers with no data
+#define MET_BYTES           2       // samples decoded
+#define MET_FRAMES          3       // frames published by decoder
+#define MET_DROPPED         4       // frames some consumer never got (display, sinks, video)
+#define MET_REC_BYTES       5       // raw signal written to disk
+#define MET_REC_DROPPED     6       // raw signal lost, writer behind
+#define MET_NET_CLIENTS     7       // stream clients connected
+#define MET_NET_BYTES       8       // sent to stream clients
+#define MET_NET_DROPPED     9       // frames not sent, client busy with previous one
+#define MET_COUNTERS        10
+
+// gauges (last value and max)
+#define MET_G_TRANSFERS     0       // usb transfers in flight
+#define MET_G_FRAME_LAG     1       // frames consumer is behind decoder
+#define MET_G_REC_BACKLOG   2       // recording blocks waiting for writer
+#define MET_GAUGES          3
+
+// histograms (ns)
+#define MET_H_DECODE        0       // decode of one transfer
+#define MET_H_INTERVAL      1       // between transfer completions
+#define MET_H_PUBLISH       2       // transfer completion -> frame published
+#define MET_H_PRESENT       3       // frame taken -> painted / handed to sinks
+#define MET_H_REC_WRITE     4       // one recording block to disk
+#define MET_H_NET_SEND      5       // frame published -> sent to stream client
+#define MET_HISTS           6
+
+#define MET_BUCKETS         128     // 4 per power of 2 up to 2^32 ns, last one the rest
+#define MET_MAX_THREADS     16      // more threads share last slot
+
+    const char* met_counter_names[MET_COUNTERS] = { "transfers", "empty_transfers", "bytes", "frames",
+        "frames_dropped", "rec_bytes", "rec_bytes_dropped", "net_clients", "net_bytes", "net_frames_dropped" };
+    const char* met_gauge_names[MET_GAUGES] = { "transfers_active", "frame_lag", "rec_backlog" };
+    const char* met_hist_names[MET_HISTS] = { "decode_ns", "transfer_interval_ns", "publish_ns",
+        "present_ns", "rec_write_ns", "net_send_ns" };
+
+struct met_slot {
+    alignas(64) std::atomic<uint64_t> c[MET_COUNTERS];
+    std::atomic<uint64_t> h[MET_HISTS][MET_BUCKETS];
+    std::atomic<uint64_t> h_sum[MET_HISTS];
+    char      name[16];
+};
+
+struct met_dumper {
+    FILE*     f;
+    int       own_file;
+    int       interval_ms;
+    uint32_t  lines;
+    std::atomic<int> active;
+    std::thread th;
+};
+
+    met_slot met_slots[MET_MAX_THREADS];
+    std::atomic<int> met_nslots(0);
+    std::atomic<uint64_t> met_g[MET_GAUGES];
+    std::atomic<uint64_t> met_g_max[MET_GAUGES];
+    uint64_t met_t0 = 0;
+    thread_local met_slot* met_cur = NULL;
+
+
+// (helper) calling thread's slot, taken on first use
+static met_slot* met_self ()
+{
+    if (met_cur == NULL) {
+        int i = met_nslots++;
+        if (i >= MET_MAX_THREADS) i = MET_MAX_THREADS - 1;
+        met_cur = &met_slots[i];
+        if (met_cur->name[0] == 0) snprintf(met_cur->name, sizeof(met_cur->name), "thread%u", (unsigned)i & 0xFF);
+    }
+    return met_cur;
+}
+
+// name calling thread in dumps
+static void met_thread (const char* name)
+{
+#ifndef FX2_NO_METRICS
+    met_slot* s = met_self();
+    strncpy(s->name, name, sizeof(s->name)-1);
+#endif
+}
+
+static void met_add (int id, uint64_t v)
+{
+#ifndef FX2_NO_METRICS
+    met_self()->c[id].fetch_add(v, std::memory_order_relaxed);
+#endif
+}
+
+static void met_gauge (int id, int64_t v)
+{
+#ifndef FX2_NO_METRICS
+    uint64_t u = (v < 0) ? 0 : (uint64_t)v;
+    met_g[id].store(u, std::memory_order_relaxed);
+    uint64_t m = met_g_max[id].load(std::memory_order_relaxed);
+    while (u > m && !met_g_max[id].compare_exchange_weak(m, u, std::memory_order_relaxed)) {}
+#endif
+}
+
+// (helper) histogram bucket of value - 0..3 exact, then power of 2 and 2 bits below it
+static int met_bucket (uint64_t ns)
+{
+    if (ns < 4) return (int)ns;
+    int b;
+#if defined(__GNUC__)
+    b = 63 - __builtin_clzll(ns);
+#else
+    b = 0;
+    for (uint64_t v=ns; v>>=1; ) b++;
+#endif
+    int i = b*4 + (int)((ns >> (b-2)) & 3);
+    return (i < MET_BUCKETS) ? i : MET_BUCKETS - 1;
+}
+
+// (helper) lowest value of bucket
+static uint64_t met_bucket_lo (int i)
+{
+    if (i < 8) return (i < 4) ? i : 4;
+    int b = i / 4;
+    return (uint64_t)(4 + (i & 3)) << (b-2);
+}
+
+static void met_hist (int id, uint64_t ns)
+{
+#ifndef FX2_NO_METRICS
+    met_slot* s = met_self();
+    s->h[id][met_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    s->h_sum[id].fetch_add(ns, std::memory_order_relaxed);
+#endif
+}
+
+// counter summed over threads
+static uint64_t met_counter (int id)
+{
+    uint64_t v = 0;
+    int n = met_nslots.load();
+    if (n > MET_MAX_THREADS) n = MET_MAX_THREADS;
+    for (int i=0; i<n; i++) v += met_slots[i].c[id].load(std::memory_order_relaxed);
+    return v;
+}
+
+// forget everything recorded so far (slots stay with their threads)
+static void met_reset ()
+{
+    for (int i=0; i<MET_MAX_THREADS; i++) {
+        met_slot* s = &met_slots[i];
+        for (int k=0; k<MET_COUNTERS; k++) s->c[k] = 0;
+        for (int k=0; k<MET_HISTS; k++) {
+            for (int b=0; b<MET_BUCKETS; b++) s->h[k][b] = 0;
+            s->h_sum[k] = 0;
+        }
+    }
+    for (int k=0; k<MET_GAUGES; k++) met_g[k] = met_g_max[k] = 0;
+    met_t0 = time_ns();
+}
+
+// write current state as one line JSON object
+static void met_json (FILE* f)
+{
+    int n = met_nslots.load();
+    if (n > MET_MAX_THREADS) n = MET_MAX_THREADS;
+    if (met_t0 == 0) met_t0 = time_ns();
+    fprintf(f, "{\"t_ms\":%.1f,\"counters\":{", (time_ns() - met_t0) / 1e6);
+    for (int k=0; k<MET_COUNTERS; k++)
+        fprintf(f, "%s\"%s\":%llu", k ? "," : "", met_counter_names[k], (unsigned long long)met_counter(k));
+    fprintf(f, "},\"gauges\":{");
+    for (int k=0; k<MET_GAUGES; k++)
+        fprintf(f, "%s\"%s\":{\"value\":%llu,\"max\":%llu}", k ? "," : "", met_gauge_names[k],
+            (unsigned long long)met_g[k].load(), (unsigned long long)met_g_max[k].load());
+    fprintf(f, "},\"histograms\":{");
+    for (int k=0; k<MET_HISTS; k++) {
+        uint64_t h[MET_BUCKETS], count = 0, sum = 0;
+        for (int b=0; b<MET_BUCKETS; b++) {
+            h[b] = 0;
+            for (int i=0; i<n; i++) h[b] += met_slots[i].h[k][b].load(std::memory_order_relaxed);
+            count += h[b];
+        }
+        for (int i=0; i<n; i++) sum += met_slots[i].h_sum[k].load(std::memory_order_relaxed);
+        // percentiles as upper bounds of buckets they fall in
+        uint64_t p50 = 0, p99 = 0, pmax = 0, acc = 0;
+        for (int b=0; b<MET_BUCKETS; b++) {
+            if (h[b] == 0) continue;
+            acc += h[b];
+            uint64_t upper = met_bucket_lo(b+1);
+            if (p50 == 0 && acc*2 >= count) p50 = upper;
+            if (p99 == 0 && acc*100 >= count*99) p99 = upper;
+            pmax = upper;
+        }
+        fprintf(f, "%s\"%s\":{\"count\":%llu,\"mean\":%.0f,\"p50\":%llu,\"p99\":%llu,\"max\":%llu,\"buckets\":{",
+            k ? "," : "", met_hist_names[k], (unsigned long long)count, count ? (double)sum/count : 0.0,
+            (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)pmax);
+        int first = 1;
+        for (int b=0; b<MET_BUCKETS; b++) {
+            if (h[b] == 0) continue;
+            fprintf(f, "%s\"%llu\":%llu", first ? "" : ",", (unsigned long long)met_bucket_lo(b), (unsigned long long)h[b]);
+            first = 0;
+        }
+        fprintf(f, "}}");
+    }
+    // per thread counters (nonzero only)
+    fprintf(f, "},\"threads\":[");
+    for (int i=0; i<n; i++) {
+        fprintf(f, "%s{\"name\":\"%s\"", i ? "," : "", met_slots[i].name);
+        for (int k=0; k<MET_COUNTERS; k++) {
+            uint64_t v = met_slots[i].c[k].load(std::memory_order_relaxed);
+            if (v) fprintf(f, ",\"%s\":%llu", met_counter_names[k], (unsigned long long)v);
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "]}\n");
+    fflush(f);
+}
+
+// (thread) dump every interval, once more when stopped
+static void met_dump_proc (met_dumper* m)
+{
+    uint64_t next = time_ns() + m->interval_ms * 1000000ull;
+    while (m->active.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        if (time_ns() < next) continue;
+        met_json(m->f);
+        m->lines++;
+        next += m->interval_ms * 1000000ull;
+    }
+    met_json(m->f);
+    m->lines++;
+}
+
+// start periodic dump to file ("-" is stdout), returns 0 if ok
+static int met_dump_start (met_dumper* m, const char* fname, int interval_ms)
+{
+    m->own_file = strcmp(fname, "-") != 0;
+    m->f = m->own_file ? fopen(fname, "w") : stdout;
+    if (m->f == NULL) return 1;
+    m->interval_ms = (interval_ms > 0) ? interval_ms : 1000;
+    m->lines = 0;
+    m->active = 1;
+    m->th = std::thread(met_dump_proc, m);
+    return 0;
+}
+
+static void met_dump_stop (met_dumper* m)
+{
+    if (m->f == NULL) return;
+    m->active = 0;
+    if (m->th.joinable()) m->th.join();
+    if (m->own_file) fclose(m->f);
+    m->f = NULL;
+}
+
+#endif
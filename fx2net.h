@@ -0,0 +1,621 @@
+// frame streaming server on local tcp port - for browsers (WebSocket) and plain tcp viewers
+// one server thread takes frames from decoder ring (never holds decoder up, falls behind
+// = frames skipped), turns pixels into palette indices and sends every client
+// a keyframe first, then per frame runs of lines which changed since the last frame
+// that client got; a client still sending previous frame has this one dropped, its changed
+// lines are carried on to the next frame it gets (slow client - lower frame rate only)
+// GET / gives small html viewer, GET with websocket upgrade or "FX2\n" starts stream
+//
+// messages (little endian), in websocket binary frames or after u32 length on plain tcp:
+//   'P' 0 u16 count, count x u32 0x00RRGGBB          palette (sent when it grows)
+//   'K' 0 u16 width, u16 height, u16 0, u32 seq, width*height indices
+//   'D' 0 u16 runs, u32 seq, runs x (u16 y, u16 lines, lines*width indices)
+
+#ifndef FX2NET_H
+#define FX2NET_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include "fx2dec.h"
+#include "fx2stat.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+
+#ifdef _WIN32
+#include <winsock.h>
+#pragma comment(lib, "wsock32.lib")
+typedef SOCKET net_sock;
+#define NET_BAD_SOCK    INVALID_SOCKET
+#define NET_NOSIGNAL    0
+#define net_close_sock  closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+typedef int net_sock;
+#define NET_BAD_SOCK    (-1)
+#define NET_NOSIGNAL    MSG_NOSIGNAL
+#define net_close_sock  close
+#endif
+
+#define NET_MAX_CLIENTS 8
+#define NET_MAX_COLORS  256
+#define NET_SNDBUF      0x40000     // socket send buffer, about one keyframe
+
+#define NET_HELLO       0           // waiting for request
+#define NET_PAGE        1           // sending viewer page, closed when done
+#define NET_RAW         2           // plain tcp stream
+#define NET_WS          3           // websocket stream
+
+struct net_stats {
+    int       id;
+    char      addr[24];
+    int       ws;
+    uint64_t  t_connect;
+    uint64_t  t_close;
+    uint64_t  bytes;
+    uint32_t  frames;               // sent completely
+    uint32_t  keyframes;
+    uint32_t  dropped;              // client was busy with previous one
+    uint64_t  lat_sum;              // frame published -> last byte handed to socket
+    uint64_t  lat_max;
+};
+
+struct net_client {
+    net_sock  fd;
+    int       state;
+    char      in[2048];
+    int       in_len;
+    std::vector<uint8_t> out;
+    size_t    out_pos;
+    std::vector<uint8_t> dirty;     // lines changed since last frame sent
+    int       need_key;
+    uint32_t  pal_sent;             // colors client knows
+    uint64_t  t_frame;              // publish time of frame being sent (0 - none)
+    net_stats st;
+};
+
+struct net_server {
+    net_sock  lfd;
+    int       port;
+    dec_state* d;
+    std::thread th;
+    std::atomic<int> active;
+    uint32_t  next_seq;
+    uint64_t  t_pub[DEC_MAXBUF];    // publish time of frame in buffer
+    int       width;
+    int       height;
+    std::vector<uint32_t> pix;      // frame taken from ring
+    std::vector<uint8_t> idx;       // its palette indices
+    std::vector<uint8_t> prev;      // indices of previous frame
+    std::vector<uint8_t> dirty;     // lines differing from previous frame
+    uint32_t  pal[NET_MAX_COLORS];
+    uint32_t  npal;
+    uint32_t  map_key[1024];        // color -> index hash (open addressing)
+    int16_t   map_val[1024];
+    net_client* clients[NET_MAX_CLIENTS];
+    std::atomic<int> streaming;     // clients getting frames
+    int       next_id;
+    std::vector<net_stats> closed;
+    uint32_t  frames;               // frames taken from ring
+    uint32_t  skipped;              // frames server itself fell behind on
+    std::vector<uint8_t> msg;       // message being built
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// websocket handshake (sha-1, base64)
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t net_rol (uint32_t v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+// sha-1 of short message (handshake key), 20 bytes to out
+static void net_sha1 (const uint8_t* msg, uint32_t len, uint8_t* out)
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint8_t buf[256];
+    uint32_t total = ((len + 8) / 64 + 1) * 64;
+    if (total > sizeof(buf)) return;
+    memset(buf, 0, total);
+    memcpy(buf, msg, len);
+    buf[len] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i=0; i<8; i++) buf[total-1-i] = (uint8_t)(bits >> (i*8));
+    for (uint32_t blk=0; blk<total; blk+=64) {
+        uint32_t w[80];
+        for (int i=0; i<16; i++)
+            w[i] = (uint32_t)buf[blk+i*4] << 24 | (uint32_t)buf[blk+i*4+1] << 16 | (uint32_t)buf[blk+i*4+2] << 8 | buf[blk+i*4+3];
+        for (int i=16; i<80; i++) w[i] = net_rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i=0; i<80; i++) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            uint32_t t = net_rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = net_rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i=0; i<20; i++) out[i] = (uint8_t)(h[i/4] >> (24 - (i%4)*8));
+}
+
+static void net_base64 (const uint8_t* p, int len, char* out)
+{
+    static const char tab[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    int o = 0;
+    for (int i=0; i<len; i+=3) {
+        uint32_t v = (uint32_t)p[i] << 16 | (i+1 < len ? (uint32_t)p[i+1] << 8 : 0) | (i+2 < len ? p[i+2] : 0);
+        out[o++] = tab[(v >> 18) & 63];
+        out[o++] = tab[(v >> 12) & 63];
+        out[o++] = (i+1 < len) ? tab[(v >> 6) & 63] : '=';
+        out[o++] = (i+2 < len) ? tab[v & 63] : '=';
+    }
+    out[o] = 0;
+}
+
+// (helper) value of header in request, case insensitive name, 0 if ok
+static int net_header (const char* req, const char* name, char* val, int size)
+{
+    int n = (int)strlen(name);
+    for (const char* p = strstr(req, "\r\n"); p; p = strstr(p + 2, "\r\n")) {
+        const char* l = p + 2;
+        int i = 0;
+        while (i < n && l[i] && ((l[i] | 0x20) == (name[i] | 0x20))) i++;
+        if (i < n || l[n] != ':') continue;
+        l += n + 1;
+        while (*l == ' ') l++;
+        int k = 0;
+        while (l[k] && l[k] != '\r' && k < size-1) { val[k] = l[k]; k++; }
+        val[k] = 0;
+        return 0;
+    }
+    return 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// clients
+////////////////////////////////////////////////////////////////////////////////
+
+    const char* net_page =
+        "<!DOCTYPE html><html><head><title>FX2</title></head>"
+        "<body style='background:#222;color:#aaa;font:12px monospace'>"
+        "<canvas id='c' style='image-rendering:pixelated'></canvas><div id='s'></div><script>\n"
+        "var c=document.getElementById('c'),x=c.getContext('2d'),pal=[],idx=null,img=null,w=0,h=0,n=0,b=0,t0=Date.now();\n"
+        "var ws=new WebSocket('ws://'+location.host+'/');ws.binaryType='arraybuffer';\n"
+        "function put(y,src,o){for(var i=0;i<w;i++){var v=pal[src[o+i]]||0,p=(y*w+i)*4;"
+        "img.data[p]=v>>16&255;img.data[p+1]=v>>8&255;img.data[p+2]=v&255;img.data[p+3]=255;}}\n"
+        "ws.onmessage=function(e){var u=new Uint8Array(e.data),v=new DataView(e.data),t=u[0];b+=u.length;\n"
+        " if(t==80){var k=v.getUint16(2,true);for(var i=0;i<k;i++)pal[i]=v.getUint32(4+i*4,true);return;}\n"
+        " if(t==75){w=v.getUint16(2,true);h=v.getUint16(4,true);c.width=w;c.height=h;c.style.height=(h*2)+'px';\n"
+        "  img=x.createImageData(w,h);for(var y=0;y<h;y++)put(y,u,12+y*w);}\n"
+        " else if(t==68&&img){var r=v.getUint16(2,true),o=8;for(var j=0;j<r;j++){var y0=v.getUint16(o,true),l=v.getUint16(o+2,true);o+=4;"
+        "  for(var y=0;y<l;y++){put(y0+y,u,o);o+=w;}}}\n"
+        " else return;\n"
+        " x.putImageData(img,0,0);n++;var s=(Date.now()-t0)/1000;\n"
+        " document.getElementById('s').textContent=n+' frames, '+(n/s).toFixed(1)+' frames/s, '+(b/s/1024).toFixed(0)+' KB/s';};\n"
+        "</script></body></html>";
+
+// (helper) queue message for client, framed as client's stream wants it
+static void net_put (net_client* c, const uint8_t* msg, size_t len)
+{
+    uint8_t hdr[10];
+    int n = 0;
+    if (c->state == NET_WS) {
+        hdr[n++] = 0x82;                        // final, binary
+        if (len < 126) hdr[n++] = (uint8_t)len;
+        else if (len < 0x10000) { hdr[n++] = 126; hdr[n++] = (uint8_t)(len >> 8); hdr[n++] = (uint8_t)len; }
+        else { hdr[n++] = 127; for (int i=7; i>=0; i--) hdr[n++] = (uint8_t)((uint64_t)len >> (i*8)); }
+    } else {
+        for (int i=0; i<4; i++) hdr[n++] = (uint8_t)(len >> (i*8));
+    }
+    c->out.insert(c->out.end(), hdr, hdr + n);
+    c->out.insert(c->out.end(), msg, msg + len);
+}
+
+static void net_drop_client (net_server* s, int i)
+{
+    net_client* c = s->clients[i];
+    net_close_sock(c->fd);
+    if (c->state == NET_RAW || c->state == NET_WS) {
+        s->streaming--;
+        c->st.t_close = time_ns();
+        s->closed.push_back(c->st);
+    }
+    delete c;
+    s->clients[i] = NULL;
+}
+
+// (helper) request is complete - choose what client gets, 0 if ok
+static int net_request (net_server* s, net_client* c)
+{
+    if (c->in_len >= 4 && memcmp(c->in, "FX2\n", 4) == 0) {
+        c->state = NET_RAW;
+    } else {
+        if (strstr(c->in, "\r\n\r\n") == NULL) return (c->in_len < (int)sizeof(c->in) - 1) ? 0 : 1;
+        if (memcmp(c->in, "GET ", 4) != 0) return 1;
+        char key[128], hdr[512];
+        if (net_header(c->in, "Sec-WebSocket-Key", key, sizeof(key)) != 0) {
+            int n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: %u\r\n"
+                "Connection: close\r\n\r\n", (unsigned)strlen(net_page));
+            c->out.insert(c->out.end(), hdr, hdr + n);
+            c->out.insert(c->out.end(), net_page, net_page + strlen(net_page));
+            c->state = NET_PAGE;
+            return 0;
+        }
+        char acc[256];
+        uint8_t sha[20];
+        snprintf(acc, sizeof(acc), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", key);
+        net_sha1((const uint8_t*)acc, (uint32_t)strlen(acc), sha);
+        net_base64(sha, 20, acc);
+        int n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+            "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", acc);
+        c->out.insert(c->out.end(), hdr, hdr + n);
+        c->state = NET_WS;
+        c->st.ws = 1;
+    }
+    c->need_key = 1;
+    c->pal_sent = 0;
+    c->st.t_connect = time_ns();
+    s->streaming++;
+    met_add(MET_NET_CLIENTS, 1);
+    return 0;
+}
+
+// (helper) data from client, 0 if it stays
+static int net_read (net_server* s, net_client* c)
+{
+    char tmp[2048];
+    int n = recv(c->fd, tmp, sizeof(tmp), 0);
+    if (n <= 0) return 1;
+    if (c->state == NET_HELLO) {
+        int k = (n < (int)sizeof(c->in) - 1 - c->in_len) ? n : (int)sizeof(c->in) - 1 - c->in_len;
+        memcpy(c->in + c->in_len, tmp, k);
+        c->in_len += k;
+        c->in[c->in_len] = 0;
+        return net_request(s, c);
+    }
+    // websocket close frame ends stream, anything else from viewer is ignored
+    if (c->state == NET_WS && (tmp[0] & 0x0F) == 0x08) return 1;
+    return 0;
+}
+
+// (helper) send what socket takes now, 0 if client stays
+static int net_write (net_client* c)
+{
+    while (c->out_pos < c->out.size()) {
+        int n = send(c->fd, (const char*)c->out.data() + c->out_pos, (int)(c->out.size() - c->out_pos), NET_NOSIGNAL);
+        if (n <= 0) {
+#ifdef _WIN32
+            if (WSAGetLastError() == WSAEWOULDBLOCK) return 0;
+#else
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+#endif
+            return 1;
+        }
+        c->out_pos += n;
+        c->st.bytes += n;
+        met_add(MET_NET_BYTES, n);
+    }
+    c->out.clear();
+    c->out_pos = 0;
+    if (c->state == NET_PAGE) return 1;
+    if (c->t_frame) {
+        uint64_t lat = time_ns() - c->t_frame;
+        c->st.lat_sum += lat;
+        if (lat > c->st.lat_max) c->st.lat_max = lat;
+        c->st.frames++;
+        met_hist(MET_H_NET_SEND, lat);
+        c->t_frame = 0;
+    }
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// frames
+////////////////////////////////////////////////////////////////////////////////
+
+// (helper) palette index of color, new colors are appended (last one if palette is full)
+static inline uint8_t net_color (net_server* s, uint32_t color)
+{
+    uint32_t key = color | 0x80000000;
+    uint32_t h = (color * 0x9E3779B1u) >> 22;
+    while (s->map_key[h] != 0) {
+        if (s->map_key[h] == key) return (uint8_t)s->map_val[h];
+        h = (h + 1) & 1023;
+    }
+    if (s->npal >= NET_MAX_COLORS) return NET_MAX_COLORS - 1;
+    s->map_key[h] = key;
+    s->map_val[h] = (int16_t)s->npal;
+    s->pal[s->npal] = color;
+    return (uint8_t)s->npal++;
+}
+
+// (helper) append to message being built
+static inline void net_msg (net_server* s, const void* p, size_t len)
+{
+    s->msg.insert(s->msg.end(), (const uint8_t*)p, (const uint8_t*)p + len);
+}
+
+static inline void net_msg16 (net_server* s, uint32_t v)
+{
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    net_msg(s, b, 2);
+}
+
+static inline void net_msg32 (net_server* s, uint32_t v)
+{
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    net_msg(s, b, 4);
+}
+
+// (helper) frame k (already indexed) to client, or dropped if client is busy
+static void net_send_frame (net_server* s, net_client* c, uint32_t k, uint64_t t_pub)
+{
+    int w = s->width, h = s->height;
+    for (int y=0; y<h; y++) c->dirty[y] |= s->dirty[y];
+    if (c->out_pos < c->out.size()) {
+        c->st.dropped++;
+        met_add(MET_NET_DROPPED, 1);
+        return;
+    }
+    if (c->pal_sent < s->npal) {
+        s->msg.clear();
+        net_msg(s, "P\0", 2);
+        net_msg16(s, s->npal);
+        for (uint32_t i=0; i<s->npal; i++) net_msg32(s, s->pal[i]);
+        net_put(c, s->msg.data(), s->msg.size());
+        c->pal_sent = s->npal;
+    }
+    s->msg.clear();
+    if (c->need_key) {
+        net_msg(s, "K\0", 2);
+        net_msg16(s, w);
+        net_msg16(s, h);
+        net_msg16(s, 0);
+        net_msg32(s, k);
+        net_msg(s, s->idx.data(), (size_t)w*h);
+        c->need_key = 0;
+        c->st.keyframes++;
+    } else {
+        net_msg(s, "D\0\0\0", 4);
+        net_msg32(s, k);
+        uint32_t runs = 0;
+        for (int y=0; y<h; ) {
+            if (!c->dirty[y]) { y++; continue; }
+            int y1 = y;
+            while (y1 < h && c->dirty[y1]) y1++;
+            net_msg16(s, y);
+            net_msg16(s, y1 - y);
+            net_msg(s, &s->idx[(size_t)y*w], (size_t)(y1 - y)*w);
+            runs++;
+            y = y1;
+        }
+        s->msg[2] = (uint8_t)runs;
+        s->msg[3] = (uint8_t)(runs >> 8);
+    }
+    memset(c->dirty.data(), 0, h);
+    net_put(c, s->msg.data(), s->msg.size());
+    c->t_frame = t_pub;
+}
+
+// (helper) take frame k from ring and hand it to clients, 0 if it was overwritten meanwhile
+static int net_frame (net_server* s, uint32_t k)
+{
+    dec_state* d = s->d;
+    int w = d->width, h = d->height;
+    uint64_t t_pub = s->t_pub[k & (d->nbuf-1)];
+    memcpy(s->pix.data(), d->bufs[k & (d->nbuf-1)], (size_t)w*h*sizeof(uint32_t));
+    if (d->seq - k > d->nbuf - 2) return 0;
+    if (d->palette == 0 && d->mode == MODE_BK) dec_to_bw(s->pix.data(), w*h);
+    // geometry changed - everyone starts over with keyframe
+    if (w != s->width || h != s->height) {
+        s->width = w;
+        s->height = h;
+        s->idx.assign((size_t)w*h, 0);
+        s->prev.assign((size_t)w*h, 0);
+        s->dirty.assign(h, 1);
+        for (int i=0; i<NET_MAX_CLIENTS; i++) {
+            net_client* c = s->clients[i];
+            if (c == NULL) continue;
+            c->need_key = 1;
+            c->dirty.assign(h, 0);
+        }
+    }
+    const uint32_t* p = s->pix.data();
+    uint8_t* q = s->idx.data();
+    uint32_t last = p[0] + 1;
+    uint8_t last_i = 0;
+    for (int i=0; i<w*h; i++) {
+        if (p[i] != last) { last = p[i]; last_i = net_color(s, last); }
+        q[i] = last_i;
+    }
+    for (int y=0; y<h; y++) s->dirty[y] = memcmp(&q[(size_t)y*w], &s->prev[(size_t)y*w], w) != 0;
+    for (int i=0; i<NET_MAX_CLIENTS; i++) {
+        net_client* c = s->clients[i];
+        if (c && (c->state == NET_RAW || c->state == NET_WS)) {
+            if (c->dirty.size() != (size_t)h) c->dirty.assign(h, 0);
+            net_send_frame(s, c, k, t_pub);
+        }
+    }
+    s->idx.swap(s->prev);
+    return 1;
+}
+
+// (thread) accept clients, take frames, send
+static void net_thread_proc (net_server* s)
+{
+    met_thread("net");
+    trace_thread("net");
+    while (s->active.load()) {
+        fd_set rd, wr;
+        FD_ZERO(&rd);
+        FD_ZERO(&wr);
+        FD_SET(s->lfd, &rd);
+        net_sock top = s->lfd;
+        for (int i=0; i<NET_MAX_CLIENTS; i++) {
+            net_client* c = s->clients[i];
+            if (c == NULL) continue;
+            FD_SET(c->fd, &rd);
+            if (c->out_pos < c->out.size()) FD_SET(c->fd, &wr);
+            if (c->fd > top) top = c->fd;
+        }
+        struct timeval tv = { 0, 1000 };
+        int n = select((int)top + 1, &rd, &wr, NULL, &tv);
+        if (n > 0 && FD_ISSET(s->lfd, &rd)) {
+            struct sockaddr_in a;
+#ifdef _WIN32
+            int alen = sizeof(a);
+#else
+            socklen_t alen = sizeof(a);
+#endif
+            net_sock fd = accept(s->lfd, (struct sockaddr*)&a, &alen);
+            int slot = -1;
+            for (int i=0; i<NET_MAX_CLIENTS && slot < 0; i++) if (s->clients[i] == NULL) slot = i;
+            if (fd != NET_BAD_SOCK && slot < 0) net_close_sock(fd);
+            else if (fd != NET_BAD_SOCK) {
+#ifdef _WIN32
+                u_long nb = 1;
+                ioctlsocket(fd, FIONBIO, &nb);
+#else
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+                // small socket buffer - a slow client shows as busy (frames dropped) instead of
+                // megabytes of frames queued in kernel
+                int one = 1, sndbuf = NET_SNDBUF;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+                setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char*)&sndbuf, sizeof(sndbuf));
+                net_client* c = new net_client();
+                c->fd = fd;
+                c->st.id = ++s->next_id;
+                snprintf(c->st.addr, sizeof(c->st.addr), "%s:%u", inet_ntoa(a.sin_addr), ntohs(a.sin_port));
+                s->clients[slot] = c;
+            }
+        }
+        for (int i=0; i<NET_MAX_CLIENTS; i++) {
+            net_client* c = s->clients[i];
+            if (c == NULL || n <= 0) continue;
+            if ((FD_ISSET(c->fd, &rd) && net_read(s, c) != 0) ||
+                (FD_ISSET(c->fd, &wr) && net_write(c) != 0)) net_drop_client(s, i);
+        }
+        // frames completed meanwhile (newest only if server is behind ring)
+        dec_state* d = s->d;
+        uint32_t seq = d->seq;
+        if (seq == s->next_seq) continue;
+        if (seq - s->next_seq > d->nbuf - 2) {
+            s->skipped += seq - 1 - s->next_seq;
+            s->next_seq = seq - 1;
+        }
+        uint32_t k = s->next_seq++;
+        trace_begin("net frame", k);
+        if (net_frame(s, k)) s->frames++;
+        else s->skipped++;
+        // start sending at once, rest goes when sockets take it
+        for (int i=0; i<NET_MAX_CLIENTS; i++) {
+            net_client* c = s->clients[i];
+            if (c && c->out_pos < c->out.size() && net_write(c) != 0) net_drop_client(s, i);
+        }
+        trace_end("net frame");
+    }
+    for (int i=0; i<NET_MAX_CLIENTS; i++) if (s->clients[i]) net_drop_client(s, i);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// server
+////////////////////////////////////////////////////////////////////////////////
+
+// listen on 127.0.0.1:port and start serving frames completed from now on, returns 0 if ok
+static int net_start (net_server* s, dec_state* d, int port)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(1, 1), &wsa) != 0) return 1;
+#endif
+    s->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->lfd == NET_BAD_SOCK) return 1;
+    int one = 1;
+    setsockopt(s->lfd, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons((uint16_t)port);
+    if (bind(s->lfd, (struct sockaddr*)&a, sizeof(a)) != 0 || listen(s->lfd, 4) != 0) {
+        net_close_sock(s->lfd);
+        return 2;
+    }
+    s->port = port;
+    s->d = d;
+    s->next_seq = d->seq;
+    s->width = s->height = 0;
+    s->pix.resize(SCR_MAXBUF);
+    s->npal = 0;
+    memset(s->map_key, 0, sizeof(s->map_key));
+    memset(s->clients, 0, sizeof(s->clients));
+    s->streaming = 0;
+    s->next_id = 0;
+    s->frames = s->skipped = 0;
+    s->closed.clear();
+    s->active = 1;
+    s->th = std::thread(net_thread_proc, s);
+    return 0;
+}
+
+// (decoder, from on_frame) buffer n is complete now
+static inline void net_publish (net_server* s, uint32_t n)
+{
+    s->t_pub[n] = time_ns();
+}
+
+// clients currently streaming
+static int net_clients (const net_server* s)
+{
+    return s->streaming.load();
+}
+
+static void net_stop (net_server* s)
+{
+    if (s->active.load() == 0) return;
+    s->active = 0;
+    if (s->th.joinable()) s->th.join();
+    net_close_sock(s->lfd);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// per client report (after net_stop)
+static void net_report (const net_server* s, FILE* f)
+{
+    fprintf(f, "net: port %i, %u frames served, %u skipped, %u clients\n",
+        s->port, s->frames, s->skipped, (unsigned)s->closed.size());
+    for (size_t i=0; i<s->closed.size(); i++) {
+        const net_stats* c = &s->closed[i];
+        double sec = (c->t_close - c->t_connect) / 1e9;
+        fprintf(f, "  client %i %s (%s): %.1f s, %u frames (%u key), %u dropped, %.2f MB, %.1f KB/s,"
+            " latency %.3f ms mean, %.3f ms max\n",
+            c->id, c->addr, c->ws ? "websocket" : "tcp", sec, c->frames, c->keyframes, c->dropped,
+            c->bytes / 1048576.0, sec > 0 ? c->bytes / 1024.0 / sec : 0.0,
+            c->frames ? c->lat_sum / 1e6 / c->frames : 0.0, c->lat_max / 1e6);
+    }
+}
+
+#endif
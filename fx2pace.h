@@ -0,0 +1,140 @@
+// display pacing - which completed frame to show at every display refresh
+// PACE_IMMEDIATE paints frame the moment it is complete (lowest latency, usb jitter
+// and 50 Hz against display refresh show up as uneven motion)
+// PACE_BUFFERED keeps smoothed source timeline (alpha-beta filter over frame completion
+// times) and at every refresh shows the frame which was due `depth` frames ago - usb
+// jitter smaller than that is absorbed and 50 -> 60/75/... Hz conversion gets steady cadence
+// more depth - smoother, but depth * 20 ms more latency
+
+#ifndef FX2PACE_H
+#define FX2PACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include "fx2dec.h"
+
+#define PACE_IMMEDIATE  0
+#define PACE_BUFFERED   1
+
+#define PACE_PERIOD     20000000.0  // nominal frame period, ns (50 Hz)
+
+// timeline as seen by display thread
+struct pace_timeline {
+    uint32_t  last_seq;             // newest completed frame
+    double    last_est;             // its smoothed completion time, ns
+    double    period;               // measured frame period, ns
+    uint32_t  first_seq;            // first frame of current timeline
+};
+
+struct pace_state {
+    int       mode;
+    double    depth;                // jitter buffer, frames
+    uint32_t  nbuf;                 // decoder ring size
+    pace_timeline tl;               // (decoder) filter state
+    int       started;
+    // published copy of tl - seqlock, odd version while decoder rewrites it
+    std::atomic<uint32_t> pub_ver;
+    pace_timeline pub;
+    std::atomic<int> pub_started;
+    uint32_t  shown_seq;            // last frame picked (display thread)
+    int       shown_any;
+    uint32_t  resyncs;              // timeline restarts (gaps, mode change)
+};
+
+
+static void pace_init (pace_state* p, int mode, double depth, uint32_t nbuf = DEC_NBUF)
+{
+    p->mode = mode;
+    p->depth = depth;
+    p->nbuf = nbuf;
+    p->started = 0;
+    p->pub_ver = 0;
+    p->pub_started = 0;
+    p->shown_any = 0;
+    p->resyncs = 0;
+    p->tl.period = PACE_PERIOD;
+}
+
+// (helper, decoder) publish timeline for display thread
+static void pace_publish (pace_state* p)
+{
+    uint32_t v = p->pub_ver.load(std::memory_order_relaxed);
+    p->pub_ver.store(v + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    p->pub = p->tl;
+    p->pub_ver.store(v + 2, std::memory_order_release);
+    p->pub_started.store(1, std::memory_order_release);
+}
+
+// (helper, display) consistent copy of published timeline, 0 if there is none yet
+static int pace_read (pace_state* p, pace_timeline* tl)
+{
+    if (!p->pub_started.load(std::memory_order_acquire)) return 0;
+    for (;;) {
+        uint32_t v = p->pub_ver.load(std::memory_order_acquire);
+        if (v & 1) continue;
+        *tl = p->pub;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (p->pub_ver.load(std::memory_order_relaxed) == v) return 1;
+    }
+}
+
+// (decoder) frame seq completed at t (ns)
+static void pace_frame (pace_state* p, uint32_t seq, uint64_t t)
+{
+    pace_timeline* tl = &p->tl;
+    if (!p->started) {
+        tl->last_est = (double)t;
+        tl->last_seq = tl->first_seq = seq;
+        p->started = 1;
+        pace_publish(p);
+        return;
+    }
+    uint32_t k = seq - tl->last_seq;
+    double pred = tl->last_est + tl->period * k;
+    double err = (double)t - pred;
+    // far off - signal lost or mode changed, start over
+    if (k == 0 || k > p->nbuf || err > 4*PACE_PERIOD || err < -4*PACE_PERIOD) {
+        tl->last_est = (double)t;
+        tl->period = PACE_PERIOD;
+        tl->last_seq = tl->first_seq = seq;
+        p->resyncs++;
+        pace_publish(p);
+        return;
+    }
+    // alpha-beta filter: follow arrival slowly, learn real period even slower
+    double period = tl->period + err / 256 / k;
+    if (period < PACE_PERIOD*0.9) period = PACE_PERIOD*0.9;
+    if (period > PACE_PERIOD*1.1) period = PACE_PERIOD*1.1;
+    tl->period = period;
+    tl->last_est = pred + err / 16;
+    tl->last_seq = seq;
+    pace_publish(p);
+}
+
+// (display) refresh at t, returns 1 and frame to show if it differs from shown one
+static int pace_pick (pace_state* p, uint64_t t, uint32_t* seq)
+{
+    pace_timeline tl;
+    if (!pace_read(p, &tl)) return 0;
+    uint32_t last = tl.last_seq;
+    double est = tl.last_est;
+    double period = tl.period;
+    // frame due at t - depth; newest completed one at most, one still in ring
+    // and of current timeline at least
+    double back = (est - ((double)t - p->depth * period)) / period;
+    uint32_t k = last;
+    if (back > 0) {
+        uint32_t b = (uint32_t)(back + 0.999);
+        if (b > p->nbuf - 3) b = p->nbuf - 3;
+        if (b > last - tl.first_seq) b = last - tl.first_seq;
+        k = last - b;
+    }
+    if (p->shown_any && (int32_t)(k - p->shown_seq) <= 0) return 0;
+    p->shown_seq = k;
+    p->shown_any = 1;
+    *seq = k;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,137 @@
+// work-stealing thread pool for batch jobs (frame export and such)
+// every worker has its own deque: it takes newest tasks from its back, idle
+// workers steal oldest tasks from the front of others, so uneven tasks balance out
+// tasks can be added all at once or by a producer while workers run
+
+#ifndef FX2POOL_H
+#define FX2POOL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include "fx2stat.h"
+
+#define POOL_MAX_THREADS    64
+
+struct pool_task {
+    uint32_t  idx;                  // task number (frame)
+    void*     data;                 // (optional) task data
+};
+
+struct pool_state;
+typedef void (*pool_fn)(pool_state* p, int worker, pool_task* t);
+
+struct pool_worker {
+    std::mutex mtx;
+    std::deque<pool_task> q;
+    std::thread th;
+    uint64_t  done;                 // tasks run
+    uint64_t  stolen;               // of them taken from other workers
+    uint64_t  busy_ns;              // time spent in tasks
+};
+
+struct pool_state {
+    int       nthreads;
+    pool_worker w[POOL_MAX_THREADS];
+    pool_fn   run;
+    void*     user;
+    std::atomic<uint32_t> next_push;    // round robin for pool_push
+    std::atomic<uint32_t> pending;      // pushed but not finished
+    std::atomic<int> closing;           // no more tasks will come
+};
+
+
+// (helper) take task from own back or steal from front of others
+static int pool_take (pool_state* p, int self, pool_task* t, int* stolen)
+{
+    {
+        std::lock_guard<std::mutex> lock(p->w[self].mtx);
+        if (!p->w[self].q.empty()) {
+            *t = p->w[self].q.back();
+            p->w[self].q.pop_back();
+            *stolen = 0;
+            return 1;
+        }
+    }
+    for (int k=1; k<p->nthreads; k++) {
+        pool_worker* v = &p->w[(self + k) % p->nthreads];
+        std::lock_guard<std::mutex> lock(v->mtx);
+        if (!v->q.empty()) {
+            *t = v->q.front();
+            v->q.pop_front();
+            *stolen = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// (thread) run tasks until pool is closed and drained
+static void pool_worker_proc (pool_state* p, int self)
+{
+    pool_worker* me = &p->w[self];
+    for (;;) {
+        pool_task t;
+        int stolen;
+        if (pool_take(p, self, &t, &stolen)) {
+            uint64_t t0 = time_ns();
+            p->run(p, self, &t);
+            me->busy_ns += time_ns() - t0;
+            me->done++;
+            me->stolen += stolen;
+            p->pending--;
+            continue;
+        }
+        if (p->closing.load() && p->pending.load() == 0) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+// start workers (nthreads <= 0 - all cores)
+static void pool_start (pool_state* p, int nthreads, pool_fn run, void* user)
+{
+    if (nthreads <= 0) nthreads = (int)std::thread::hardware_concurrency();
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > POOL_MAX_THREADS) nthreads = POOL_MAX_THREADS;
+    p->nthreads = nthreads;
+    p->run = run;
+    p->user = user;
+    p->next_push = 0;
+    p->pending = 0;
+    p->closing = 0;
+    for (int i=0; i<nthreads; i++) {
+        p->w[i].done = 0;
+        p->w[i].stolen = 0;
+        p->w[i].busy_ns = 0;
+        p->w[i].th = std::thread(pool_worker_proc, p, i);
+    }
+}
+
+// add task to next worker's deque
+static void pool_push (pool_state* p, uint32_t idx, void* data)
+{
+    pool_task t = { idx, data };
+    pool_worker* w = &p->w[p->next_push++ % p->nthreads];
+    p->pending++;
+    std::lock_guard<std::mutex> lock(w->mtx);
+    w->q.push_back(t);
+}
+
+// producer side back pressure - wait while more than max tasks are queued or running
+static void pool_wait_below (pool_state* p, uint32_t max)
+{
+    while (p->pending.load() > max) std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+// no more tasks - wait for workers to drain queues and exit
+static void pool_finish (pool_state* p)
+{
+    p->closing = 1;
+    for (int i=0; i<p->nthreads; i++) if (p->w[i].th.joinable()) p->w[i].th.join();
+}
+
+#endif
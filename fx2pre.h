@@ -0,0 +1,270 @@
+// pre-trigger signal ring - always holds last seconds of raw samples in memory, so
+// a glitch seen on screen can still be saved after it happened
+// producer (usb callback, replay) collects samples into blocks of RLE_BLOCK_RAW, run
+// length encodes full ones (signal packs 40..100:1) and appends them to byte arena,
+// oldest blocks go as new ones need room or are older than the seconds kept
+// pre_dump (any thread: menu, key, detector) asks for dump, names it and counts it;
+// producer takes snapshot
+// after its next data - current partial block is closed and all blocks present are
+// pinned - and writer thread saves them to rle capture file (raw samples if ring is
+// not compressed) while acquisition goes on; producer never waits, if pinned blocks
+// leave no room new blocks are lost for ring and next dump starts after them
+// (header only, used from fx2bk.cpp and fx2head.cpp)
+
+#ifndef FX2PRE_H
+#define FX2PRE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fx2cap.h"
+#include "fx2stat.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+
+#define PRE_MAXBLOCKS   1024        // about 87 s of signal
+
+#define PRE_IDLE        0
+#define PRE_NAMING      1           // requester sets file name
+#define PRE_REQUESTED   2           // producer takes snapshot with next data
+#define PRE_WRITING     3           // writer thread saves snapshot
+
+struct pre_block {
+    uint64_t  pos;                  // arena position (grows forever, modulo size)
+    uint32_t  raw_len;
+    uint32_t  enc_len;
+    uint32_t  type;                 // RLE_TYPE_RUNS / RLE_TYPE_STORED
+};
+
+struct pre_ring {
+    int       rle;                  // encode blocks (dump is rle file), plain samples otherwise
+    int       mode;                 // MODE_BK / MODE_UKNC of rle header (set with name)
+    uint32_t  max_blocks;           // history kept, blocks
+    uint8_t*  mem;                  // arena
+    uint64_t  size;
+    uint8_t*  stage;                // (producer) block being collected
+    uint32_t  stage_fill;
+    uint8_t*  scratch;              // (producer) encoded block
+    pre_block blk[PRE_MAXBLOCKS];   // block seq is at seq % PRE_MAXBLOCKS
+    uint32_t  first;                // (producer) oldest block kept
+    uint32_t  count;
+    uint32_t  valid_from;           // first block after lost ones
+    uint64_t  wr;                   // (producer) arena position of next block
+    std::atomic<int> state;         // PRE_IDLE ...
+    char      name[512];            // dump file
+    uint32_t  snap_first;           // pinned blocks of snapshot
+    uint32_t  snap_count;
+    std::atomic<int> active;        // writer thread runs
+    std::thread th;
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_lost;   // samples not kept while snapshot was pinned
+    std::atomic<uint32_t> dumps;
+    std::atomic<uint32_t> asked;    // dumps taken by pre_dump
+    std::atomic<uint32_t> busy;     // asked while previous one was not written yet
+    uint64_t  last_samples;         // of last dump
+    uint64_t  last_bytes;
+    uint64_t  last_ns;              // writing it
+    int       io_error;
+};
+
+
+// (producer) oldest block is pinned by snapshot being written
+static inline int pre_pinned (const pre_ring* p)
+{
+    return p->state.load(std::memory_order_acquire) == PRE_WRITING &&
+        p->first - p->snap_first < p->snap_count;
+}
+
+// (helper, producer) append block of stage to arena
+static void pre_add_block (pre_ring* p)
+{
+    uint32_t raw_len = p->stage_fill;
+    p->stage_fill = 0;
+    if (raw_len == 0) return;
+    const uint8_t* src = p->stage;
+    uint32_t len = raw_len, type = RLE_TYPE_STORED;
+    if (p->rle) {
+        uint32_t enc = rle_encode(p->stage, raw_len, p->scratch);
+        if (enc != 0) { src = p->scratch; len = enc; type = RLE_TYPE_RUNS; }
+    }
+    // block is contiguous in arena, skip to its start if it does not fit before end
+    uint64_t pos = p->wr;
+    if (pos % p->size + len > p->size) pos += p->size - pos % p->size;
+    while (p->count > 0 && (p->count >= p->max_blocks || pos + len - p->blk[p->first % PRE_MAXBLOCKS].pos > p->size)) {
+        if (pre_pinned(p)) {
+            p->bytes_lost += raw_len;
+            p->valid_from = p->first + p->count;
+            return;
+        }
+        p->first++;
+        p->count--;
+    }
+    memcpy(p->mem + pos % p->size, src, len);
+    pre_block* b = &p->blk[(p->first + p->count) % PRE_MAXBLOCKS];
+    b->pos = pos;
+    b->raw_len = raw_len;
+    b->enc_len = len;
+    b->type = type;
+    p->count++;
+    p->wr = pos + len;
+}
+
+// (helper, producer) close partial block and pin all blocks for writer
+static void pre_snapshot (pre_ring* p)
+{
+    pre_add_block(p);
+    uint32_t from = p->first;
+    if ((int32_t)(p->valid_from - from) > 0) from = p->valid_from;
+    p->snap_first = from;
+    p->snap_count = p->first + p->count - from;
+    trace_instant("pre snapshot", p->snap_count);
+    p->state.store(PRE_WRITING, std::memory_order_release);
+}
+
+// (helper, writer) save pinned blocks, returns 0 if ok
+static int pre_write (pre_ring* p)
+{
+    FILE* f = fopen(p->name, "wb");
+    if (f == NULL) return 1;
+    int err = p->rle ? rle_write_header(f, p->mode) : 0;
+    uint64_t samples = 0, bytes = p->rle ? sizeof(rle_file_hdr) : 0;
+    for (uint32_t i=0; i<p->snap_count && err == 0; i++) {
+        const pre_block* b = &p->blk[(p->snap_first + i) % PRE_MAXBLOCKS];
+        const uint8_t* payload = p->mem + b->pos % p->size;
+        if (p->rle) {
+            rle_block_hdr h;
+            h.raw_len = b->raw_len;
+            h.enc_len = b->enc_len;
+            h.crc = crc32_buf(payload, b->enc_len);
+            h.type = b->type;
+            if (fwrite(&h, sizeof(h), 1, f) != 1) err = 1;
+            bytes += sizeof(h);
+        }
+        if (fwrite(payload, 1, b->enc_len, f) != b->enc_len) err = 1;
+        bytes += b->enc_len;
+        samples += b->raw_len;
+    }
+    if (fclose(f) != 0) err = 1;
+    p->last_samples = samples;
+    p->last_bytes = bytes;
+    return err;
+}
+
+// writer thread - saves snapshots as they are taken
+static void pre_writer_proc (pre_ring* p)
+{
+    met_thread("pre writer");
+    trace_thread("pre writer");
+    while (p->active.load()) {
+        if (p->state.load(std::memory_order_acquire) != PRE_WRITING) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        uint64_t t0 = time_ns();
+        trace_begin("pre dump", p->snap_count);
+        if (pre_write(p) != 0) p->io_error = 1;
+        trace_end("pre dump");
+        p->last_ns = time_ns() - t0;
+        p->dumps++;
+        p->state.store(PRE_IDLE, std::memory_order_release);
+    }
+}
+
+// keep last seconds of signal within mb of memory, rle - compressed, returns 0 if ok
+static int pre_start (pre_ring* p, double seconds, int mb, int rle)
+{
+    p->rle = rle;
+    p->mode = MODE_BK;
+    double blocks = seconds * SAMPLE_HZ / RLE_BLOCK_RAW + 1;
+    p->max_blocks = (blocks > PRE_MAXBLOCKS) ? PRE_MAXBLOCKS : (blocks < 2) ? 2 : (uint32_t)blocks;
+    p->size = (uint64_t)mb << 20;
+    if (p->size < RLE_MAX_ENC) p->size = RLE_MAX_ENC;
+    p->mem = (uint8_t*) malloc((size_t)p->size);
+    p->stage = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    p->scratch = (uint8_t*) malloc(RLE_MAX_ENC);
+    if (p->mem == NULL || p->stage == NULL || p->scratch == NULL) {
+        free(p->mem); free(p->stage); free(p->scratch);
+        p->mem = p->stage = p->scratch = NULL;
+        return 1;
+    }
+    p->stage_fill = 0;
+    p->first = p->count = p->valid_from = 0;
+    p->wr = 0;
+    p->state = PRE_IDLE;
+    p->bytes_in = 0;
+    p->bytes_lost = 0;
+    p->dumps = 0;
+    p->asked = 0;
+    p->busy = 0;
+    p->last_samples = p->last_bytes = p->last_ns = 0;
+    p->io_error = 0;
+    p->active = 1;
+    p->th = std::thread(pre_writer_proc, p);
+    return 0;
+}
+
+// producer: keep data (xor'ed with inv), never waits
+static void pre_push (pre_ring* p, const uint8_t* buf, uint32_t len, uint8_t inv)
+{
+    if (p->mem == NULL) return;
+    p->bytes_in += len;
+    uint64_t inv64 = 0x0101010101010101ull * inv;
+    while (len > 0) {
+        uint32_t n = RLE_BLOCK_RAW - p->stage_fill;
+        if (n > len) n = len;
+        uint8_t* dst = p->stage + p->stage_fill;
+        uint32_t k = 0;
+        for (; k+8<=n; k+=8) {
+            uint64_t q; memcpy(&q, buf+k, 8);
+            q ^= inv64;
+            memcpy(dst+k, &q, 8);
+        }
+        for (; k<n; k++) dst[k] = buf[k] ^ inv;
+        p->stage_fill += n;
+        buf += n;
+        len -= n;
+        if (p->stage_fill == RLE_BLOCK_RAW) pre_add_block(p);
+    }
+    // after data, so snapshot has it and next block is a whole block away
+    if (p->state.load(std::memory_order_acquire) == PRE_REQUESTED) pre_snapshot(p);
+}
+
+// (any thread) dump ring of signal in mode to file named by pattern with dump number
+// (cap_name), returns that number, 0 if ring is off, pattern is bad or previous dump is not done yet
+static uint32_t pre_dump (pre_ring* p, const char* pattern, int mode)
+{
+    int expected = PRE_IDLE;
+    if (p->mem == NULL || !cap_name_ok(pattern)) return 0;
+    if (!p->state.compare_exchange_strong(expected, PRE_NAMING)) { p->busy++; return 0; }
+    uint32_t n = ++p->asked;
+    cap_name(p->name, sizeof(p->name), pattern, n);
+    p->mode = mode;
+    p->state.store(PRE_REQUESTED, std::memory_order_release);
+    return n;
+}
+
+// seconds of signal ring holds now (producer's view, approximate from other threads)
+static double pre_span (const pre_ring* p)
+{
+    return ((double)p->count * RLE_BLOCK_RAW + p->stage_fill) / SAMPLE_HZ;
+}
+
+// finish dump asked for and stop writer (producer must not run anymore)
+static void pre_stop (pre_ring* p)
+{
+    if (!p->th.joinable()) return;
+    for (int st; (st = p->state.load()) != PRE_IDLE; ) {
+        if (st == PRE_REQUESTED) pre_snapshot(p);
+        else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    p->active = 0;
+    p->th.join();
+    free(p->mem); free(p->stage); free(p->scratch);
+    p->mem = p->stage = p->scratch = NULL;
+}
+
+#endif
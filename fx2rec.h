@@ -0,0 +1,294 @@
+// raw signal recording to disk
+// producer (usb callback) copies data into large aligned blocks, dedicated
+// writer thread flushes them with unbuffered i/o (O_DIRECT / FILE_FLAG_NO_BUFFERING)
+// producer never waits - if all blocks are busy data is counted as dropped, and
+// every such gap goes to sidecar "<file>.gaps" (file offset and samples dropped
+// there), so replay of the file can tell where frames are torn
+// REC_FX2C format goes to indexed container (buffered i/o, see fx2cap.h)
+
+#ifndef FX2REC_H
+#define FX2REC_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fx2cap.h"
+#include "fx2stat.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define REC_BLOCK_SIZE  0x400000    // 4MB per block (multiple of any sector size)
+#define REC_BLOCKS      16          // 64MB in flight, about 5s at 12MB/s
+#define REC_ALIGN       0x1000      // unbuffered i/o alignment
+
+#define REC_RAW         0           // plain samples, like test/*.bin
+#define REC_FX2C        1           // seekable container with frames index
+
+struct rec_state {
+    uint8_t*  blocks[REC_BLOCKS];
+    uint32_t  fill[REC_BLOCKS];     // bytes used in block (valid when handed to writer)
+    uint64_t  t_blk[REC_BLOCKS];    // host time of last sample in block
+    uint64_t  gap[REC_BLOCKS];      // samples dropped right before block
+    uint64_t  pending_gap;          // (producer) dropped since last block was started
+    uint32_t  cur_fill;             // producer's fill of current block
+    std::atomic<uint32_t> head;     // blocks handed to writer (producer)
+    std::atomic<uint32_t> tail;     // blocks written (writer)
+    std::atomic<int> active;        // producer accepts data
+    std::atomic<int> in_push;       // producer is inside rec_push
+    std::atomic<int> closing;       // writer should exit when drained
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> bytes_dropped;
+    std::thread writer;
+    int       io_error;
+    int       format;               // REC_RAW / REC_FX2C
+    cont_writer cont;
+    uint64_t  file_size;
+    char      gaps_name[512];       // sidecar of gaps, made with first one
+    FILE*     gaps_f;
+    uint32_t  gaps;
+#ifdef _WIN32
+    HANDLE    fh;
+#else
+    int       fd;
+#endif
+};
+
+
+// (helper) aligned block allocation
+static uint8_t* rec_alloc (size_t size)
+{
+#ifdef _WIN32
+    return (uint8_t*) VirtualAlloc(NULL, size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+#else
+    void* p = NULL;
+    if (posix_memalign(&p, REC_ALIGN, size) != 0) return NULL;
+    return (uint8_t*) p;
+#endif
+}
+
+static void rec_free (uint8_t* p)
+{
+    if (p == NULL) return;
+#ifdef _WIN32
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    free(p);
+#endif
+}
+
+// (helper) unbuffered write of aligned data, returns 0 if ok
+static int rec_file_write (rec_state* r, const uint8_t* p, uint32_t size)
+{
+#ifdef _WIN32
+    DWORD written = 0;
+    if (!WriteFile(r->fh, p, size, &written, NULL) || written != size) return 1;
+#else
+    while (size > 0) {
+        ssize_t res = write(r->fd, p, size);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        p += res;
+        size -= (uint32_t)res;
+    }
+#endif
+    return 0;
+}
+
+// (helper, writer) note dropped samples at file offset in sidecar
+static void rec_note_gap (rec_state* r, uint64_t at, uint64_t dropped)
+{
+    if (r->gaps_f == NULL) {
+        r->gaps_f = fopen(r->gaps_name, "w");
+        if (r->gaps_f == NULL) { r->io_error = 1; return; }
+        fprintf(r->gaps_f, "# samples dropped (writer behind): offset in file, count\n");
+    }
+    fprintf(r->gaps_f, "%llu %llu\n", (unsigned long long)at, (unsigned long long)dropped);
+    r->gaps++;
+}
+
+// writer thread - flush blocks until closed and drained
+static void rec_writer_proc (rec_state* r)
+{
+    met_thread("rec writer");
+    trace_thread("rec writer");
+    for (;;) {
+        uint32_t tail = r->tail.load(std::memory_order_relaxed);
+        if (tail == r->head.load(std::memory_order_acquire)) {
+            if (r->closing.load()) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        uint32_t i = tail % REC_BLOCKS;
+        uint32_t size = r->fill[i];
+        // last (partial) block is padded to alignment and cut off later
+        uint32_t aligned = (size + REC_ALIGN - 1) & ~(REC_ALIGN - 1);
+        uint64_t t0 = time_ns();
+        if (r->gap[i]) rec_note_gap(r, r->file_size, r->gap[i]);
+        trace_begin("write", size);
+        if (r->format == REC_FX2C) {
+            cont_write(&r->cont, r->blocks[i], size, r->t_blk[i]);
+            if (r->cont.error) r->io_error = 1;
+        } else {
+            memset(r->blocks[i] + size, 0, aligned - size);
+            if (r->io_error == 0 && aligned > 0) {
+                if (rec_file_write(r, r->blocks[i], aligned) != 0) r->io_error = 1;
+            }
+        }
+        trace_end("write");
+        met_hist(MET_H_REC_WRITE, time_ns() - t0);
+        if (r->io_error) {
+            r->bytes_dropped += size;
+            met_add(MET_REC_DROPPED, size);
+        } else {
+            r->bytes_written += size;
+            r->file_size += size;
+            met_add(MET_REC_BYTES, size);
+        }
+        r->tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+// open file and start writer thread, returns 0 if ok
+// (mode is needed for REC_FX2C frames index only)
+static int rec_start (rec_state* r, const char* fname, int format, int mode)
+{
+    r->head = 0; r->tail = 0; r->cur_fill = 0;
+    r->bytes_in = 0; r->bytes_written = 0; r->bytes_dropped = 0;
+    r->active = 0; r->in_push = 0; r->closing = 0;
+    r->io_error = 0; r->file_size = 0;
+    r->pending_gap = 0; r->gaps = 0; r->gaps_f = NULL;
+    snprintf(r->gaps_name, sizeof(r->gaps_name), "%s.gaps", fname);
+    remove(r->gaps_name);           // of previous recording
+    r->format = format;
+    if (format == REC_FX2C) {
+        if (cont_create(&r->cont, fname, mode, time_ns()) != 0) return 1;
+    } else {
+#ifdef _WIN32
+        r->fh = CreateFileA(fname, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_NO_BUFFERING, NULL);
+        if (r->fh == INVALID_HANDLE_VALUE) return 1;
+#else
+        r->fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT, 0644);
+        // some filesystems (tmpfs) have no O_DIRECT
+        if (r->fd < 0 && errno == EINVAL) r->fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (r->fd < 0) return 1;
+#endif
+    }
+    for (int i=0; i<REC_BLOCKS; i++) {
+        r->blocks[i] = rec_alloc(REC_BLOCK_SIZE);
+        if (r->blocks[i] == NULL) {
+            for (int j=0; j<i; j++) { rec_free(r->blocks[j]); r->blocks[j] = NULL; }
+            if (format == REC_FX2C) cont_close(&r->cont);
+#ifdef _WIN32
+            else CloseHandle(r->fh);
+#else
+            else close(r->fd);
+#endif
+            return 2;
+        }
+    }
+    r->writer = std::thread(rec_writer_proc, r);
+    r->active = 1;
+    return 0;
+}
+
+// producer: copy data (xor'ed with inv) to blocks, never waits
+static void rec_push (rec_state* r, const uint8_t* buf, uint32_t len, uint8_t inv)
+{
+    r->in_push = 1;
+    if (r->active.load() == 0) { r->in_push = 0; return; }
+    r->bytes_in += len;
+    uint64_t inv64 = 0x0101010101010101ull * inv;
+    while (len > 0) {
+        uint32_t head = r->head.load(std::memory_order_relaxed);
+        if (head - r->tail.load(std::memory_order_acquire) >= REC_BLOCKS) {
+            // writer is behind, all blocks are busy
+            r->bytes_dropped += len;
+            r->pending_gap += len;
+            met_add(MET_REC_DROPPED, len);
+            break;
+        }
+        if (r->cur_fill == 0) {
+            // block starts here, after whatever was dropped
+            r->gap[head % REC_BLOCKS] = r->pending_gap;
+            r->pending_gap = 0;
+        }
+        uint8_t* dst = r->blocks[head % REC_BLOCKS] + r->cur_fill;
+        uint32_t n = REC_BLOCK_SIZE - r->cur_fill;
+        if (n > len) n = len;
+        uint32_t k = 0;
+        for (; k+8<=n; k+=8) {
+            uint64_t q; memcpy(&q, buf+k, 8);
+            q ^= inv64;
+            memcpy(dst+k, &q, 8);
+        }
+        for (; k<n; k++) dst[k] = buf[k] ^ inv;
+        r->cur_fill += n;
+        buf += n;
+        len -= n;
+        if (r->cur_fill == REC_BLOCK_SIZE) {
+            r->fill[head % REC_BLOCKS] = REC_BLOCK_SIZE;
+            r->t_blk[head % REC_BLOCKS] = time_ns();
+            r->cur_fill = 0;
+            r->head.store(head + 1, std::memory_order_release);
+        }
+        met_gauge(MET_G_REC_BACKLOG, r->head.load(std::memory_order_relaxed) - r->tail.load(std::memory_order_relaxed));
+    }
+    r->in_push = 0;
+}
+
+// stop producer, flush everything, close file
+static void rec_stop (rec_state* r)
+{
+    if (!r->writer.joinable()) return;
+    r->active = 0;
+    while (r->in_push.load()) std::this_thread::yield();
+    // hand partial block to writer (if there is free one)
+    uint32_t head = r->head.load();
+    if (r->cur_fill > 0) {
+        while (head - r->tail.load() >= REC_BLOCKS) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        r->fill[head % REC_BLOCKS] = r->cur_fill;
+        r->t_blk[head % REC_BLOCKS] = time_ns();
+        r->cur_fill = 0;
+        r->head.store(head + 1, std::memory_order_release);
+    }
+    r->closing = 1;
+    r->writer.join();
+    if (r->pending_gap) rec_note_gap(r, r->file_size, r->pending_gap);
+    if (r->gaps_f && fclose(r->gaps_f) != 0) r->io_error = 1;
+    r->gaps_f = NULL;
+    if (r->format == REC_FX2C) {
+        if (cont_close(&r->cont) != 0) r->io_error = 1;
+    } else {
+        // cut off padding of the last block
+#ifdef _WIN32
+        LARGE_INTEGER pos; pos.QuadPart = (LONGLONG)r->file_size;
+        SetFilePointerEx(r->fh, pos, NULL, FILE_BEGIN);
+        SetEndOfFile(r->fh);
+        CloseHandle(r->fh);
+#else
+        if (ftruncate(r->fd, (off_t)r->file_size) != 0) r->io_error = 1;
+        close(r->fd);
+#endif
+    }
+    for (int i=0; i<REC_BLOCKS; i++) { rec_free(r->blocks[i]); r->blocks[i] = NULL; }
+}
+
+#endif
@@ -0,0 +1,191 @@
+// presentation kernel - integer scaling of decoded frame (1x2, 2x2, 3x3 ...) with
+// optional scanline darkening, done on cpu into reused output buffer
+// every source line is widened once into a small cached line (and its darkened copy),
+// output lines are then streamed from there (non-temporal stores for big outputs)
+// SSE2 on x86/x64, plain C elsewhere (scale_frame_ref is the reference)
+
+#ifndef FX2SCALE_H
+#define FX2SCALE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCALE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define SCALE_MAX       16          // max factor per axis
+#define SCALE_STREAM    0x400000    // outputs bigger than that bypass cache
+
+struct scale_state {
+    uint32_t* out;                  // output frame, out_w x out_h, 64 bytes aligned
+    size_t    cap;                  // allocated pixels
+    int       out_w;
+    int       out_h;
+    uint32_t* line;                 // widened source line
+    uint32_t* dark;                 // same darkened
+    size_t    line_cap;
+};
+
+
+// (helper) 64 bytes aligned buffers
+static uint32_t* scale_alloc (size_t pixels)
+{
+#ifdef _WIN32
+    return (uint32_t*) _aligned_malloc(pixels*sizeof(uint32_t), 64);
+#else
+    void* p = NULL;
+    if (posix_memalign(&p, 64, pixels*sizeof(uint32_t)) != 0) return NULL;
+    return (uint32_t*) p;
+#endif
+}
+
+static void scale_free_buf (uint32_t* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+static void scale_free (scale_state* s)
+{
+    scale_free_buf(s->out);
+    scale_free_buf(s->line);
+    scale_free_buf(s->dark);
+    memset(s, 0, sizeof(scale_state));
+}
+
+// (helper) widen line n times horizontally
+static void scale_widen (uint32_t* dst, const uint32_t* src, int w, int sx)
+{
+    int x = 0;
+#ifdef SCALE_SSE2
+    if (sx == 1) {
+        memcpy(dst, src, w*sizeof(uint32_t));
+        return;
+    }
+    for (; x+4<=w; x+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i* d = (__m128i*)(dst + x*sx);
+        if (sx == 2) {
+            _mm_storeu_si128(d,   _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128(d+1, _mm_unpackhi_epi32(v, v));
+        } else if (sx == 3) {
+            _mm_storeu_si128(d,   _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,0,0)));
+            _mm_storeu_si128(d+1, _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,1,1)));
+            _mm_storeu_si128(d+2, _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,2)));
+        } else {
+            // every pixel broadcast to whole vectors, rest of it one by one
+            __m128i p[4] = { _mm_shuffle_epi32(v, 0x00), _mm_shuffle_epi32(v, 0x55),
+                             _mm_shuffle_epi32(v, 0xAA), _mm_shuffle_epi32(v, 0xFF) };
+            uint32_t* o = dst + x*sx;
+            for (int i=0; i<4; i++) {
+                int k = 0;
+                for (; k+4<=sx; k+=4) _mm_storeu_si128((__m128i*)(o + k), p[i]);
+                for (; k<sx; k++) o[k] = src[x+i];
+                o += sx;
+            }
+        }
+    }
+#endif
+    for (; x<w; x++) {
+        uint32_t c = src[x];
+        for (int k=0; k<sx; k++) dst[x*sx + k] = c;
+    }
+}
+
+// (helper) every color channel * level / 256
+static void scale_darken (uint32_t* dst, const uint32_t* src, int n, int level)
+{
+    int i = 0;
+#ifdef SCALE_SSE2
+    __m128i z = _mm_setzero_si128();
+    __m128i f = _mm_set1_epi16((short)level);
+    for (; i+4<=n; i+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, z), f), 8);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, z), f), 8);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i<n; i++) {
+        uint32_t c = src[i];
+        dst[i] = ((((c & 0xFF00FF) * level) >> 8) & 0xFF00FF) | ((((c & 0x00FF00) * level) >> 8) & 0x00FF00);
+    }
+}
+
+// (helper) output line copy, non-temporal if asked and aligned
+static void scale_store (uint32_t* dst, const uint32_t* src, int n, int stream)
+{
+#ifdef SCALE_SSE2
+    if (stream && ((uintptr_t)dst & 15) == 0) {
+        int i = 0;
+        for (; i+4<=n; i+=4) _mm_stream_si128((__m128i*)(dst + i), _mm_load_si128((const __m128i*)(src + i)));
+        for (; i<n; i++) dst[i] = src[i];
+        return;
+    }
+#endif
+    memcpy(dst, src, n*sizeof(uint32_t));
+}
+
+// scale frame w x h by sx, sy into s->out (reallocated only when it grows)
+// level < 256 darkens last line of every sy group (scanlines, needs sy >= 2)
+// returns 0 if ok
+static int scale_frame (scale_state* s, const uint32_t* pix, int w, int h, int sx, int sy, int level)
+{
+    if (sx < 1 || sy < 1 || sx > SCALE_MAX || sy > SCALE_MAX) return 1;
+    size_t ow = (size_t)w * sx;
+    size_t need = ow * h * sy;
+    if (need > s->cap) {
+        scale_free_buf(s->out);
+        s->out = scale_alloc(need);
+        s->cap = s->out ? need : 0;
+        if (s->out == NULL) return 2;
+    }
+    if (ow > s->line_cap) {
+        scale_free_buf(s->line);
+        scale_free_buf(s->dark);
+        s->line = scale_alloc(ow);
+        s->dark = scale_alloc(ow);
+        s->line_cap = (s->line && s->dark) ? ow : 0;
+        if (s->line_cap == 0) return 2;
+    }
+    s->out_w = (int)ow;
+    s->out_h = h * sy;
+    int scan = (sy >= 2 && level < 256);
+    int stream = (need*sizeof(uint32_t) > SCALE_STREAM && (ow & 3) == 0);
+    uint32_t* dst = s->out;
+    for (int y=0; y<h; y++) {
+        scale_widen(s->line, pix + (size_t)y*w, w, sx);
+        if (scan) scale_darken(s->dark, s->line, (int)ow, level);
+        for (int k=0; k<sy; k++, dst += ow)
+            scale_store(dst, (scan && k == sy-1) ? s->dark : s->line, (int)ow, stream);
+    }
+#ifdef SCALE_SSE2
+    if (stream) _mm_sfence();
+#endif
+    return 0;
+}
+
+// plain reference, same result as scale_frame (dst is w*sx x h*sy)
+static void scale_frame_ref (uint32_t* dst, const uint32_t* pix, int w, int h, int sx, int sy, int level)
+{
+    size_t ow = (size_t)w * sx;
+    for (int y=0; y<h*sy; y++) {
+        int dk = (sy >= 2 && level < 256 && y % sy == sy-1);
+        for (size_t x=0; x<ow; x++) {
+            uint32_t c = pix[(size_t)(y/sy)*w + x/sx];
+            if (dk) c = ((((c & 0xFF00FF) * level) >> 8) & 0xFF00FF) | ((((c & 0x00FF00) * level) >> 8) & 0x00FF00);
+            dst[y*ow + x] = c;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,247 @@
+// shared memory frame ring - decoder screen buffers live in named shared memory,
+// so any number of local processes can map them and read frames in place
+// producer (fx2head -S) points decoder ring at the slots and only stores frame seq,
+// time and published count after every frame - no copies, no locks, never waits
+// frame k is in slot k % nslots; client takes it while seq - k <= nslots-2 and checks
+// that again after reading pixels (decoder may have come round meanwhile)
+// name is like "/fx2" (shm_open, linux) or "Local\fx2" (windows file mapping)
+
+#ifndef FX2SHM_H
+#define FX2SHM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "fx2dec.h"
+#include "fx2stat.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#endif
+
+#define SHM_MAGIC       0x4D485346  // 'FSHM'
+#define SHM_VERSION     1
+#define SHM_HDR_SIZE    0x1000      // header page, slots follow
+#define SHM_SLOT_SIZE   (SCR_MAXBUF*sizeof(uint32_t))
+
+#define SHM_RUNNING     1
+#define SHM_STOPPED     2           // producer is gone, frames left stay readable
+
+struct shm_hdr {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  mode;                 // MODE_BK, MODE_UKNC
+    uint32_t  width;                // picture is width x height of 32-bit pixels (0x00RRGGBB)
+    uint32_t  height;
+    uint32_t  nslots;
+    uint32_t  slot_size;            // bytes, slot i at SHM_HDR_SIZE + i*slot_size
+    uint32_t  palette;              // 0 - BK black & white, client converts (dec_to_bw)
+    uint32_t  pid;                  // producer process
+    std::atomic<uint32_t> state;    // SHM_RUNNING, SHM_STOPPED
+    std::atomic<uint32_t> seq;      // frames published
+    uint32_t  reserved;
+    uint32_t  slot_seq[DEC_MAXBUF]; // frame in slot
+    uint64_t  slot_t_ns[DEC_MAXBUF];// its publish time, time_ns()
+};
+
+struct shm_ring {
+    shm_hdr*  hdr;
+    uint8_t*  base;
+    size_t    size;
+    int       owner;                // producer (removes name when closed)
+    char      name[64];
+#ifdef _WIN32
+    HANDLE    hmap;
+#endif
+};
+
+
+#ifndef _WIN32
+// (helper) name exists - 1 if it is a ring left by producer which is gone (crashed
+// or stopped), so it can be removed; anything else (live producer, not a ring) stays
+static int shm_stale (const char* name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return 0;
+    struct stat st;
+    void* p = (fstat(fd, &st) != 0 || st.st_size < SHM_HDR_SIZE) ? MAP_FAILED :
+        mmap(NULL, SHM_HDR_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return 0;
+    const shm_hdr* h = (const shm_hdr*) p;
+    int stale = 0;
+    if (h->magic == SHM_MAGIC)
+        stale = (h->state.load() == SHM_STOPPED || (kill((pid_t)h->pid, 0) != 0 && errno == ESRCH));
+    munmap(p, SHM_HDR_SIZE);
+    return stale;
+}
+#endif
+
+// (helper) map name of size, create it for producer, returns 0 if ok, 3 if producer
+// would take over name which is in use
+static int shm_map (shm_ring* r, const char* name, size_t size, int create)
+{
+    memset(r, 0, sizeof(shm_ring));
+    strncpy(r->name, name, sizeof(r->name)-1);
+    r->owner = create;
+#ifdef _WIN32
+    if (create) r->hmap = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        (DWORD)((uint64_t)size >> 32), (DWORD)size, name);
+    else r->hmap = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (r->hmap == NULL) return 1;
+    if (create && GetLastError() == ERROR_ALREADY_EXISTS) { CloseHandle(r->hmap); return 3; }
+    r->base = (uint8_t*) MapViewOfFile(r->hmap, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (r->base == NULL) { CloseHandle(r->hmap); return 2; }
+    if (!create) {
+        MEMORY_BASIC_INFORMATION mi;
+        VirtualQuery(r->base, &mi, sizeof(mi));
+        size = mi.RegionSize;
+    }
+#else
+    // never truncate a ring clients may read, only one left by producer which is gone
+    int fd = create ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644) : shm_open(name, O_RDONLY, 0);
+    if (fd < 0 && create && errno == EEXIST) {
+        if (!shm_stale(name)) return 3;
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) return 1;
+    if (create && ftruncate(fd, (off_t)size) != 0) { close(fd); shm_unlink(name); return 2; }
+    if (!create) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(fd); return 2; }
+        size = (size_t)st.st_size;
+    }
+    void* p = (size < SHM_HDR_SIZE) ? MAP_FAILED : mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) { if (create) shm_unlink(name); return 2; }
+    r->base = (uint8_t*) p;
+#endif
+    r->size = size;
+    r->hdr = (shm_hdr*) r->base;
+    return 0;
+}
+
+// (helper) unmap, producer also removes name
+static void shm_unmap (shm_ring* r)
+{
+    if (r->base == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(r->base);
+    CloseHandle(r->hmap);
+#else
+    munmap(r->base, r->size);
+    if (r->owner) shm_unlink(r->name);
+#endif
+    r->base = NULL;
+    r->hdr = NULL;
+}
+
+// (producer) create ring for decoder and move decoder ring into it - must be done
+// before decoding starts, returns 0 if ok, 2 if name is taken by another producer
+static int shm_create (shm_ring* r, const char* name, dec_state* d)
+{
+    int res = shm_map(r, name, SHM_HDR_SIZE + (size_t)d->nbuf * SHM_SLOT_SIZE, 1);
+    if (res == 3) return 2;
+    if (res != 0) return 1;
+    shm_hdr* h = r->hdr;
+    h->version = SHM_VERSION;
+    h->mode = d->mode;
+    h->width = d->width;
+    h->height = d->height;
+    h->nslots = d->nbuf;
+    h->slot_size = SHM_SLOT_SIZE;
+    h->palette = d->palette;
+#ifdef _WIN32
+    h->pid = GetCurrentProcessId();
+#else
+    h->pid = (uint32_t) getpid();
+#endif
+    h->seq.store(d->seq);
+    for (uint32_t i=0; i<d->nbuf; i++) {
+        uint32_t* slot = (uint32_t*)(r->base + SHM_HDR_SIZE + (size_t)i * SHM_SLOT_SIZE);
+        memcpy(slot, d->bufs[i], SHM_SLOT_SIZE);
+        free(d->bufs[i]);
+        d->bufs[i] = slot;
+    }
+    h->state.store(SHM_RUNNING);
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = SHM_MAGIC;
+    return 0;
+}
+
+// (producer, from decoder on_frame) buffer n holds frame d->seq
+static void shm_publish (shm_ring* r, const dec_state* d, uint32_t n)
+{
+    shm_hdr* h = r->hdr;
+    h->slot_seq[n] = d->seq;
+    h->slot_t_ns[n] = time_ns();
+    h->seq.store(d->seq + 1, std::memory_order_release);
+}
+
+// (producer) mark ring stopped and remove it, decoder ring goes back to heap
+// (decoder must not run anymore)
+static void shm_close (shm_ring* r, dec_state* d)
+{
+    if (r->hdr == NULL) return;
+    r->hdr->state.store(SHM_STOPPED);
+    for (uint32_t i=0; i<d->nbuf; i++) {
+        uint32_t* buf = (uint32_t*) malloc(SHM_SLOT_SIZE);
+        if (buf) memcpy(buf, d->bufs[i], SHM_SLOT_SIZE);
+        d->bufs[i] = buf;
+    }
+    shm_unmap(r);
+}
+
+// (client) map existing ring read only, returns 0 if ok
+static int shm_attach (shm_ring* r, const char* name)
+{
+    if (shm_map(r, name, 0, 0) != 0) return 1;
+    shm_hdr* h = r->hdr;
+    if (h->magic != SHM_MAGIC || h->version != SHM_VERSION || h->nslots < 4 || h->nslots > DEC_MAXBUF ||
+        SHM_HDR_SIZE + (size_t)h->nslots * h->slot_size > r->size) {
+        shm_unmap(r);
+        return 2;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return 0;
+}
+
+static void shm_detach (shm_ring* r)
+{
+    shm_unmap(r);
+}
+
+// (client) frames published so far
+static uint32_t shm_seq (const shm_ring* r)
+{
+    return r->hdr->seq.load(std::memory_order_acquire);
+}
+
+// (client) pixels of frame k in place, NULL if it is not complete yet or taken over
+// (read them, then shm_still_valid tells if what was read is frame k)
+static const uint32_t* shm_frame (const shm_ring* r, uint32_t k)
+{
+    const shm_hdr* h = r->hdr;
+    uint32_t seq = h->seq.load(std::memory_order_acquire);
+    if ((int32_t)(seq - k) <= 0 || seq - k > h->nslots - 2) return NULL;
+    return (const uint32_t*)(r->base + SHM_HDR_SIZE + (size_t)(k & (h->nslots-1)) * h->slot_size);
+}
+
+// (client) 1 if frame k was not overwritten while it was read
+static int shm_still_valid (const shm_ring* r, uint32_t k)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t seq = r->hdr->seq.load(std::memory_order_relaxed);
+    return seq - k <= r->hdr->nslots - 2;
+}
+
+#endif
@@ -0,0 +1,331 @@
+// signal quality analysis of raw samples - sync pulses, line and frame periods,
+// clock drift and activity of all 8 input pins
+// sync pulses are taken from sync pin alone (bit 4 low, captures polarity), so picture
+// content does not matter; pulse lengths tell hsync from vsync like decoder does
+// SSE2 scans 16 samples per step (pin counters vertically, sync pin as bitmask),
+// plain C elsewhere; live use feeds sampled transfers with sig_gap between them
+// (128 KB transfers are shorter than a frame - live report has lines and pulses only)
+
+#ifndef FX2SIG_H
+#define FX2SIG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <vector>
+#include <algorithm>
+#include "fx2dec.h"
+#include "fx2cap.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIG_SSE2
+#include <emmintrin.h>
+#endif
+
+#define SIG_SYNC_BIT    0x10        // sync pin, low is pulse
+#define SIG_RUN_MAX     1024        // sync pulse lengths histogram (longer ones - last)
+#define SIG_LINE_MAX    4096        // line periods histogram
+#define SIG_LINE_TOL    2           // line period off nominal more than that is anomalous
+#define SIG_MAX_FRAMES  0x100000    // frame periods kept
+#define SIG_LIVE_EVERY  4           // live analysis takes every Nth transfer (power of 2)
+
+struct sig_state {
+    int       mode;
+    uint64_t  samples;
+    uint64_t  ones[8];              // samples with pin high
+    uint64_t  toggles[8];           // pin changes
+    uint8_t   prev;                 // last sample (toggles across chunks)
+    int       have_prev;
+    uint32_t  run;                  // sync pulse length so far
+    int       run_valid;            // pulse start was seen (not cut by gap)
+    uint64_t  last_h;               // end of last hsync, 0 - none since other pulse / gap
+    uint64_t  last_v;               // end of last vsync, 0 - none
+    uint32_t  run_hist[SIG_RUN_MAX];
+    uint32_t  line_hist[SIG_LINE_MAX];
+    uint64_t  lines;                // line periods measured
+    uint64_t  lines_bad;            // off nominal
+    uint64_t  line_sum;
+    uint32_t  line_max_dev;
+    uint64_t  pulses;
+    uint64_t  gaps;                 // discontinuities (live sampling)
+    std::vector<uint32_t> frames;   // vsync to vsync periods
+};
+
+// nominal pulse lengths and periods of machine
+static inline uint32_t sig_hsync_len (int mode) { return (mode == MODE_BK) ? 0x38 : 0x40; }
+static inline uint32_t sig_line_len (int mode)  { return (mode == MODE_BK) ? B_SCR_WIDTH : U_SCR_WIDTH; }
+static inline uint32_t sig_frame_len (int mode) { return (mode == MODE_BK) ? B_SCR_FULL : U_SCR_FULL; }
+
+
+static void sig_init (sig_state* s, int mode)
+{
+    s->mode = mode;
+    s->samples = 0;
+    memset(s->ones, 0, sizeof(s->ones));
+    memset(s->toggles, 0, sizeof(s->toggles));
+    s->prev = 0;
+    s->have_prev = 0;
+    s->run = 0;
+    s->run_valid = 0;
+    s->last_h = s->last_v = 0;
+    memset(s->run_hist, 0, sizeof(s->run_hist));
+    memset(s->line_hist, 0, sizeof(s->line_hist));
+    s->lines = s->lines_bad = s->line_sum = 0;
+    s->line_max_dev = 0;
+    s->pulses = 0;
+    s->gaps = 0;
+    s->frames.clear();
+}
+
+// data is not continuous from here (next transfer of live sample)
+static void sig_gap (sig_state* s)
+{
+    s->have_prev = 0;
+    s->run = 0;
+    s->run_valid = 0;
+    s->last_h = s->last_v = 0;
+    s->gaps++;
+}
+
+// (helper) sync pulse of len samples ended at pos
+static void sig_pulse (sig_state* s, uint32_t len, uint64_t pos)
+{
+    s->pulses++;
+    s->run_hist[len < SIG_RUN_MAX ? len : SIG_RUN_MAX-1]++;
+    if (len == sig_hsync_len(s->mode)) {
+        if (s->last_h) {
+            uint64_t p = pos - s->last_h;
+            uint32_t nom = sig_line_len(s->mode);
+            uint32_t dev = (uint32_t)(p > nom ? p - nom : nom - p);
+            s->line_hist[p < SIG_LINE_MAX ? p : SIG_LINE_MAX-1]++;
+            s->lines++;
+            s->line_sum += p;
+            if (dev > SIG_LINE_TOL) s->lines_bad++;
+            if (dev > s->line_max_dev) s->line_max_dev = dev;
+        }
+        s->last_h = pos;
+        return;
+    }
+    // anything else breaks line chain (vsync, equalizing pulses, noise)
+    s->last_h = 0;
+    if (len == dec_vsync_len(s->mode)) {
+        if (s->last_v && s->frames.size() < SIG_MAX_FRAMES) {
+            uint64_t p = pos - s->last_v;
+            s->frames.push_back(p > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)p);
+        }
+        s->last_v = pos;
+    }
+}
+
+// (helper) scalar scan of samples (already in captures polarity)
+static void sig_scan_plain (sig_state* s, const uint8_t* p, uint32_t len, uint64_t base)
+{
+    uint8_t prev = s->prev;
+    uint32_t run = s->run;
+    for (uint32_t i=0; i<len; i++) {
+        uint8_t b = p[i];
+        if (s->have_prev) {
+            uint8_t t = b ^ prev;
+            for (int k=0; k<8; k++) s->toggles[k] += (t >> k) & 1;
+        }
+        for (int k=0; k<8; k++) s->ones[k] += (b >> k) & 1;
+        prev = b;
+        s->have_prev = 1;
+        if ((b & SIG_SYNC_BIT) == 0) {
+            run++;
+        } else if (run) {
+            if (s->run_valid) sig_pulse(s, run, base + i);
+            run = 0;
+            s->run_valid = 1;
+        } else {
+            s->run_valid = 1;
+        }
+    }
+    s->prev = prev;
+    s->run = run;
+}
+
+#ifdef SIG_SSE2
+// (helper) byte counters to totals
+static void sig_flush (__m128i* c, uint64_t* out)
+{
+    __m128i z = _mm_setzero_si128();
+    for (int k=0; k<8; k++) {
+        __m128i sad = _mm_sad_epu8(c[k], z);
+        out[k] += (uint64_t)_mm_cvtsi128_si32(sad) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+        c[k] = z;
+    }
+}
+#endif
+
+// analyze samples (xor'ed with inv first: 0xFF for live usb data, 0 for captures)
+static void sig_feed (sig_state* s, const uint8_t* p, uint32_t len, uint8_t inv)
+{
+    uint64_t base = s->samples;
+    uint32_t i = 0;
+#ifdef SIG_SSE2
+    if (len >= 32 && s->have_prev) {
+        __m128i vinv = _mm_set1_epi8((char)inv);
+        __m128i vsync = _mm_set1_epi8((char)SIG_SYNC_BIT);
+        __m128i bits[8], c_one[8], c_tog[8];
+        for (int k=0; k<8; k++) {
+            bits[k] = _mm_set1_epi8((char)(1 << k));
+            c_one[k] = c_tog[k] = _mm_setzero_si128();
+        }
+        __m128i prev = _mm_set1_epi8((char)s->prev);
+        uint32_t run = s->run;
+        int blocks = 0;
+        for (; i+16<=len; i+=16) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + i)), vinv);
+            // every sample against one before it
+            __m128i t = _mm_xor_si128(v, _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(prev, 15)));
+            prev = v;
+            for (int k=0; k<8; k++) {
+                c_one[k] = _mm_sub_epi8(c_one[k], _mm_cmpeq_epi8(_mm_and_si128(v, bits[k]), bits[k]));
+                c_tog[k] = _mm_sub_epi8(c_tog[k], _mm_cmpeq_epi8(_mm_and_si128(t, bits[k]), bits[k]));
+            }
+            if (++blocks == 255) {
+                sig_flush(c_one, s->ones);
+                sig_flush(c_tog, s->toggles);
+                blocks = 0;
+            }
+            // sync pin low as bitmask, whole block in or out of pulse is one step
+            uint32_t m = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, vsync), _mm_setzero_si128()));
+            if (m == 0xFFFF) { run += 16; continue; }
+            if (m == 0 && run == 0) { s->run_valid = 1; continue; }
+            for (int j=0; j<16; j++) {
+                if (m & (1u << j)) {
+                    run++;
+                } else {
+                    if (run && s->run_valid) sig_pulse(s, run, base + i + j);
+                    run = 0;
+                    s->run_valid = 1;
+                }
+            }
+        }
+        sig_flush(c_one, s->ones);
+        sig_flush(c_tog, s->toggles);
+        s->run = run;
+        s->prev = (uint8_t)(_mm_cvtsi128_si32(_mm_srli_si128(prev, 12)) >> 24);
+    }
+#endif
+    // rest (and first sample after gap) one by one
+    if (i < len) {
+        uint8_t tmp[64];
+        while (i < len) {
+            uint32_t n = (len - i < 64) ? len - i : 64;
+            for (uint32_t k=0; k<n; k++) tmp[k] = p[i+k] ^ inv;
+            sig_scan_plain(s, tmp, n, base + i);
+            i += n;
+#ifdef SIG_SSE2
+            // back to vectors once there is previous sample
+            if (len - i >= 32) {
+                s->samples = base + i;
+                sig_feed(s, p + i, len - i, inv);
+                return;
+            }
+#endif
+        }
+    }
+    s->samples = base + len;
+}
+
+// (helper) append to report of len chars, returns new length - clamped, so it
+// always stays within size when text does not fit
+static int sig_cat (char* o, int size, int len, const char* fmt, ...)
+{
+    if (len >= size) return len;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(o+len, size-len, fmt, ap);
+    va_end(ap);
+    if (n < 0) return len;
+    return (n >= size - len) ? size - 1 : len + n;
+}
+
+// (helper) "len:count" list of biggest histogram entries
+static int sig_top (char* o, int size, const uint32_t* h, int n, int top)
+{
+    int len = 0;
+    uint32_t last_max = 0xFFFFFFFF;
+    int last_idx = -1;
+    for (int t=0; t<top && len<size-1; t++) {
+        int best = -1;
+        for (int i=0; i<n; i++) {
+            if (h[i] == 0) continue;
+            if (h[i] > last_max || (h[i] == last_max && i <= last_idx)) continue;
+            if (best < 0 || h[i] > h[best]) best = i;
+        }
+        if (best < 0) break;
+        len = sig_cat(o, size, len, " %s%i:%u", best == n-1 ? ">=" : "", best, h[best]);
+        last_max = h[best];
+        last_idx = best;
+    }
+    return len;
+}
+
+// text report
+static void sig_report (const sig_state* s, char* o, int size)
+{
+    const double hz = SAMPLE_HZ;
+    int len = sig_cat(o, size, 0, "%llu samples (%.3f s at %g MHz)%s\n", (unsigned long long)s->samples, s->samples / hz, hz / 1e6,
+        s->gaps ? ", sampled" : "");
+    // frames
+    uint32_t fnom = sig_frame_len(s->mode);
+    size_t nf = s->frames.size();
+    uint32_t good = 0, bad = 0;
+    double sum = 0, sum2 = 0;
+    uint32_t fmin = 0xFFFFFFFF, fmax = 0;
+    for (size_t i=0; i<nf; i++) {
+        uint32_t f = s->frames[i];
+        if (f < fmin) fmin = f;
+        if (f > fmax) fmax = f;
+        if (f + sig_line_len(s->mode)/2 < fnom || f > fnom + sig_line_len(s->mode)/2) { bad++; continue; }
+        good++; sum += f; sum2 += (double)f*f;
+    }
+    double mean = good ? sum / good : 0, sd = good ? sqrt(std::max(0.0, sum2/good - mean*mean)) : 0;
+    len = sig_cat(o, size, len, "frames: %u periods, nominal %u, %u anomalous",
+        (uint32_t)nf, fnom, bad);
+    if (nf) len = sig_cat(o, size, len, ", min %u, max %u", fmin, fmax);
+    if (good) len = sig_cat(o, size, len, ", mean %.1f (%.3f Hz), sd %.2f", mean, hz / mean, sd);
+    len = sig_cat(o, size, len, "\n");
+    // clock: normal frames against nominal, first quarter against last one
+    if (good) {
+        double q1 = 0, q4 = 0;
+        uint32_t n1 = 0, n4 = 0, k = 0;
+        for (size_t i=0; i<nf; i++) {
+            uint32_t f = s->frames[i];
+            if (f + sig_line_len(s->mode)/2 < fnom || f > fnom + sig_line_len(s->mode)/2) continue;
+            if (k < good/4) { q1 += f; n1++; }
+            if (k >= good - good/4) { q4 += f; n4++; }
+            k++;
+        }
+        len = sig_cat(o, size, len, "clock: frame period %+.1f ppm off nominal", (mean - fnom) * 1e6 / fnom);
+        if (n1 && n4 && good >= 8)
+            len = sig_cat(o, size, len, ", drift %+.2f ppm (first to last quarter)", (q4/n4 - q1/n1) * 1e6 / fnom);
+        len = sig_cat(o, size, len, "\n");
+    }
+    // lines
+    uint32_t lnom = sig_line_len(s->mode);
+    len = sig_cat(o, size, len, "lines: %llu periods, nominal %u, %llu anomalous (off more than %i), max deviation %u",
+        (unsigned long long)s->lines, lnom, (unsigned long long)s->lines_bad, SIG_LINE_TOL, s->line_max_dev);
+    if (s->lines) len = sig_cat(o, size, len, ", mean %.3f (%+.1f ppm)", (double)s->line_sum / s->lines,
+        ((double)s->line_sum / s->lines - lnom) * 1e6 / lnom);
+    len = sig_cat(o, size, len, "\n  period:count");
+    len += sig_top(o+len, size-len, s->line_hist, SIG_LINE_MAX, 8);
+    // sync pulses
+    len = sig_cat(o, size, len, "\nsync pulses: %llu, hsync %u, vsync %u\n  length:count",
+        (unsigned long long)s->pulses, sig_hsync_len(s->mode), dec_vsync_len(s->mode));
+    len += sig_top(o+len, size-len, s->run_hist, SIG_RUN_MAX, 8);
+    // pins
+    len = sig_cat(o, size, len, "\npin  high%%   toggles   MHz\n");
+    for (int k=0; k<8 && len<size-1; k++) {
+        double t = s->samples ? s->toggles[k] * hz / s->samples / 1e6 : 0;
+        len = sig_cat(o, size, len, " %i  %6.2f %9llu %6.3f%s\n", k, s->samples ? s->ones[k]*100.0/s->samples : 0.0,
+            (unsigned long long)s->toggles[k], t, s->toggles[k] == 0 ? (s->ones[k] ? "  stuck high" : "  stuck low") : "");
+    }
+}
+
+#endif
@@ -0,0 +1,125 @@
+// timing and latency statistics
+// (header only, included from fx2bk.cpp)
+
+#ifndef FX2STAT_H
+#define FX2STAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// pipeline stages we are measuring latency of
+#define LAT_DECODE      0           // decode start -> decode end (one bulk transfer)
+#define LAT_PUBLISH     1           // usb transfer completion -> frame published
+#define LAT_PRESENT     2           // frame published -> frame painted
+#define LAT_EXPORT      3           // frame published -> frame written to file
+#define LAT_TOTAL       4           // usb transfer completion -> frame painted
+#define LAT_FRAME       5           // time between new frames painted (frame time)
+#define LAT_COUNT       6
+
+#define LAT_SAMPLES     1024        // ring size per stage (power of 2)
+
+    const char* lat_names[LAT_COUNT] = { "decode", "publish", "present", "export", "total", "frame" };
+
+    uint64_t lat_samples[LAT_COUNT][LAT_SAMPLES];
+    volatile uint32_t lat_idx[LAT_COUNT];
+
+
+// monotonic time in nanoseconds
+static uint64_t time_ns ()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq = {0};
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    LARGE_INTEGER c; QueryPerformanceCounter(&c);
+    // split to avoid overflow of c*1e9
+    return (uint64_t)(c.QuadPart / freq.QuadPart) * 1000000000ull
+         + (uint64_t)(c.QuadPart % freq.QuadPart) * 1000000000ull / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// cpu time used by calling thread (or whole process), nanoseconds
+static uint64_t cpu_ns (int whole_process)
+{
+#ifdef _WIN32
+    FILETIME t_create, t_exit, t_kernel, t_user;
+    if (whole_process) GetProcessTimes(GetCurrentProcess(), &t_create, &t_exit, &t_kernel, &t_user);
+    else GetThreadTimes(GetCurrentThread(), &t_create, &t_exit, &t_kernel, &t_user);
+    uint64_t k = ((uint64_t)t_kernel.dwHighDateTime << 32) | t_kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t)t_user.dwHighDateTime << 32) | t_user.dwLowDateTime;
+    return (k + u) * 100;
+#else
+    struct timespec ts;
+    clock_gettime(whole_process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// add stage latency sample (each stage is written from one thread only)
+static void lat_add (int stage, uint64_t ns)
+{
+    uint32_t i = lat_idx[stage];
+    lat_samples[stage][i & (LAT_SAMPLES-1)] = ns;
+    lat_idx[stage] = i + 1;
+}
+
+// p50/p99/max of last samples, returns samples count used
+static int lat_percentiles (int stage, uint64_t* p50, uint64_t* p99, uint64_t* pmax)
+{
+    static uint64_t tmp[LAT_SAMPLES];
+    uint32_t n = lat_idx[stage];
+    if (n > LAT_SAMPLES) n = LAT_SAMPLES;
+    *p50 = *p99 = *pmax = 0;
+    if (n == 0) return 0;
+    memcpy(tmp, lat_samples[stage], n*sizeof(uint64_t));
+    std::sort(tmp, tmp+n);
+    *p50  = tmp[(n-1)*50/100];
+    *p99  = tmp[(n-1)*99/100];
+    *pmax = tmp[n-1];
+    return n;
+}
+
+// mean and standard deviation of last samples (ns)
+static void lat_stddev (int stage, double* mean, double* sd)
+{
+    uint32_t n = lat_idx[stage];
+    if (n > LAT_SAMPLES) n = LAT_SAMPLES;
+    *mean = *sd = 0;
+    if (n == 0) return;
+    double s1 = 0, s2 = 0;
+    for (uint32_t i=0; i<n; i++) {
+        double v = (double)lat_samples[stage][i];
+        s1 += v;
+        s2 += v*v;
+    }
+    *mean = s1 / n;
+    double var = s2 / n - (*mean)*(*mean);
+    *sd = (var > 0) ? sqrt(var) : 0;
+}
+
+// text report of all stages (microseconds)
+static void lat_report (char* s, int size)
+{
+    int len = snprintf(s, size, "%-8s %6s %10s %10s %10s %10s\n", "stage", "n", "p50,us", "p99,us", "max,us", "sd,us");
+    for (int i=0; i<LAT_COUNT && len<size; i++) {
+        uint64_t p50, p99, pmax;
+        double mean, sd;
+        int n = lat_percentiles(i, &p50, &p99, &pmax);
+        lat_stddev(i, &mean, &sd);
+        len += snprintf(s+len, size-len, "%-8s %6i %10.1f %10.1f %10.1f %10.1f\n", lat_names[i], n, p50/1000.0, p99/1000.0, pmax/1000.0, sd/1000.0);
+    }
+}
+
+#endif
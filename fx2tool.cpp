@@ -0,0 +1,1600 @@
+// compile:
+//   windows: cl /O2 /EHsc fx2tool.cpp
+//   linux:   g++ -O2 -pthread fx2tool.cpp -o fx2tool
+//
+// command line tool for capture files (raw samples like test/*.bin or rle)
+//   fx2tool pack   <in> <out.rle> [-m bk|uknc]   - compress capture to rle
+//   fx2tool unpack <in.rle> <out.bin>            - expand rle capture to raw samples
+//   fx2tool decode <in> [-m bk|uknc] [-N 3|5]    - decode capture, print frames hash and speed
+//   fx2tool index  <in> <out.fx2c> [-m bk|uknc]  - convert capture to seekable container
+//   fx2tool verify <in.fx2c>                     - check container integrity without decoding
+//   fx2tool frames <in.fx2c> [first [count]] [-j threads] - decode indexed frames range in parallel
+//   fx2tool replay <in> [-m bk|uknc]             - decode memory mapped capture, print speed
+//   fx2tool synth  <in> <out.bin> <MB>           - make long synthetic capture repeating one field of in
+//   fx2tool video  <in> <out|-|"|cmd"> [first [count]] [-f y4m|raw|gif|apng] - decode capture to video file,
+//                                                  stdout or pipe, or to palette-indexed animation
+//   -N 3|5 (decode, video, events) - temporal noise filter, majority of pixel over last 3 or 5 frames (fx2flt.h)
+//   fx2tool export <in> <out%05u.png|qoi|bmp> [first [count]] [-n every] [-j threads] - frames to images
+//   fx2tool scale  <in>                          - benchmark presentation kernel (integer scaling, scanlines)
+//   fx2tool pace   <in> [hz [depth [jitter_ms]]] - simulate display pacing of capture, immediate vs buffered
+//   fx2tool analyze <in> [-m bk|uknc]            - signal quality: sync pulses, line/frame periods, clock, pins
+//   fx2tool check  [golden.txt]                  - decode captures of golden file with every decoder variant
+//                                                  (fx2c one seeks every frame through index), fail on any
+//                                                  picture different from golden (test/golden.txt);
+//                                                  also every decoder color through y4m conversion and back
+//   fx2tool golden <out.txt> <in>...             - write golden picture hashes of captures
+//   fx2tool watch  <name> [frames]               - read frames of shared memory ring (fx2head -S name) in place,
+//                                                  print their hashes and how late they were taken
+//   fx2tool netwatch <port> [frames]             - plain tcp client of stream server (fx2head -W port), rebuilds
+//                                                  frames from keyframe and changed lines, prints their hashes
+//   fx2tool center <in> [fields [x y]]          - centering calibration over capture from picture shift x y
+//                                                  if given (other setup), prints shift to put in config
+//   fx2tool text   <in> <font.txt> [-u]          - read screen text of frames with font (fx2txt.h), print it when
+//                                                  it changes, -u - unknown cells as glyph lines for font file
+//   fx2tool events <in> [lines [pre [post]]]     - change trigger over capture (fx2trig.h): frame ranges which
+//                                                  would be recorded, with pre/post roll frames (-N as decode)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include "fx2dec.h"
+#include "fx2cap.h"
+#include "fx2stat.h"
+#include "fx2vid.h"
+#include "fx2img.h"
+#include "fx2pool.h"
+#include "fx2scale.h"
+#include "fx2pace.h"
+#include "fx2sig.h"
+#include "fx2shm.h"
+#include "fx2net.h"
+#include "fx2txt.h"
+#include "fx2flt.h"
+#include "fx2trig.h"
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Options
+////////////////////////////////////////////////////////////////////////////////
+
+    int   opt_mode = -1;            // -m, <0 - from file or guess
+    int   opt_threads = 0;          // -j, 0 - all cores
+    int   opt_video = VID_Y4M;      // -f
+    int   opt_every = 1;            // -n, every Nth frame
+    int   opt_unknown = 0;          // -u, print unknown cells (text)
+    int   opt_noise = 0;            // -N, temporal noise filter depth (decode, video)
+    char* opt_args[8];              // positional arguments
+    int   opt_nargs = 0;
+
+    const char* mode_names[2] = { "BK", "UKNC" };
+    const char* cap_names[3]  = { "raw", "rle", "fx2c" };
+
+
+// parse common options, returns 0 if ok
+int parse_options (int argc, char** argv)
+{
+    for (int i=0; i<argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i+1 < argc) {
+            i++;
+            if (strcmp(argv[i], "bk") == 0) opt_mode = MODE_BK;
+            else if (strcmp(argv[i], "uknc") == 0) opt_mode = MODE_UKNC;
+            else { fprintf(stderr, "unknown mode %s\n", argv[i]); return 1; }
+        } else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+            opt_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i+1 < argc) {
+            opt_every = atoi(argv[++i]);
+            if (opt_every < 1) opt_every = 1;
+        } else if (strcmp(argv[i], "-N") == 0 && i+1 < argc) {
+            opt_noise = atoi(argv[++i]);
+            if (opt_noise != 3 && opt_noise != 5) { fprintf(stderr, "noise filter depth is 3 or 5\n"); return 1; }
+        } else if (strcmp(argv[i], "-u") == 0) {
+            opt_unknown = 1;
+        } else if (strcmp(argv[i], "-f") == 0 && i+1 < argc) {
+            i++;
+            if (strcmp(argv[i], "y4m") == 0) opt_video = VID_Y4M;
+            else if (strcmp(argv[i], "raw") == 0) opt_video = VID_RAW;
+            else if (strcmp(argv[i], "gif") == 0) opt_video = VID_GIF;
+            else if (strcmp(argv[i], "apng") == 0) opt_video = VID_APNG;
+            else { fprintf(stderr, "unknown video format %s\n", argv[i]); return 1; }
+        } else if (argv[i][0] == '-' && argv[i][1] != 0 && (argv[i][1] < '0' || argv[i][1] > '9')) {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        } else if (opt_nargs < 8) {
+            opt_args[opt_nargs++] = argv[i];
+        }
+    }
+    return 0;
+}
+
+// (helper) open capture with error message
+int open_capture (cap_reader* c, const char* fname)
+{
+    int res = cap_open(c, fname, opt_mode);
+    if (res != 0) fprintf(stderr, "unable to open capture %s\n", fname);
+    return res;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Commands
+////////////////////////////////////////////////////////////////////////////////
+
+// compress capture to rle
+int cmd_pack (const char* in_name, const char* out_name)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    FILE* f = fopen(out_name, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "unable to create %s\n", out_name);
+        cap_close(&c);
+        return 1;
+    }
+    uint8_t* raw = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    uint8_t* enc = (uint8_t*) malloc(RLE_MAX_ENC);
+    uint64_t raw_total = 0, out_total = sizeof(rle_file_hdr);
+    uint32_t blocks = 0, stored = 0;
+    uint64_t t_enc = 0;
+    int res = rle_write_header(f, c.mode);
+    int n = 0;
+    while (res == 0 && (n = cap_read(&c, raw)) > 0) {
+        uint64_t t0 = time_ns();
+        uint32_t written = rle_write_block(f, raw, n, enc);
+        t_enc += time_ns() - t0;
+        if (written == 0) { res = 1; break; }
+        if (written == sizeof(rle_block_hdr) + (uint32_t)n) stored++;
+        raw_total += n;
+        out_total += written;
+        blocks++;
+    }
+    if (n < 0) res = 1;
+    fclose(f);
+    cap_close(&c);
+    free(raw);
+    free(enc);
+    if (res != 0) {
+        fprintf(stderr, "error while packing %s\n", in_name);
+        return 1;
+    }
+    printf("%s: %s, %llu -> %llu bytes, ratio %.1f:1, %u blocks (%u stored), encoder %.0f MB/s\n",
+        in_name, mode_names[c.mode], (unsigned long long)raw_total, (unsigned long long)out_total,
+        out_total ? (double)raw_total/out_total : 0.0, blocks, stored,
+        t_enc ? raw_total*1000.0/t_enc : 0.0);
+    return 0;
+}
+
+// expand rle capture to raw samples
+int cmd_unpack (const char* in_name, const char* out_name)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    FILE* f = fopen(out_name, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "unable to create %s\n", out_name);
+        cap_close(&c);
+        return 1;
+    }
+    uint8_t* raw = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    int n;
+    while ((n = cap_read(&c, raw)) > 0) fwrite(raw, 1, n, f);
+    fclose(f);
+    cap_close(&c);
+    free(raw);
+    if (n < 0) {
+        fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+        return 1;
+    }
+    return 0;
+}
+
+    uint64_t  frames_hash;
+    flt_state noise;                // (-N) temporal noise filter
+    uint32_t  noise_seq;            // frame it expects next
+
+// (helper) set up noise filter for decoder frames, returns 0 if ok
+int noise_init (dec_state* d)
+{
+    noise_seq = d->seq;
+    if (flt_init(&noise, opt_noise, d->full) == 0) return 0;
+    fprintf(stderr, "unable to allocate noise filter\n");
+    flt_free(&noise);
+    return 1;
+}
+
+// (helper) filter frame in buffer n, history starts over when frames do not follow
+// (seek, frames skipped)
+void noise_frame (dec_state* d, uint32_t n)
+{
+    if (d->seq != noise_seq) flt_reset(&noise);
+    noise_seq = d->seq + 1;
+    flt_frame(&noise, d->bufs[n]);
+}
+
+// (helper) noise filter summary
+void noise_report (FILE* f)
+{
+    if (noise.depth == 0) return;
+    fprintf(f, "noise filter: %i frames, %llu pixels changed (%.1f per frame), %.3f ms per frame\n",
+        noise.depth, (unsigned long long)noise.changed, noise.frames ? (double)noise.changed / noise.frames : 0.0,
+        noise.frames ? noise.ns/1e6/noise.frames : 0.0);
+}
+
+// (callback) hash every completed frame
+void decode_on_frame (dec_state* d, uint32_t n)
+{
+    noise_frame(d, n);
+    frames_hash = hash64(d->bufs[n], d->full*sizeof(uint32_t), frames_hash);
+}
+
+// decode capture, print frames hash and speed
+int cmd_decode (const char* in_name)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return 1;
+    }
+    if (noise_init(&d) != 0) {
+        cap_close(&c);
+        dec_free(&d);
+        return 1;
+    }
+    d.on_frame = decode_on_frame;
+    frames_hash = 0;
+    uint64_t t0 = time_ns();
+    int n;
+    while ((n = cap_feed(&c, &d)) > 0) {}
+    uint64_t t = time_ns() - t0;
+    if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+    printf("%s: %s %s, %llu samples, %u frames, %.1f ms, %.0f MB/s, frames hash %016llx\n",
+        in_name, cap_names[c.type], mode_names[c.mode],
+        (unsigned long long)c.raw_pos, d.seq, t/1e6, t ? c.raw_pos*1000.0/t : 0.0,
+        (unsigned long long)frames_hash);
+    noise_report(stdout);
+    flt_free(&noise);
+    cap_close(&c);
+    dec_free(&d);
+    return (n < 0) ? 1 : 0;
+}
+
+
+// convert capture to seekable container
+int cmd_index (const char* in_name, const char* out_name)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    cont_writer w;
+    if (cont_create(&w, out_name, c.mode, 0) != 0) {
+        fprintf(stderr, "unable to create %s\n", out_name);
+        cap_close(&c);
+        return 1;
+    }
+    uint8_t* raw = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    int n;
+    while ((n = cap_read(&c, raw)) > 0) cont_write(&w, raw, n, 0);
+    int res = cont_close(&w);
+    uint32_t nframes = (uint32_t) w.frames.size();
+    uint32_t nblocks = (uint32_t) w.blocks.size();
+    cap_close(&c);
+    free(raw);
+    if (n < 0 || res != 0) {
+        fprintf(stderr, "error while indexing %s\n", in_name);
+        return 1;
+    }
+    // leading frame (and fields without vsync) have no index entry
+    printf("%s: %s, %llu samples, %u blocks, %u frames indexed of %u decoded, first is frame %u\n",
+        out_name, mode_names[c.mode], (unsigned long long)c.raw_pos, nblocks, nframes,
+        w.hdr.dec_frames, nframes ? w.frames[0].seq : 0);
+    return 0;
+}
+
+// (helper) open container with error message
+int open_container (cont_reader* c, const char* fname)
+{
+    int res = cont_open(c, fname);
+    if (res != 0) fprintf(stderr, "%s is not fx2c container\n", fname);
+    return res;
+}
+
+// check container integrity without decoding
+int cmd_verify (const char* in_name)
+{
+    cont_reader c;
+    if (open_container(&c, in_name) != 0) return 1;
+    uint32_t bad_blocks, bad_frames;
+    uint64_t t0 = time_ns();
+    int res = cont_verify(&c, &bad_blocks, &bad_frames);
+    uint64_t t = time_ns() - t0;
+    if (res == 1 || res == 2) printf("%s: index is broken\n", in_name);
+    else printf("%s: %u blocks, %u frames, %u bad blocks, %u bad frames, %.0f MB/s - %s\n",
+        in_name, c.ft.nblocks, c.ft.nframes, bad_blocks, bad_frames,
+        t ? c.ft.raw_total*1000.0/t : 0.0, res ? "FAILED" : "ok");
+    cont_close_reader(&c);
+    return res ? 1 : 0;
+}
+
+    struct frame_result {
+        cont_frame fr;
+        uint64_t   pic_hash;
+        int        res;
+    };
+
+// (thread) decode frames taken from shared counter
+void frames_worker (const char* fname, std::atomic<uint32_t>* next, uint32_t first, uint32_t count, frame_result* out)
+{
+    cont_reader c;
+    dec_state d;
+    if (cont_open(&c, fname) != 0) return;
+    dec_init(&d, c.hdr.mode);
+    uint8_t* tmp = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    uint32_t i;
+    while ((i = (*next)++) < count) {
+        frame_result* r = &out[i];
+        cont_get_frame(&c, first + i, &r->fr);
+        r->res = cont_decode_frame(&c, &d, first + i, tmp);
+        r->pic_hash = (r->res >= 0) ? hash64(d.bufs[r->res], d.full*sizeof(uint32_t)) : 0;
+    }
+    free(tmp);
+    dec_free(&d);
+    cont_close_reader(&c);
+}
+
+// decode frames range in parallel (every thread seeks on its own)
+int cmd_frames (const char* in_name, const char* s_first, const char* s_count)
+{
+    cont_reader c;
+    if (open_container(&c, in_name) != 0) return 1;
+    uint32_t nframes = c.ft.nframes;
+    cont_close_reader(&c);
+    uint32_t first = s_first ? (uint32_t)atoi(s_first) : 0;
+    if (first >= nframes) {
+        fprintf(stderr, "no frame %u (%u frames in file)\n", first, nframes);
+        return 1;
+    }
+    uint32_t count = s_count ? (uint32_t)atoi(s_count) : nframes - first;
+    if (count > nframes - first) count = nframes - first;
+    int nthreads = opt_threads > 0 ? opt_threads : (int)std::thread::hardware_concurrency();
+    if (nthreads > (int)count) nthreads = (int)count;
+    if (nthreads < 1) nthreads = 1;
+    std::vector<frame_result> results(count);
+    std::atomic<uint32_t> next(0);
+    std::vector<std::thread> threads;
+    uint64_t t0 = time_ns();
+    for (int i=0; i<nthreads; i++) threads.push_back(std::thread(frames_worker, in_name, &next, first, count, results.data()));
+    for (size_t i=0; i<threads.size(); i++) threads[i].join();
+    uint64_t t = time_ns() - t0;
+    int errors = 0;
+    for (uint32_t i=0; i<count; i++) {
+        frame_result* r = &results[i];
+        if (r->res == -3) {
+            printf("frame %u: incomplete, capture ends\n", first + i);
+            continue;
+        }
+        if (r->res < 0) {
+            printf("frame %u: unable to decode (%i)\n", first + i, r->res);
+            errors++;
+            continue;
+        }
+        printf("frame %u: sample %llu, %.3f s, raw %016llx, picture %016llx\n",
+            r->fr.seq, (unsigned long long)r->fr.raw_off, r->fr.t_ns/1e9,
+            (unsigned long long)r->fr.hash, (unsigned long long)r->pic_hash);
+    }
+    printf("%u frames, %i threads, %.1f ms, %.0f frames/s\n", count, nthreads, t/1e6, t ? count*1e9/t : 0.0);
+    return errors ? 1 : 0;
+}
+
+
+// decode memory mapped capture, print speed
+int cmd_replay (const char* in_name)
+{
+    cap_map m;
+    if (map_open(&m, in_name) != 0) {
+        fprintf(stderr, "unable to open %s\n", in_name);
+        return 1;
+    }
+    // mode from header or guessed from first samples
+    size_t len;
+    const uint8_t* p = map_at(&m, 0, &len);
+    int mode = opt_mode;
+    if (mode < 0 && p != NULL) {
+        uint32_t magic = (len >= 4) ? *(const uint32_t*)p : 0;
+        if (magic == RLE_MAGIC && len >= sizeof(rle_file_hdr)) mode = ((const rle_file_hdr*)p)->mode;
+        else if (magic == CONT_MAGIC && len >= sizeof(cont_file_hdr)) mode = ((const cont_file_hdr*)p)->mode;
+        else mode = cap_guess_mode(p, len > RLE_BLOCK_RAW ? RLE_BLOCK_RAW : (uint32_t)len);
+    }
+    if (mode < 0) mode = MODE_BK;
+    dec_state d;
+    if (dec_init(&d, mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        map_close(&m);
+        return 1;
+    }
+    int error;
+    uint64_t t0 = time_ns();
+    uint64_t samples = map_replay(&m, &d, &error);
+    uint64_t t = time_ns() - t0;
+    printf("%s: %s, %llu bytes mapped, %llu samples, %u frames, %.3f s, %.2f GB/s (%.2f ns/sample)%s\n",
+        in_name, mode_names[mode], (unsigned long long)m.size, (unsigned long long)samples, d.seq,
+        t/1e9, t ? samples/(double)t : 0.0, samples ? (double)t/samples : 0.0,
+        error ? ", broken block" : "");
+    map_close(&m);
+    dec_free(&d);
+    return error;
+}
+
+// make long synthetic capture repeating one field of in
+int cmd_synth (const char* in_name, const char* out_name, const char* s_mb)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    // whole input is needed to find a field
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> chunk(RLE_BLOCK_RAW);
+    int n;
+    while ((n = cap_read(&c, chunk.data())) > 0) raw.insert(raw.end(), chunk.begin(), chunk.begin() + n);
+    cap_close(&c);
+    vs_scan vs;
+    memset(&vs, 0, sizeof(vs));
+    vs.mode = c.mode;
+    uint64_t pulses[2];
+    if (vs_scan_feed(&vs, raw.data(), (uint32_t)raw.size(), pulses, 2) < 2) {
+        fprintf(stderr, "less than two vsync pulses in %s\n", in_name);
+        return 1;
+    }
+    FILE* f = fopen(out_name, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "unable to create %s\n", out_name);
+        return 1;
+    }
+    uint64_t size = (uint64_t)atoi(s_mb) << 20;
+    uint64_t field = pulses[1] - pulses[0];
+    // field starts right after vsync pulse - so start with the pulse itself
+    uint32_t vlen = dec_vsync_len(c.mode);
+    const uint8_t* src = raw.data() + pulses[0] - vlen;
+    uint64_t written = 0;
+    while (written < size) {
+        uint64_t k = (size - written < field) ? size - written : field;
+        if (fwrite(src, 1, (size_t)k, f) != k) break;
+        written += k;
+    }
+    fclose(f);
+    printf("%s: %llu bytes, field of %llu samples from %s repeated\n",
+        out_name, (unsigned long long)written, (unsigned long long)field, in_name);
+    return written == size ? 0 : 1;
+}
+
+    vid_state video_out;
+    uint32_t  video_first, video_end;
+    const char* video_names[4] = { "y4m", "raw bgr0", "gif", "apng" };
+
+// (callback) write completed frames of range to video
+void video_on_frame (dec_state* d, uint32_t n)
+{
+    noise_frame(d, n);
+    if (d->seq >= video_first && d->seq < video_end) vid_frame(&video_out, d->bufs[n]);
+}
+
+// decode capture (or frames range of it) to y4m, raw video or animation
+// (frames go out at native 50 fps)
+int cmd_video (const char* in_name, const char* out_name, const char* s_first, const char* s_count)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return 1;
+    }
+    if (vid_open(&video_out, out_name, opt_video, d.width, d.height) != 0) {
+        fprintf(stderr, "unable to open video output %s\n", out_name);
+        vid_close(&video_out);
+        cap_close(&c);
+        dec_free(&d);
+        return 1;
+    }
+    if (noise_init(&d) != 0) {
+        vid_close(&video_out);
+        cap_close(&c);
+        dec_free(&d);
+        return 1;
+    }
+    video_first = s_first ? (uint32_t)atoi(s_first) : 0;
+    uint32_t count = s_count ? (uint32_t)atoi(s_count) : 0xFFFFFFFF;
+    video_end = (count > 0xFFFFFFFF - video_first) ? 0xFFFFFFFF : video_first + count;
+    d.on_frame = video_on_frame;
+    uint64_t t0 = time_ns();
+    int n;
+    while ((n = cap_feed(&c, &d)) > 0 && video_out.io_error == 0 && d.seq < video_end) {}
+    vid_close(&video_out);
+    uint64_t t = time_ns() - t0;
+    if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+    if (video_out.io_error) fprintf(stderr, "write error on %s\n", out_name);
+    // stdout may be the video itself
+    fprintf(stderr, "%s: %ix%i %s, %u frames, %.1f ms, %.0f frames/s\n",
+        out_name, d.width, d.height, video_names[opt_video],
+        (uint32_t)video_out.frames_written, t/1e6, t ? video_out.frames_written*1e9/t : 0.0);
+    noise_report(stderr);
+    flt_free(&noise);
+    cap_close(&c);
+    dec_free(&d);
+    return (n < 0 || video_out.io_error) ? 1 : 0;
+}
+
+    // per worker state of export
+    struct export_ctx {
+        cont_reader c;              // (fx2c input) every worker decodes on its own
+        dec_state  d;
+        uint8_t*   tmp;
+        int        opened;
+        std::vector<uint8_t> out;   // encoded image
+    };
+
+    struct export_job {
+        const char* in_name;
+        const char* pattern;
+        int        format;
+        int        width;
+        int        height;
+        std::atomic<uint32_t> written;
+        std::atomic<uint32_t> errors;
+        export_ctx ctx[POOL_MAX_THREADS];
+    };
+
+// (pool task) decode frame if needed and write it as image
+void export_task (pool_state* p, int worker, pool_task* t)
+{
+    export_job* j = (export_job*) p->user;
+    export_ctx* x = &j->ctx[worker];
+    const uint32_t* pix = (const uint32_t*) t->data;
+    if (pix == NULL) {
+        if (!x->opened) {
+            x->opened = (cont_open(&x->c, j->in_name) == 0 && dec_init(&x->d, x->c.hdr.mode) == 0) ? 1 : -1;
+            x->tmp = (uint8_t*) malloc(RLE_BLOCK_RAW);
+        }
+        int res = (x->opened > 0) ? cont_decode_seq(&x->c, &x->d, t->idx, x->tmp) : -1;
+        if (res == -3) return;      // incomplete, capture ends
+        if (res < 0) {
+            fprintf(stderr, "frame %u: unable to decode (%i)\n", t->idx, res);
+            j->errors++;
+            return;
+        }
+        pix = x->d.bufs[res];
+    }
+    char fname[512];
+    cap_name(fname, sizeof(fname), j->pattern, t->idx);
+    if (img_write(fname, j->format, pix, j->width, j->height, 2, x->out) != 0) {
+        fprintf(stderr, "unable to write %s\n", fname);
+        j->errors++;
+    } else {
+        j->written++;
+    }
+    free(t->data);
+}
+
+    pool_state* export_pool;
+    uint32_t    export_first, export_end;
+
+// (callback) sequential decode - copy wanted frames out and hand them to the pool
+void export_on_frame (dec_state* d, uint32_t n)
+{
+    uint32_t k = d->seq;
+    if (k < export_first || k >= export_end || (k - export_first) % opt_every != 0) return;
+    uint32_t* pix = (uint32_t*) malloc(d->full*sizeof(uint32_t));
+    if (pix == NULL) return;
+    memcpy(pix, d->bufs[n], d->full*sizeof(uint32_t));
+    // frames are 1MB each - keep only a few per worker in flight
+    pool_wait_below(export_pool, 4*export_pool->nthreads);
+    pool_push(export_pool, k, pix);
+}
+
+// write every Nth frame of range to images, encoding fans out over thread pool
+// (fx2c input is decoded in parallel too, others are decoded sequentially - frame
+// numbers are the same for every input, as 'decode' counts them)
+int cmd_export (const char* in_name, const char* pattern, const char* s_first, const char* s_count)
+{
+    if (!cap_name_ok(pattern)) {
+        fprintf(stderr, "output name needs one frame number %%u, like frame%%05u.png\n");
+        return 1;
+    }
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    uint32_t first = s_first ? (uint32_t)atoi(s_first) : 0;
+    uint32_t count = s_count ? (uint32_t)atoi(s_count) : 0xFFFFFFFF;
+    uint32_t end = (count > 0xFFFFFFFF - first) ? 0xFFFFFFFF : first + count;
+    export_job* j = new export_job();
+    j->in_name = in_name;
+    j->pattern = pattern;
+    j->format = img_format_by_name(pattern);
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        delete j;
+        return 1;
+    }
+    j->width = d.width;
+    j->height = d.height;
+    pool_state* p = new pool_state();
+    pool_start(p, opt_threads, export_task, j);
+    uint64_t t0 = time_ns();
+    int n = 0;
+    uint32_t frames = 0;
+    if (c.type == CAP_CONT) {
+        cap_close(&c);
+        cont_reader cr;
+        if (open_container(&cr, in_name) == 0) {
+            frames = cont_dec_frames(&cr);
+            cont_close_reader(&cr);
+        }
+        if (end > frames) end = frames;
+        for (uint32_t k=first; k<end; k+=opt_every) pool_push(p, k, NULL);
+    } else {
+        export_pool = p;
+        export_first = first;
+        export_end = end;
+        d.on_frame = export_on_frame;
+        while ((n = cap_feed(&c, &d)) > 0 && d.seq < end) {}
+        if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+        frames = d.seq;
+        cap_close(&c);
+    }
+    pool_finish(p);
+    uint64_t t = time_ns() - t0;
+    uint64_t busy = 0;
+    for (int i=0; i<p->nthreads; i++) {
+        pool_worker* w = &p->w[i];
+        busy += w->busy_ns;
+        printf("  worker %2i: %llu frames (%llu stolen), busy %.1f ms\n", i,
+            (unsigned long long)w->done, (unsigned long long)w->stolen, w->busy_ns/1e6);
+    }
+    uint32_t written = j->written;
+    double fps = t ? written*1e9/t : 0.0;
+    printf("%s: %u of %u frames written, %i threads, %.1f ms, %.1f frames/s, %.1f frames/s per core, %.0f%% busy\n",
+        pattern, written, frames, p->nthreads, t/1e6, fps, fps/p->nthreads,
+        t ? busy*100.0/((double)t*p->nthreads) : 0.0);
+    int errors = j->errors + (n < 0 ? 1 : 0);
+    for (int i=0; i<p->nthreads; i++) {
+        export_ctx* x = &j->ctx[i];
+        if (x->opened > 0) { cont_close_reader(&x->c); dec_free(&x->d); }
+        free(x->tmp);
+    }
+    dec_free(&d);
+    delete p;
+    delete j;
+    return errors ? 1 : 0;
+}
+
+// (helper) decode capture up to last complete frame, returns its buffer or -1
+int decode_last_frame (const char* in_name, dec_state* d)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return -1;
+    if (dec_init(d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return -1;
+    }
+    while (cap_feed(&c, d) > 0) {}
+    cap_close(&c);
+    if (d->seq < 2) {
+        fprintf(stderr, "no complete frame in %s\n", in_name);
+        return -1;
+    }
+    return (d->n_cur - 1) & (d->nbuf-1);
+}
+
+// benchmark integer scaling kernel on last frame of capture
+// (checked against plain reference first, 4K line is the biggest factors fitting 3840x2160)
+int cmd_scale (const char* in_name)
+{
+    dec_state d;
+    int n = decode_last_frame(in_name, &d);
+    if (n < 0) return 1;
+    const uint32_t* pix = d.bufs[n];
+    int fit_x = 3840 / d.width, fit_y = 2160 / d.height;
+    struct { int sx, sy, level; } cfg[] = {
+        { 1, 2, 256 }, { 1, 2, 160 }, { 2, 2, 256 }, { 2, 4, 160 }, { 3, 3, 256 }, { 3, 6, 160 },
+        { fit_x, fit_y, 256 }, { fit_x, fit_y, 160 } };
+    scale_state s;
+    memset(&s, 0, sizeof(s));
+    std::vector<uint32_t> ref;
+    int errors = 0;
+    printf("%s: %s %ix%i frame\n", in_name, mode_names[d.mode], d.width, d.height);
+    printf("  scale  scanlines   output       ms/frame   Mpix/s    GB/s  x50Hz   plain ms\n");
+    for (size_t i=0; i<sizeof(cfg)/sizeof(cfg[0]); i++) {
+        int sx = cfg[i].sx, sy = cfg[i].sy, level = cfg[i].level;
+        if (scale_frame(&s, pix, d.width, d.height, sx, sy, level) != 0) {
+            fprintf(stderr, "unable to allocate output\n");
+            errors++;
+            break;
+        }
+        size_t npix = (size_t)s.out_w * s.out_h;
+        ref.resize(npix);
+        uint64_t t0 = time_ns();
+        scale_frame_ref(ref.data(), pix, d.width, d.height, sx, sy, level);
+        uint64_t t_ref = time_ns() - t0;
+        int ok = (memcmp(ref.data(), s.out, npix*sizeof(uint32_t)) == 0);
+        if (!ok) errors++;
+        // at least 0.3 s of repeats
+        uint32_t iters = 0;
+        t0 = time_ns();
+        uint64_t t;
+        do {
+            scale_frame(&s, pix, d.width, d.height, sx, sy, level);
+            iters++;
+            t = time_ns() - t0;
+        } while (t < 300000000ull);
+        double ms = t / 1e6 / iters;
+        printf("  %2ix%-2i  %-9s %5ix%-5i   %8.3f  %8.0f  %6.2f  %5.1f  %8.3f%s\n",
+            sx, sy, level < 256 ? "yes" : "no", s.out_w, s.out_h, ms, npix / ms / 1e3,
+            npix*sizeof(uint32_t) / ms / 1e6, 20.0 / ms, t_ref/1e6, ok ? "" : "  MISMATCH");
+    }
+    scale_free(&s);
+    dec_free(&d);
+    return errors ? 1 : 0;
+}
+
+    std::vector<uint64_t> pace_pub; // completion time of every frame (simulated)
+    uint64_t pace_t_chunk;          // completion time of transfer being decoded
+
+// (callback) frame is complete when transfer it ends in is
+void pace_on_frame (dec_state*, uint32_t)
+{
+    pace_pub.push_back(pace_t_chunk);
+}
+
+    struct pace_result {
+        uint32_t shown;             // distinct frames painted
+        uint32_t dropped;           // frames never painted
+        uint32_t ticks[4];          // frames shown for 1, 2, 3, 4+ refreshes
+        double   ft_mean, ft_sd, ft_max;    // frame time, ms
+        double   lat_mean, lat_max;         // completion -> refresh it is shown at, ms
+    };
+
+// (helper) run virtual display at refresh hz over frame completion times
+static void pace_simulate (int mode, double hz, double depth, pace_result* r)
+{
+    pace_state p;
+    pace_init(&p, mode, depth);
+    memset(r, 0, sizeof(pace_result));
+    double vsync = 1e9 / hz;
+    size_t nf = pace_pub.size(), fed = 0;
+    uint32_t shown = 0;
+    int any = 0;
+    double t_last = 0, s1 = 0, s2 = 0, l1 = 0;
+    uint32_t nft = 0;
+    for (double t = (double)pace_pub[0]; fed < nf; t += vsync) {
+        while (fed < nf && pace_pub[fed] <= t) pace_frame(&p, (uint32_t)fed, pace_pub[fed]), fed++;
+        if (fed == 0) continue;
+        uint32_t seq;
+        if (mode == PACE_IMMEDIATE) {
+            seq = (uint32_t)fed - 1;
+            if (any && seq == shown) continue;
+        } else if (!pace_pick(&p, (uint64_t)t, &seq)) continue;
+        if (any) {
+            r->dropped += seq - shown - 1;
+            double ft = t - t_last;
+            int k = (int)(ft / vsync + 0.5);
+            r->ticks[k < 1 ? 0 : k > 4 ? 3 : k-1]++;
+            s1 += ft; s2 += ft*ft; nft++;
+            if (ft > r->ft_max) r->ft_max = ft;
+        }
+        double lat = t - pace_pub[seq];
+        l1 += lat;
+        if (lat > r->lat_max) r->lat_max = lat;
+        r->shown++;
+        shown = seq;
+        t_last = t;
+        any = 1;
+    }
+    if (nft) {
+        r->ft_mean = s1 / nft;
+        double var = s2 / nft - r->ft_mean * r->ft_mean;
+        r->ft_sd = var > 0 ? sqrt(var) : 0;
+    }
+    if (r->shown) r->lat_mean = l1 / r->shown;
+    r->ft_mean /= 1e6; r->ft_sd /= 1e6; r->ft_max /= 1e6;
+    r->lat_mean /= 1e6; r->lat_max /= 1e6;
+}
+
+// decode capture as if it came over usb with jittery transfer completion,
+// then compare immediate painting with paced one on display refreshing at hz
+int cmd_pace (const char* in_name, const char* s_hz, const char* s_depth, const char* s_jitter)
+{
+    double hz = s_hz ? atof(s_hz) : 60;
+    double depth = s_depth ? atof(s_depth) : 1.5;
+    double jitter = (s_jitter ? atof(s_jitter) : 4) * 1e6;
+    if (hz < 10 || depth < 0 || depth > DEC_NBUF - 3 || jitter < 0) {
+        fprintf(stderr, "bad refresh rate, depth (0..%i frames) or jitter\n", DEC_NBUF - 3);
+        return 1;
+    }
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return 1;
+    }
+    uint8_t* buf = (uint8_t*) malloc(RLE_BLOCK_RAW);
+    d.on_frame = pace_on_frame;
+    pace_pub.clear();
+    // transfer is done when its last sample is in, plus host side delay up to jitter
+    uint64_t pos = 0, t_prev = 0, rnd = 88172645463325252ull;
+    int n;
+    while (buf && (n = cap_read(&c, buf)) > 0) {
+        for (int i=0; i<n; i+=USB_CHUNK) {
+            uint32_t len = (n - i < USB_CHUNK) ? n - i : USB_CHUNK;
+            pos += len;
+            rnd ^= rnd << 13; rnd ^= rnd >> 7; rnd ^= rnd << 17;
+            uint64_t t = pos * 1000000000ull / SAMPLE_HZ + (uint64_t)((rnd >> 11) * (1.0/9007199254740992.0) * jitter);
+            pace_t_chunk = t_prev = (t > t_prev) ? t : t_prev;
+            dec_bytes(&d, buf + i, len, 0);
+        }
+    }
+    free(buf);
+    cap_close(&c);
+    dec_free(&d);
+    if (pace_pub.size() < 2) {
+        fprintf(stderr, "no complete frames in %s\n", in_name);
+        return 1;
+    }
+    printf("%s: %u frames, %.1f Hz display, %.1f ms jitter, buffered depth %.2f frames\n",
+        in_name, (uint32_t)pace_pub.size(), hz, jitter/1e6, depth);
+    printf("  mode        shown dropped  1x/2x/3x/4x+ refreshes     frame time mean/sd/max, ms   latency mean/max, ms\n");
+    const char* names[2] = { "immediate", "buffered" };
+    for (int mode=PACE_IMMEDIATE; mode<=PACE_BUFFERED; mode++) {
+        pace_result r;
+        pace_simulate(mode, hz, depth, &r);
+        printf("  %-10s %6u %7u  %6u/%u/%u/%u %10s %8.2f %6.2f %6.2f %14.2f %6.2f\n",
+            names[mode], r.shown, r.dropped, r.ticks[0], r.ticks[1], r.ticks[2], r.ticks[3], "",
+            r.ft_mean, r.ft_sd, r.ft_max, r.lat_mean, r.lat_max);
+    }
+    return 0;
+}
+
+// signal quality report of capture (whole file, at disk speed)
+int cmd_analyze (const char* in_name)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    sig_state* s = new sig_state;
+    sig_init(s, c.mode);
+    std::vector<uint8_t> buf(RLE_BLOCK_RAW);
+    uint64_t t0 = time_ns();
+    int n;
+    while ((n = cap_read(&c, buf.data())) > 0) sig_feed(s, buf.data(), n, 0);
+    uint64_t t = time_ns() - t0;
+    cap_close(&c);
+    if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+    std::vector<char> text(8192);
+    sig_report(s, text.data(), (int)text.size());
+    printf("%s: %s %s, %.1f ms, %.0f MB/s\n%s", in_name, cap_names[c.type], mode_names[c.mode],
+        t/1e6, t ? s->samples*1000.0/t : 0.0, text.data());
+    delete s;
+    return (n < 0) ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Golden frames (regression check of decoder output)
+////////////////////////////////////////////////////////////////////////////////
+
+// golden file has a line per frame: <capture> <config> <frame> <hash of picture>
+// every decoder variant must give exactly these pictures from the capture
+
+    struct check_input {
+        const char* fname;
+        int       mode;
+        std::vector<uint8_t> raw;       // samples as in capture files
+        std::vector<uint8_t> inv;       // same inverted (live usb data)
+        std::vector<uint8_t> rle;       // rle pairs by RLE_BLOCK_RAW blocks
+        std::vector<uint32_t> rle_len;  // encoded length of every block (0 - stored)
+    };
+
+    struct check_config {
+        const char* name;
+        int       palette;
+        int       show_sync;
+        int       bk_only;
+    };
+
+    check_config check_configs[] = {
+        { "color", 1, 0, 0 },
+        { "bw",    0, 0, 1 },           // black & white view of BK, converted after decoding
+        { "sync",  1, 1, 0 },           // sync pulses shown
+    };
+
+    typedef void (*check_fn)(dec_state* d, const check_input* in);
+
+    std::vector<uint64_t> check_hashes;   // picture hashes of current run
+    std::vector<uint32_t> check_bw;       // black & white copy of frame
+
+// (callback) hash picture of every completed frame
+void check_on_frame (dec_state* d, uint32_t n)
+{
+    const uint32_t* p = d->bufs[n];
+    if (d->palette == 0) {
+        memcpy(check_bw.data(), p, d->full*sizeof(uint32_t));
+        dec_to_bw(check_bw.data(), d->full);
+        p = check_bw.data();
+    }
+    check_hashes.push_back(hash64(p, d->full*sizeof(uint32_t)));
+}
+
+// (helper) load whole capture as samples and its derived forms, returns 0 if ok
+static int check_load (check_input* in, const char* fname)
+{
+    cap_reader c;
+    if (open_capture(&c, fname) != 0) return 1;
+    std::vector<uint8_t> chunk(RLE_BLOCK_RAW);
+    int n;
+    while ((n = cap_read(&c, chunk.data())) > 0) in->raw.insert(in->raw.end(), chunk.begin(), chunk.begin() + n);
+    cap_close(&c);
+    if (n < 0) {
+        fprintf(stderr, "broken block in %s\n", fname);
+        return 1;
+    }
+    in->fname = fname;
+    in->mode = c.mode;
+    size_t len = in->raw.size();
+    in->inv.resize(len);
+    for (size_t i=0; i<len; i++) in->inv[i] = in->raw[i] ^ 0xFF;
+    in->rle.resize(len);
+    size_t o = 0;
+    for (size_t i=0; i<len; i+=RLE_BLOCK_RAW) {
+        uint32_t blk = (len - i < RLE_BLOCK_RAW) ? (uint32_t)(len - i) : RLE_BLOCK_RAW;
+        uint32_t e = rle_encode(&in->raw[i], blk, &in->rle[o]);
+        if (e == 0) memcpy(&in->rle[o], &in->raw[i], blk);
+        in->rle_len.push_back(e);
+        o += e ? e : blk;
+    }
+    in->rle.resize(o);
+    return 0;
+}
+
+// samples in transfer sized chunks (reference, golden values are made with it)
+static void check_scalar (dec_state* d, const check_input* in)
+{
+    size_t n = in->raw.size();
+    for (size_t i=0; i<n; i+=USB_CHUNK)
+        dec_bytes(d, &in->raw[i], (n - i < USB_CHUNK) ? (uint32_t)(n - i) : USB_CHUNK, 0);
+}
+
+// inverted samples as they come from usb
+static void check_inv (dec_state* d, const check_input* in)
+{
+    size_t n = in->inv.size();
+    for (size_t i=0; i<n; i+=USB_CHUNK)
+        dec_bytes(d, &in->inv[i], (n - i < USB_CHUNK) ? (uint32_t)(n - i) : USB_CHUNK, 0xFF);
+}
+
+// chunks of odd sizes, so sync pulses and frame ends fall on chunk boundaries
+static void check_chunks (dec_state* d, const check_input* in)
+{
+    static const uint32_t sizes[] = { 1, 7, 61, 509, 4093, 65521 };
+    size_t n = in->raw.size();
+    size_t i = 0;
+    for (int k=0; i<n; k++) {
+        uint32_t len = sizes[k % 6];
+        if (len > n - i) len = (uint32_t)(n - i);
+        dec_bytes(d, &in->raw[i], len, 0);
+        i += len;
+    }
+}
+
+// runs of rle blocks (fx2tool pack, recorder)
+static void check_rle (dec_state* d, const check_input* in)
+{
+    const uint8_t* p = in->rle.data();
+    size_t left = in->raw.size();
+    for (size_t b=0; b<in->rle_len.size(); b++) {
+        uint32_t raw_len = (left < RLE_BLOCK_RAW) ? (uint32_t)left : RLE_BLOCK_RAW;
+        uint32_t e = in->rle_len[b];
+        if (e) rle_feed(d, p, e);
+        else dec_bytes(d, p, raw_len, 0);
+        p += e ? e : raw_len;
+        left -= raw_len;
+    }
+}
+
+// memory mapped file (fx2tool replay, headless replay)
+static void check_mapped (dec_state* d, const check_input* in)
+{
+    cap_map m;
+    if (map_open(&m, in->fname) != 0) return;
+    int error;
+    map_replay(&m, d, &error);
+    map_close(&m);
+}
+
+// seekable container (fx2tool index, frames, export) - every frame decoded on its
+// own from index, numbering must be the same as in sequential decoding
+static void check_cont (dec_state* d, const check_input* in)
+{
+    std::string name = std::string(in->fname) + ".check.fx2c";
+    cont_writer w;
+    if (cont_create(&w, name.c_str(), in->mode, 0) != 0) return;
+    size_t n = in->raw.size();
+    for (size_t i=0; i<n; i+=RLE_BLOCK_RAW)
+        cont_write(&w, &in->raw[i], (n - i < RLE_BLOCK_RAW) ? (uint32_t)(n - i) : RLE_BLOCK_RAW, 0);
+    cont_reader c;
+    if (cont_close(&w) == 0 && cont_open(&c, name.c_str()) == 0) {
+        // only the frame asked for is hashed
+        dec_frame_fn on_frame = d->on_frame;
+        d->on_frame = NULL;
+        std::vector<uint8_t> tmp(RLE_BLOCK_RAW);
+        for (uint32_t k=0; k<cont_dec_frames(&c); k++) {
+            int b = cont_decode_seq(&c, d, k, tmp.data());
+            if (b < 0) break;
+            on_frame(d, b);
+        }
+        d->on_frame = on_frame;
+        cont_close_reader(&c);
+    }
+    remove(name.c_str());
+}
+
+    struct check_variant {
+        const char* name;
+        check_fn  fn;
+    };
+
+    check_variant check_variants[] = {
+        { "scalar", check_scalar },
+        { "inv",    check_inv },
+        { "chunks", check_chunks },
+        { "rle",    check_rle },
+        { "mapped", check_mapped },
+        { "fx2c",   check_cont },
+    };
+
+// (helper) decode input with variant and config from power-on state, hashes to check_hashes
+static void check_run (dec_state* d, const check_input* in, const check_variant* v, const check_config* cfg)
+{
+    d->n_cur = 0;
+    d->seq = 0;
+    d->cur_addr = 0;
+    d->lsync_cnt = 0;
+    d->palette = (uint8_t)cfg->palette;
+    d->show_sync = (uint8_t)cfg->show_sync;
+    d->on_frame = check_on_frame;
+    // first frame is partly left from previous run otherwise
+    for (uint32_t i=0; i<d->nbuf; i++) memset(d->bufs[i], 0, SCR_MAXBUF*sizeof(uint32_t));
+    check_hashes.clear();
+    v->fn(d, in);
+}
+
+// write golden picture hashes of captures (reference variant, every config)
+int cmd_golden (const char* out_name, int ncaps, char** caps)
+{
+    FILE* f = fopen(out_name, "w");
+    if (f == NULL) {
+        fprintf(stderr, "unable to create %s\n", out_name);
+        return 1;
+    }
+    fprintf(f, "# golden frames: <capture> <config> <frame> <picture hash>\n");
+    fprintf(f, "# check with 'fx2tool check %s', made with 'fx2tool golden'\n", out_name);
+    check_bw.resize(SCR_MAXBUF);
+    for (int i=0; i<ncaps; i++) {
+        check_input in;
+        dec_state d;
+        if (check_load(&in, caps[i]) != 0) { fclose(f); return 1; }
+        if (dec_init(&d, in.mode) != 0) {
+            fprintf(stderr, "unable to allocate screen buffers\n");
+            fclose(f);
+            return 1;
+        }
+        for (size_t k=0; k<sizeof(check_configs)/sizeof(check_configs[0]); k++) {
+            const check_config* cfg = &check_configs[k];
+            if (cfg->bk_only && in.mode != MODE_BK) continue;
+            check_run(&d, &in, &check_variants[0], cfg);
+            for (size_t n=0; n<check_hashes.size(); n++)
+                fprintf(f, "%s %s %u %016llx\n", caps[i], cfg->name, (unsigned)n, (unsigned long long)check_hashes[n]);
+            printf("%s %s: %u frames\n", caps[i], cfg->name, (unsigned)check_hashes.size());
+        }
+        dec_free(&d);
+    }
+    int err = ferror(f);
+    fclose(f);
+    if (err) fprintf(stderr, "unable to write %s\n", out_name);
+    return err ? 1 : 0;
+}
+
+// (helper) every decoder color through y4m conversion and back, returns colors off
+// by more than rounding (chroma must not wrap around)
+static int check_y4m_colors (int* ncolors)
+{
+    std::vector<uint32_t> colors(palette_data, palette_data + sizeof(palette_data)/sizeof(palette_data[0]));
+    colors.insert(colors.end(), palette_uknc, palette_uknc + 16);
+    colors.push_back(0xFFFFFF);     // black & white
+    int bad = 0;
+    for (size_t i=0; i<colors.size(); i++) {
+        uint8_t y, u, v;
+        vid_yuv(colors[i], &y, &u, &v);
+        double rgb[3] = { y + 1.402*(v-128), y - 0.344136*(u-128) - 0.714136*(v-128), y + 1.772*(u-128) };
+        for (int k=0; k<3; k++) {
+            int want = (colors[i] >> (16 - 8*k)) & 0xFF;
+            double got = rgb[k] < 0 ? 0 : rgb[k] > 255 ? 255 : rgb[k];
+            if (got < want - 3 || got > want + 3) {
+                printf("y4m color %06x: yuv %u,%u,%u comes back %.0f,%.0f,%.0f\n", colors[i], y, u, v, rgb[0], rgb[1], rgb[2]);
+                bad++;
+                break;
+            }
+        }
+    }
+    *ncolors = (int)colors.size();
+    return bad;
+}
+
+// decode captures of golden file with every variant, returns 0 if every picture matches
+int cmd_check (const char* golden_name)
+{
+    FILE* f = fopen(golden_name, "r");
+    if (f == NULL) {
+        fprintf(stderr, "unable to open %s\n", golden_name);
+        return 1;
+    }
+    // (capture, config) -> hashes in frame order
+    std::vector<std::string> caps, cfgs;
+    std::vector<std::vector<uint64_t> > golden;
+    char line[512], cap[256], cfg[32];
+    unsigned frame;
+    unsigned long long hash;
+    int lineno = 0, bad = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+        if (sscanf(line, "%255s %31s %u %llx", cap, cfg, &frame, &hash) != 4) {
+            fprintf(stderr, "%s:%i: broken line\n", golden_name, lineno);
+            bad = 1;
+            break;
+        }
+        size_t g = golden.size();
+        if (g == 0 || caps[g-1] != cap || cfgs[g-1] != cfg) {
+            caps.push_back(cap);
+            cfgs.push_back(cfg);
+            golden.push_back(std::vector<uint64_t>());
+            g++;
+        }
+        if (frame != golden[g-1].size()) {
+            fprintf(stderr, "%s:%i: frame %u out of order\n", golden_name, lineno, frame);
+            bad = 1;
+            break;
+        }
+        golden[g-1].push_back(hash);
+    }
+    fclose(f);
+    if (bad) return 1;
+    check_bw.resize(SCR_MAXBUF);
+    int failed = 0, runs = 0;
+    size_t g = 0;
+    while (g < golden.size()) {
+        // every config of one capture
+        check_input in;
+        dec_state d;
+        if (check_load(&in, caps[g].c_str()) != 0) return 1;
+        if (dec_init(&d, in.mode) != 0) {
+            fprintf(stderr, "unable to allocate screen buffers\n");
+            return 1;
+        }
+        for (; g < golden.size() && caps[g] == in.fname; g++) {
+            const check_config* c = NULL;
+            for (size_t k=0; k<sizeof(check_configs)/sizeof(check_configs[0]); k++)
+                if (cfgs[g] == check_configs[k].name) c = &check_configs[k];
+            if (c == NULL) {
+                printf("%s %s: unknown config\n", in.fname, cfgs[g].c_str());
+                failed++;
+                continue;
+            }
+            const std::vector<uint64_t>& want = golden[g];
+            for (size_t v=0; v<sizeof(check_variants)/sizeof(check_variants[0]); v++) {
+                check_run(&d, &in, &check_variants[v], c);
+                runs++;
+                size_t n = 0;
+                while (n < want.size() && n < check_hashes.size() && want[n] == check_hashes[n]) n++;
+                if (n == want.size() && n == check_hashes.size()) {
+                    printf("%s %s %s: ok, %u frames\n", in.fname, c->name, check_variants[v].name, (unsigned)n);
+                    continue;
+                }
+                failed++;
+                if (n < want.size() && n < check_hashes.size())
+                    printf("%s %s %s: FAILED, frame %u picture %016llx, golden %016llx\n", in.fname, c->name,
+                        check_variants[v].name, (unsigned)n, (unsigned long long)check_hashes[n], (unsigned long long)want[n]);
+                else
+                    printf("%s %s %s: FAILED, %u frames, golden %u\n", in.fname, c->name,
+                        check_variants[v].name, (unsigned)check_hashes.size(), (unsigned)want.size());
+            }
+        }
+        dec_free(&d);
+    }
+    // video output of the same pictures
+    int ncolors, bad_colors = check_y4m_colors(&ncolors);
+    runs++;
+    if (bad_colors) failed++;
+    printf("y4m colors: %s, %i decoder colors\n", bad_colors ? "FAILED" : "ok", ncolors);
+    printf("%i runs, %i failed\n", runs, failed);
+    return (failed || runs == 0) ? 1 : 0;
+}
+
+
+// shared memory ring client - every frame is hashed in place, no copy
+int cmd_watch (const char* name, const char* s_count)
+{
+    shm_ring r;
+    if (shm_attach(&r, name) != 0) {
+        fprintf(stderr, "no frame ring %s (start fx2head -S %s)\n", name, name);
+        return 1;
+    }
+    const shm_hdr* h = r.hdr;
+    uint32_t count = s_count ? (uint32_t)atoi(s_count) : 0;
+    uint32_t full = h->width * h->height;
+    printf("%s: %s %ux%u, %u slots, producer pid %u\n", name, mode_names[h->mode & 1], h->width, h->height, h->nslots, h->pid);
+    uint32_t next = shm_seq(&r);
+    uint32_t taken = 0, skipped = 0, overwritten = 0;
+    double lag_sum = 0, lag_max = 0;
+    while (count == 0 || taken < count) {
+        uint32_t seq = shm_seq(&r);
+        if (seq == next) {
+            if (h->state.load() != SHM_RUNNING) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        // fell behind more than ring holds - go on from newest frame
+        if (seq - next > h->nslots - 2) {
+            skipped += seq - 1 - next;
+            next = seq - 1;
+        }
+        uint32_t k = next++;
+        const uint32_t* pix = shm_frame(&r, k);
+        if (pix == NULL) { skipped++; continue; }
+        uint64_t t_pub = h->slot_t_ns[k & (h->nslots-1)];
+        uint64_t hash = hash64(pix, full*sizeof(uint32_t));
+        double lag = (time_ns() - t_pub) / 1e6;
+        if (!shm_still_valid(&r, k)) { overwritten++; continue; }
+        printf("frame %u: picture %016llx, %.3f ms after publish\n", k, (unsigned long long)hash, lag);
+        lag_sum += lag;
+        if (lag > lag_max) lag_max = lag;
+        taken++;
+    }
+    printf("%u frames, %u skipped, %u overwritten while read, lag %.3f ms mean, %.3f ms max\n",
+        taken, skipped, overwritten, taken ? lag_sum / taken : 0.0, lag_max);
+    shm_detach(&r);
+    return 0;
+}
+
+// (helper) read exactly len bytes, 0 if ok
+static int recv_all (net_sock fd, uint8_t* p, size_t len)
+{
+    while (len > 0) {
+        int n = recv(fd, (char*)p, (int)len, 0);
+        if (n <= 0) return 1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// stream server client - pictures are rebuilt from palette indices, so their hashes are
+// the ones of decoder pictures (fx2tool check, watch)
+int cmd_netwatch (const char* s_port, const char* s_count)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(1, 1), &wsa);
+#endif
+    net_sock fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a.sin_port = htons((uint16_t)atoi(s_port));
+    if (fd == NET_BAD_SOCK || connect(fd, (struct sockaddr*)&a, sizeof(a)) != 0) {
+        fprintf(stderr, "unable to connect to 127.0.0.1:%s (start fx2head -W %s)\n", s_port, s_port);
+        return 1;
+    }
+    send(fd, "FX2\n", 4, 0);
+    uint32_t count = s_count ? (uint32_t)atoi(s_count) : 0;
+    uint32_t pal[NET_MAX_COLORS] = { 0 };
+    std::vector<uint8_t> msg, idx;
+    std::vector<uint32_t> pix;
+    int w = 0, h = 0, bad = 0;
+    uint32_t frames = 0, keys = 0, last_seq = 0;
+    uint64_t bytes = 0, t0 = time_ns();
+    while (count == 0 || frames < count) {
+        uint8_t len4[4];
+        if (recv_all(fd, len4, 4) != 0) break;
+        uint32_t len = len4[0] | len4[1] << 8 | len4[2] << 16 | (uint32_t)len4[3] << 24;
+        if (len < 4 || len > 0x1000000) { bad = 1; break; }
+        msg.resize(len);
+        if (recv_all(fd, msg.data(), len) != 0) break;
+        bytes += 4 + len;
+        const uint8_t* m = msg.data();
+        uint32_t n16 = m[2] | m[3] << 8;
+        if (m[0] == 'P') {
+            for (uint32_t i=0; i<n16 && i<NET_MAX_COLORS && 4+i*4+4 <= len; i++)
+                pal[i] = m[4+i*4] | m[5+i*4] << 8 | m[6+i*4] << 16 | (uint32_t)m[7+i*4] << 24;
+            continue;
+        }
+        uint32_t seq;
+        if (m[0] == 'K') {
+            w = n16;
+            h = m[4] | m[5] << 8;
+            seq = m[8] | m[9] << 8 | m[10] << 16 | (uint32_t)m[11] << 24;
+            if (len != 12 + (size_t)w*h) { bad = 1; break; }
+            idx.assign(m + 12, m + len);
+            keys++;
+        } else if (m[0] == 'D' && w > 0) {
+            seq = m[4] | m[5] << 8 | m[6] << 16 | (uint32_t)m[7] << 24;
+            size_t o = 8;
+            for (uint32_t r=0; r<n16; r++) {
+                if (o + 4 > len) { bad = 1; break; }
+                uint32_t y = m[o] | m[o+1] << 8, lines = m[o+2] | m[o+3] << 8;
+                o += 4;
+                if (y + lines > (uint32_t)h || o + (size_t)lines*w > len) { bad = 1; break; }
+                memcpy(&idx[(size_t)y*w], m + o, (size_t)lines*w);
+                o += (size_t)lines*w;
+            }
+            if (bad) break;
+        } else {
+            bad = 1;
+            break;
+        }
+        pix.resize((size_t)w*h);
+        for (size_t i=0; i<pix.size(); i++) pix[i] = pal[idx[i]];
+        printf("frame %u: picture %016llx, %s %u bytes%s\n", seq, (unsigned long long)hash64(pix.data(), pix.size()*sizeof(uint32_t)),
+            m[0] == 'K' ? "keyframe" : "delta", len, (frames && seq - last_seq > 1) ? " (frames dropped before)" : "");
+        last_seq = seq;
+        frames++;
+    }
+    uint64_t t = time_ns() - t0;
+    net_close_sock(fd);
+    printf("%u frames (%u key), %.2f MB, %.1f KB/s, %.1f frames/s%s\n", frames, keys, bytes / 1048576.0,
+        t ? bytes / 1024.0 * 1e9 / t : 0.0, t ? frames * 1e9 / t : 0.0, bad ? ", broken stream" : "");
+    return bad;
+}
+
+// centering calibration over capture, starting from shift x y (picture of other setup)
+int cmd_center (const char* in_name, const char* s_fields, const char* s_x, const char* s_y)
+{
+    int fields = s_fields ? atoi(s_fields) : DEC_CAL_FIELDS;
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return 1;
+    }
+    if (s_x) dec_set_offset(&d, atoi(s_x), atoi(s_y));
+    int x0 = d.ofs_x, y0 = d.ofs_y;
+    // short captures have less fields than that (first one is skipped)
+    int n;
+    while ((n = cap_feed(&c, &d)) > 0) {}
+    if (fields > (int)d.seq - DEC_CAL_SKIP) fields = (int)d.seq - DEC_CAL_SKIP;
+    cap_close(&c);
+    if (n < 0 || open_capture(&c, in_name) != 0) fields = 0;
+    d.n_cur = d.seq = d.cur_addr = d.lsync_cnt = 0;
+    if (fields > 0) dec_calibrate(&d, fields);
+    while (fields > 0 && (n = cap_feed(&c, &d)) > 0 && d.cal_done == 0) {}
+    if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+    int res = 0;
+    if (d.cal_done == 0) {
+        fprintf(stderr, "%s: no complete frame\n", in_name);
+        res = 1;
+    } else if (!d.cal_lit) {
+        printf("%s: %s, blank screen, shift %i,%i kept\n", in_name, mode_names[d.mode], d.ofs_x, d.ofs_y);
+    } else {
+        printf("%s: %s, %i fields, lit pixels %i..%i x %i..%i at shift %i,%i, moved by %i,%i\n",
+            in_name, mode_names[d.mode], fields, d.cal_x0, d.cal_x1, d.cal_y0, d.cal_y1, x0, y0,
+            d.ofs_x - x0, d.ofs_y - y0);
+        printf("offset_x = %i\noffset_y = %i\n", d.ofs_x, d.ofs_y);
+    }
+    cap_close(&c);
+    dec_free(&d);
+    return res;
+}
+
+    txt_font   text_font;
+    txt_screen text_scr;
+    uint64_t   text_hash, text_ns;
+    uint32_t   text_frames, text_changes, text_unknown;
+    std::vector<uint64_t> text_seen;        // (-u) unknown cells printed
+    std::vector<uint16_t> text_miss;
+
+// (callback) read text of every completed frame, print it when it changes
+void text_on_frame (dec_state* d, uint32_t n)
+{
+    uint64_t t0 = time_ns();
+    txt_read(&text_font, d->bufs[n], d->width, d->height, &text_scr);
+    text_ns += time_ns() - t0;
+    text_frames++;
+    text_unknown += text_scr.unknown;
+    if (text_scr.hash != text_hash) {
+        printf("frame %u: %i cells known, %i unknown\n", d->seq, text_scr.known, text_scr.unknown);
+        txt_print(&text_scr, stdout);
+        text_hash = text_scr.hash;
+        text_changes++;
+    }
+    for (size_t i=0; opt_unknown && i<text_scr.miss.size(); i += text_font.h) {
+        uint64_t h = hash64(&text_scr.miss[i], text_font.h*sizeof(uint16_t));
+        size_t k = 0;
+        while (k < text_seen.size() && text_seen[k] != h) k++;
+        if (k < text_seen.size()) continue;
+        text_seen.push_back(h);
+        text_miss.insert(text_miss.end(), &text_scr.miss[i], &text_scr.miss[i] + text_font.h);
+    }
+}
+
+// read screen text of capture frames with font
+int cmd_text (const char* in_name, const char* font_name)
+{
+    char err[TXT_ERR_SIZE];
+    if (txt_load(&text_font, font_name, err) != 0) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return 1;
+    }
+    d.on_frame = text_on_frame;
+    text_hash = 1;
+    text_ns = 0;
+    text_frames = text_changes = text_unknown = 0;
+    int n;
+    while ((n = cap_feed(&c, &d)) > 0) {}
+    if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+    printf("%s: %u frames, %u text changes, %i glyphs, origin %i,%i, %.3f ms per frame (%.0f frames/s on one core)\n",
+        in_name, text_frames, text_changes, text_font.nglyphs, text_font.ox, text_font.oy,
+        text_frames ? text_ns/1e6/text_frames : 0.0, text_ns ? text_frames*1e9/text_ns : 0.0);
+    if (opt_unknown) {
+        printf("# %u unknown cells, %u different\n", text_unknown, (uint32_t)text_seen.size());
+        for (size_t i=0; i<text_miss.size(); i += text_font.h) txt_print_glyph(&text_font, &text_miss[i], stdout);
+    }
+    cap_close(&c);
+    dec_free(&d);
+    return (n < 0) ? 1 : 0;
+}
+
+    trg_state trig;                 // (events) change trigger
+    uint32_t  trig_first;           // first frame of event
+
+void events_on_start (trg_state* t, const uint32_t*, uint32_t k)
+{
+    trig_first = t->ring_n ? t->ring_k[t->ring_first] : k;
+    printf("event %u: change at frame %u, %u lines\n", t->events, k, t->changed_lines);
+}
+
+void events_on_stop (trg_state* t, uint32_t k)
+{
+    printf("event %u: frames %u..%u recorded\n", t->events, trig_first, k);
+}
+
+void events_on_frame (dec_state* d, uint32_t n)
+{
+    noise_frame(d, n);
+    trg_frame(&trig, d->bufs[n], d->seq);
+}
+
+// change trigger over capture frames
+int cmd_events (const char* in_name, const char* s_lines, const char* s_pre, const char* s_post)
+{
+    cap_reader c;
+    if (open_capture(&c, in_name) != 0) return 1;
+    dec_state d;
+    if (dec_init(&d, c.mode) != 0) {
+        fprintf(stderr, "unable to allocate screen buffers\n");
+        cap_close(&c);
+        return 1;
+    }
+    if (noise_init(&d) != 0 || trg_init(&trig, d.width, d.height, s_lines ? atoi(s_lines) : 1,
+            s_pre ? atoi(s_pre) : 25, s_post ? atoi(s_post) : 50) != 0) {
+        fprintf(stderr, "unable to allocate change trigger\n");
+        cap_close(&c);
+        dec_free(&d);
+        return 1;
+    }
+    trig.on_start = events_on_start;
+    trig.on_stop = events_on_stop;
+    d.on_frame = events_on_frame;
+    int n;
+    while ((n = cap_feed(&c, &d)) > 0) {}
+    if (n < 0) fprintf(stderr, "broken block at sample %llu of %s\n", (unsigned long long)c.raw_pos, in_name);
+    trg_finish(&trig);
+    printf("%s: %u frames, %u events (%i+ lines changed, %i frames pre-roll, %i post-roll), %u frames recorded (%.1f%%),"
+        " %.3f ms per frame\n", in_name, trig.frames_in, trig.events, trig.lines, trig.pre, trig.post, trig.frames_out,
+        trig.frames_in ? trig.frames_out*100.0/trig.frames_in : 0.0, trig.frames_in ? trig.ns/1e6/trig.frames_in : 0.0);
+    noise_report(stdout);
+    flt_free(&noise);
+    trg_free(&trig);
+    cap_close(&c);
+    dec_free(&d);
+    return (n < 0) ? 1 : 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Main
+////////////////////////////////////////////////////////////////////////////////
+
+void usage ()
+{
+    printf("usage:\n"
+        "  fx2tool pack   <in> <out.rle> [-m bk|uknc]   compress capture to rle\n"
+        "  fx2tool unpack <in.rle> <out.bin>            expand rle capture to raw samples\n"
+        "  fx2tool decode <in> [-m bk|uknc] [-N 3|5]    decode capture, print frames hash and speed\n"
+        "  fx2tool index  <in> <out.fx2c> [-m bk|uknc]  convert capture to seekable container\n"
+        "  fx2tool verify <in.fx2c>                     check container integrity without decoding\n"
+        "  fx2tool frames <in.fx2c> [first [count]] [-j threads]  decode indexed frames range in parallel\n"
+        "  fx2tool replay <in> [-m bk|uknc]             decode memory mapped capture, print speed\n"
+        "  fx2tool synth  <in> <out.bin> <MB>           make long synthetic capture repeating one field of in\n"
+        "  fx2tool video  <in> <out|-|\"|cmd\"> [first [count]] [-f y4m|raw|gif|apng]\n"
+        "                                               decode capture to video file, stdout or pipe, or animation\n"
+        "  -N 3|5 (decode, video, events)               temporal noise filter, pixel majority over last 3 or 5 frames\n"
+        "  fx2tool export <in> <out%%05u.png|qoi|bmp> [first [count]] [-n every] [-j threads]  frames to images\n"
+        "  fx2tool scale  <in>                          benchmark presentation kernel (integer scaling, scanlines)\n"
+        "  fx2tool pace   <in> [hz [depth [jitter_ms]]] simulate display pacing of capture, immediate vs buffered\n"
+        "  fx2tool analyze <in> [-m bk|uknc]            signal quality: sync pulses, line/frame periods, clock, pins\n"
+        "  fx2tool check  [golden.txt]                  decode captures of golden file with every decoder variant\n"
+        "                                               (fx2c one seeks every frame through index), fail on any\n"
+        "                                               picture different from golden (test/golden.txt),\n"
+        "                                               and on decoder colors y4m conversion does not keep\n"
+        "  fx2tool golden <out.txt> <in>...             write golden picture hashes of captures\n"
+        "  fx2tool watch  <name> [frames]               read frames of shared memory ring (fx2head -S name) in place,\n"
+        "                                               print their hashes and how late they were taken\n"
+        "  fx2tool netwatch <port> [frames]             plain tcp client of stream server (fx2head -W port), rebuilds\n"
+        "                                               frames from keyframe and changed lines, prints their hashes\n"
+        "  fx2tool center <in> [fields [x y]]           centering calibration over capture from picture shift x y\n"
+        "                                               if given (other setup), prints shift to put in config\n"
+        "  fx2tool text   <in> <font.txt> [-u]          read screen text of frames with font, print it when it changes,\n"
+        "                                               -u - unknown cells as glyph lines for font file\n"
+        "  fx2tool events <in> [lines [pre [post]]]     change trigger: frame ranges recorded with pre/post roll frames\n"
+        "                                               (1 line, 25, 50 by default), -N as decode\n");
+}
+
+int main (int argc, char** argv)
+{
+    if (argc < 2) { usage(); return 1; }
+    const char* cmd = argv[1];
+    if (parse_options(argc-2, argv+2) != 0) return 1;
+    if (strcmp(cmd, "pack") == 0 && opt_nargs == 2) return cmd_pack(opt_args[0], opt_args[1]);
+    if (strcmp(cmd, "unpack") == 0 && opt_nargs == 2) return cmd_unpack(opt_args[0], opt_args[1]);
+    if (strcmp(cmd, "decode") == 0 && opt_nargs == 1) return cmd_decode(opt_args[0]);
+    if (strcmp(cmd, "index") == 0 && opt_nargs == 2) return cmd_index(opt_args[0], opt_args[1]);
+    if (strcmp(cmd, "verify") == 0 && opt_nargs == 1) return cmd_verify(opt_args[0]);
+    if (strcmp(cmd, "frames") == 0 && opt_nargs >= 1 && opt_nargs <= 3)
+        return cmd_frames(opt_args[0], opt_nargs > 1 ? opt_args[1] : NULL, opt_nargs > 2 ? opt_args[2] : NULL);
+    if (strcmp(cmd, "replay") == 0 && opt_nargs == 1) return cmd_replay(opt_args[0]);
+    if (strcmp(cmd, "synth") == 0 && opt_nargs == 3) return cmd_synth(opt_args[0], opt_args[1], opt_args[2]);
+    if (strcmp(cmd, "video") == 0 && opt_nargs >= 2 && opt_nargs <= 4)
+        return cmd_video(opt_args[0], opt_args[1], opt_nargs > 2 ? opt_args[2] : NULL, opt_nargs > 3 ? opt_args[3] : NULL);
+    if (strcmp(cmd, "export") == 0 && opt_nargs >= 2 && opt_nargs <= 4)
+        return cmd_export(opt_args[0], opt_args[1], opt_nargs > 2 ? opt_args[2] : NULL, opt_nargs > 3 ? opt_args[3] : NULL);
+    if (strcmp(cmd, "scale") == 0 && opt_nargs == 1) return cmd_scale(opt_args[0]);
+    if (strcmp(cmd, "analyze") == 0 && opt_nargs == 1) return cmd_analyze(opt_args[0]);
+    if (strcmp(cmd, "check") == 0 && opt_nargs <= 1) return cmd_check(opt_nargs ? opt_args[0] : "test/golden.txt");
+    if (strcmp(cmd, "golden") == 0 && opt_nargs >= 2) return cmd_golden(opt_args[0], opt_nargs-1, opt_args+1);
+    if (strcmp(cmd, "watch") == 0 && opt_nargs >= 1 && opt_nargs <= 2) return cmd_watch(opt_args[0], opt_args[1]);
+    if (strcmp(cmd, "netwatch") == 0 && opt_nargs >= 1 && opt_nargs <= 2) return cmd_netwatch(opt_args[0], opt_args[1]);
+    if (strcmp(cmd, "center") == 0 && (opt_nargs == 1 || opt_nargs == 2 || opt_nargs == 4))
+        return cmd_center(opt_args[0], opt_args[1], opt_args[2], opt_args[3]);
+    if (strcmp(cmd, "text") == 0 && opt_nargs == 2) return cmd_text(opt_args[0], opt_args[1]);
+    if (strcmp(cmd, "events") == 0 && opt_nargs >= 1 && opt_nargs <= 4)
+        return cmd_events(opt_args[0], opt_args[1], opt_args[2], opt_args[3]);
+    if (strcmp(cmd, "pace") == 0 && opt_nargs >= 1 && opt_nargs <= 4)
+        return cmd_pace(opt_args[0], opt_args[1], opt_args[2], opt_args[3]);
+    usage();
+    return 1;
+}
@@ -0,0 +1,154 @@
+// pipeline timeline tracing - begin/end and instant events of every thread,
+// dumped as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// every thread appends to its own event buffer (single writer, no locks), dump reads
+// events published so far; when tracing is off every call is one load and branch
+// buffers are allocated at first event of a thread, full buffer stops recording of that thread
+
+#ifndef FX2TRACE_H
+#define FX2TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include "fx2stat.h"
+
+#define TRACE_MAX_THREADS   16
+#define TRACE_EVENTS        0x40000     // per thread, about 4 minutes of usb + display events
+
+struct trace_event {
+    uint64_t  ts;                   // time_ns()
+    const char* name;               // static string
+    uint32_t  arg;
+    char      ph;                   // 'B' begin, 'E' end, 'i' instant
+};
+
+struct trace_buf {
+    trace_event* ev;
+    std::atomic<uint32_t> count;    // events published (written before count)
+    uint32_t  dropped;
+    char      name[16];
+};
+
+    std::atomic<int> trace_on(0);
+    trace_buf trace_bufs[TRACE_MAX_THREADS];
+    std::atomic<int> trace_nbufs(0);
+    uint64_t trace_t0;
+    thread_local trace_buf* trace_cur = NULL;
+    thread_local const char* trace_cur_name = NULL;
+    thread_local int trace_no_buf = 0;    // no free slot or memory for this thread
+
+
+// (helper) calling thread's buffer, NULL if there is none
+static trace_buf* trace_self ()
+{
+    if (trace_cur == NULL) {
+        if (trace_no_buf) return NULL;
+        trace_no_buf = 1;
+        int i = trace_nbufs.load();
+        do {
+            if (i >= TRACE_MAX_THREADS) return NULL;
+        } while (!trace_nbufs.compare_exchange_weak(i, i+1));
+        trace_buf* b = &trace_bufs[i];
+        b->ev = (trace_event*) malloc(TRACE_EVENTS * sizeof(trace_event));
+        if (b->ev == NULL) return NULL;
+        trace_no_buf = 0;
+        if (trace_cur_name) strncpy(b->name, trace_cur_name, sizeof(b->name)-1);
+        else snprintf(b->name, sizeof(b->name), "thread%u", (unsigned)i & 0xFF);
+        trace_cur = b;
+    }
+    return trace_cur;
+}
+
+// (helper) append event
+static void trace_put (char ph, const char* name, uint32_t arg)
+{
+    trace_buf* b = trace_self();
+    if (b == NULL) return;
+    uint32_t n = b->count.load(std::memory_order_relaxed);
+    if (n >= TRACE_EVENTS) { b->dropped++; return; }
+    trace_event* e = &b->ev[n];
+    e->ts = time_ns();
+    e->name = name;
+    e->arg = arg;
+    e->ph = ph;
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+static inline void trace_begin (const char* name, uint32_t arg = 0)
+{
+    if (trace_on.load(std::memory_order_relaxed)) trace_put('B', name, arg);
+}
+
+static inline void trace_end (const char* name)
+{
+    if (trace_on.load(std::memory_order_relaxed)) trace_put('E', name, 0);
+}
+
+static inline void trace_instant (const char* name, uint32_t arg = 0)
+{
+    if (trace_on.load(std::memory_order_relaxed)) trace_put('i', name, arg);
+}
+
+// name calling thread in timeline (static string, before its first event)
+static void trace_thread (const char* name)
+{
+    trace_cur_name = name;
+    if (trace_cur) strncpy(trace_cur->name, name, sizeof(trace_cur->name)-1);
+}
+
+// start new recording (events of previous one are forgotten)
+static void trace_start ()
+{
+    trace_on = 0;
+    int n = trace_nbufs.load();
+    for (int i=0; i<n && i<TRACE_MAX_THREADS; i++) {
+        trace_bufs[i].count.store(0, std::memory_order_release);
+        trace_bufs[i].dropped = 0;
+    }
+    trace_t0 = time_ns();
+    trace_on = 1;
+}
+
+static void trace_stop ()
+{
+    trace_on = 0;
+}
+
+// write events recorded so far as Chrome trace JSON, returns events count or -1
+// (safe while threads still record - events published after the snapshot are left out)
+static int trace_dump (const char* fname)
+{
+    FILE* f = fopen(fname, "w");
+    if (f == NULL) return -1;
+    int nb = trace_nbufs.load();
+    if (nb > TRACE_MAX_THREADS) nb = TRACE_MAX_THREADS;
+    int total = 0;
+    uint32_t dropped = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"fx2\"}}");
+    for (int i=0; i<nb; i++) {
+        trace_buf* b = &trace_bufs[i];
+        uint32_t n = b->count.load(std::memory_order_acquire);
+        dropped += b->dropped;
+        fprintf(f, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}", i+1, b->name);
+        for (uint32_t k=0; k<n; k++) {
+            const trace_event* e = &b->ev[k];
+            if (e->ts < trace_t0) continue;
+            double us = (e->ts - trace_t0) / 1000.0;
+            if (e->ph == 'E')
+                fprintf(f, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%i,\"ts\":%.3f}", i+1, us);
+            else
+                fprintf(f, ",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"name\":\"%s\"%s,\"args\":{\"n\":%u}}",
+                    e->ph, i+1, us, e->name, e->ph == 'i' ? ",\"s\":\"t\"" : "", e->arg);
+            total++;
+        }
+    }
+    fprintf(f, "\n],\"otherData\":{\"dropped_events\":%u}}\n", dropped);
+    int err = ferror(f);
+    fclose(f);
+    return err ? -1 : total;
+}
+
+#endif
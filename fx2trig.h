@@ -0,0 +1,156 @@
+// change trigger - records only stretches of frames where screen changes, for long
+// unattended sessions: per line hashes of every frame are compared with previous frame,
+// frame with at least `lines` changed lines starts an event (or keeps it going), event
+// ends after `post` frames without change; up to `pre` frames before the change are
+// kept and go first, so event shows what was on screen just before it
+// quiet frames which did not change at all share one copy in pre-roll, so memory is
+// one frame while screen stands still (pre frames at most)
+// frames of events go to on_frame callback (video file, dumps), nothing else costs
+// more than hashing a frame
+// (header only, used from fx2head.cpp and fx2tool.cpp)
+
+#ifndef FX2TRIG_H
+#define FX2TRIG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "fx2cap.h"
+#include "fx2stat.h"
+
+#define TRG_MAXPRE      500         // pre-roll frames (10 s)
+
+struct trg_state {
+    int       width;
+    int       height;
+    int       lines;                // changed lines which make a change
+    int       pre;                  // frames kept before change
+    int       post;                 // frames recorded after last change
+    uint64_t* hash;                 // per line hash of previous frame
+    int       have_prev;
+    // pre-roll - ring of frames, each refers to copy in slot
+    uint32_t* slot[TRG_MAXPRE];
+    int       slot_ref[TRG_MAXPRE];
+    int       ring_slot[TRG_MAXPRE];
+    uint32_t  ring_k[TRG_MAXPRE];
+    int       ring_first;
+    int       ring_n;
+    int       recording;            // inside event
+    int       quiet;                // frames without change since last one (recording)
+    uint32_t  last_k;
+    uint32_t  changed_lines;        // of last frame
+    uint32_t  events;
+    uint32_t  frames_in;
+    uint32_t  frames_out;           // frames recorded
+    uint64_t  ns;                   // spent detecting changes
+    void*     user;
+    void    (*on_start) (trg_state* t, const uint32_t* pix, uint32_t k);  // frame k made event
+    void    (*on_frame) (trg_state* t, const uint32_t* pix, uint32_t k);  // record frame k
+    void    (*on_stop) (trg_state* t, uint32_t k);                        // k was last frame
+};
+
+
+// set up for frames of width x height, returns 0 if ok
+static int trg_init (trg_state* t, int width, int height, int lines, int pre, int post)
+{
+    memset(t, 0, sizeof(trg_state));
+    t->width = width;
+    t->height = height;
+    t->lines = (lines < 1) ? 1 : lines;
+    t->pre = (pre < 0) ? 0 : (pre > TRG_MAXPRE) ? TRG_MAXPRE : pre;
+    t->post = (post < 0) ? 0 : post;
+    t->hash = (uint64_t*) calloc(height, sizeof(uint64_t));
+    return (t->hash == NULL) ? 1 : 0;
+}
+
+static void trg_free (trg_state* t)
+{
+    for (int i=0; i<TRG_MAXPRE; i++) { free(t->slot[i]); t->slot[i] = NULL; }
+    free(t->hash);
+    t->hash = NULL;
+}
+
+// (helper) drop oldest pre-roll frame
+static void trg_pop (trg_state* t)
+{
+    t->slot_ref[t->ring_slot[t->ring_first]]--;
+    t->ring_first = (t->ring_first + 1) % t->pre;
+    t->ring_n--;
+}
+
+// (helper) keep quiet frame k in pre-roll, same as previous one if nothing changed
+static void trg_keep (trg_state* t, const uint32_t* pix, uint32_t k, int same)
+{
+    if (t->pre == 0) return;
+    int s = -1;
+    if (same && t->ring_n > 0) s = t->ring_slot[(t->ring_first + t->ring_n - 1) % t->pre];
+    if (t->ring_n == t->pre) trg_pop(t);
+    if (s < 0) {
+        size_t size = (size_t)t->width * t->height * sizeof(uint32_t);
+        for (s=0; t->slot_ref[s] != 0; s++) ;   // less than pre are taken here
+        if (t->slot[s] == NULL) t->slot[s] = (uint32_t*) malloc(size);
+        if (t->slot[s] == NULL) return;
+        memcpy(t->slot[s], pix, size);
+    }
+    t->slot_ref[s]++;
+    int i = (t->ring_first + t->ring_n) % t->pre;
+    t->ring_slot[i] = s;
+    t->ring_k[i] = k;
+    t->ring_n++;
+}
+
+// (helper) record frame
+static void trg_out (trg_state* t, const uint32_t* pix, uint32_t k)
+{
+    if (t->on_frame) t->on_frame(t, pix, k);
+    t->frames_out++;
+}
+
+// take frame k, returns 1 if it is recorded
+static int trg_frame (trg_state* t, const uint32_t* pix, uint32_t k)
+{
+    uint64_t t0 = time_ns();
+    int changed = 0;
+    for (int y=0; y<t->height; y++) {
+        uint64_t h = hash64(pix + (size_t)y * t->width, t->width * sizeof(uint32_t));
+        if (h != t->hash[y]) { t->hash[y] = h; changed++; }
+    }
+    if (!t->have_prev) changed = 0;         // nothing to compare first frame with
+    t->have_prev = 1;
+    t->changed_lines = changed;
+    t->frames_in++;
+    t->last_k = k;
+    t->ns += time_ns() - t0;
+    int change = (changed >= t->lines);
+    if (!t->recording) {
+        if (!change) {
+            trg_keep(t, pix, k, changed == 0);
+            return 0;
+        }
+        t->recording = 1;
+        t->events++;
+        if (t->on_start) t->on_start(t, pix, k);
+        for (; t->ring_n > 0; trg_pop(t)) {
+            int i = t->ring_first;
+            trg_out(t, t->slot[t->ring_slot[i]], t->ring_k[i]);
+        }
+        t->ring_first = 0;
+    }
+    trg_out(t, pix, k);
+    t->quiet = change ? 0 : t->quiet + 1;
+    if (t->quiet >= t->post) {
+        t->recording = 0;
+        if (t->on_stop) t->on_stop(t, k);
+    }
+    return 1;
+}
+
+// end of frames - close event if it is still going
+static void trg_finish (trg_state* t)
+{
+    if (!t->recording) return;
+    t->recording = 0;
+    if (t->on_stop) t->on_stop(t, t->last_k);
+}
+
+#endif
@@ -0,0 +1,343 @@
+// character-cell text extraction (screen OCR) - picture is cut into cells of glyph
+// size, every cell becomes a bitmap of its lit pixels (not background color) and is
+// looked up in a hash table of font glyphs and their inverse (cursor), so a screen
+// costs one pass over its pixels and one hash lookup per non-blank cell
+// font is a text file (# starts a comment):
+//   cell 8 10           glyph width and height in font pixels (up to 16 x 16)
+//   pixel 2 1           pixel clocks per font pixel, lines per font row (BK 32 columns - 2,
+//                       BK 64 columns black & white - 1, UKNC - 1), 1 1 by default
+//   lsb                 (optional) leftmost pixel is bit 0 of row like in ROM dumps,
+//                       top bit (of cell width) by default
+//   background 0x000000 (optional) color of unlit pixels, black by default
+//   origin 128 30       (optional) pixel clock and line of first cell, found on first
+//                       frame with text if not given (txt_align)
+//   glyph A 7C 82 ...   text of glyph (utf-8 character, U+XXXX code point or "space")
+//                       and its rows in hex, top row first
+// (header only, shared by fx2tool.cpp and fx2head.cpp)
+
+#ifndef FX2TXT_H
+#define FX2TXT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "fx2dec.h"
+#include "fx2cap.h"
+
+#define TXT_MAXW        16          // glyph width, bits of row
+#define TXT_MAXH        16          // glyph height, rows
+#define TXT_MAXCOLS     128         // cells in text row (800 / 8 at most)
+#define TXT_SLOTS       4096        // glyph table (power of 2, at most 3/4 full)
+#define TXT_UNKNOWN     "?"         // text of cell not in font
+#define TXT_ALIGN_WAIT  50          // frames to skip after picture with no text to align on
+
+#define TXT_ERR_SIZE    256         // err buffers hold that much at least
+
+struct txt_glyph {
+    uint16_t  rows[TXT_MAXH];       // lit pixels, leftmost is top bit of width
+    char      text[7];              // utf-8
+    uint8_t   used;                 // 1 - glyph, 2 - inverse of glyph
+};
+
+struct txt_font {
+    int       w, h;                 // cell, font pixels
+    int       sx, sy;               // pixel clocks and lines per font pixel
+    int       ox, oy;               // first cell in picture, ox < 0 - not aligned yet
+    int       lsb;                  // rows in file are bit 0 leftmost
+    int       align_wait;           // frames left until next txt_align try
+    uint32_t  background;
+    int       nglyphs;              // as in file
+    int       nslots;               // used in table, inverse ones too
+    std::vector<txt_glyph> table;
+};
+
+struct txt_screen {
+    int       cols, rows;
+    int       known;                // non-blank cells found in font
+    int       unknown;              // non-blank cells not in font
+    uint64_t  hash;                 // of text, changes when it does
+    std::vector<char> text;         // rows lines of utf-8, right trimmed, '\n' after each
+    std::vector<uint16_t> miss;     // rows of unknown cells, h per cell (for learning font)
+};
+
+
+// (helper) slot of cell bitmap
+static inline uint32_t txt_slot (const uint16_t* rows, int h)
+{
+    uint64_t x = 0;
+    for (int r=0; r<h; r++) x = (x ^ rows[r]) * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(x >> 40) & (TXT_SLOTS-1);
+}
+
+// glyph of cell bitmap, NULL if it is not in font
+static inline const txt_glyph* txt_find (const txt_font* f, const uint16_t* rows)
+{
+    uint32_t i = txt_slot(rows, f->h);
+    while (f->table[i].used) {
+        if (memcmp(f->table[i].rows, rows, f->h*sizeof(uint16_t)) == 0) return &f->table[i];
+        i = (i + 1) & (TXT_SLOTS-1);
+    }
+    return NULL;
+}
+
+// (helper) add bitmap with its text, first one of same bitmap stays, returns 0 if ok
+static int txt_add (txt_font* f, const uint16_t* rows, const char* text, int used)
+{
+    if (txt_find(f, rows)) return 0;
+    if (f->nslots >= TXT_SLOTS/4*3) return 1;
+    uint32_t i = txt_slot(rows, f->h);
+    while (f->table[i].used) i = (i + 1) & (TXT_SLOTS-1);
+    txt_glyph* g = &f->table[i];
+    memcpy(g->rows, rows, f->h*sizeof(uint16_t));
+    strncpy(g->text, text, sizeof(g->text)-1);
+    g->used = (uint8_t)used;
+    f->nslots++;
+    return 0;
+}
+
+// (helper) glyph text token to utf-8, returns 0 if ok
+static int txt_token (const char* tok, char* out)
+{
+    unsigned long cp;
+    if (strcmp(tok, "space") == 0) cp = ' ';
+    else if ((tok[0] == 'U' || tok[0] == 'u') && tok[1] == '+') {
+        char* end;
+        cp = strtoul(tok+2, &end, 16);
+        if (end == tok+2 || *end != 0 || cp > 0x10FFFF) return 1;
+    } else {
+        if (strlen(tok) > 4) return 1;
+        strcpy(out, tok);
+        return 0;
+    }
+    if (cp < 0x80) { out[0] = (char)cp; out[1] = 0; }
+    else if (cp < 0x800) { out[0] = (char)(0xC0 | cp >> 6); out[1] = (char)(0x80 | (cp & 0x3F)); out[2] = 0; }
+    else if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | cp >> 12); out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F)); out[3] = 0;
+    } else {
+        out[0] = (char)(0xF0 | cp >> 18); out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (char)(0x80 | ((cp >> 6) & 0x3F)); out[3] = (char)(0x80 | (cp & 0x3F)); out[4] = 0;
+    }
+    return 0;
+}
+
+// (helper) reverse low n bits
+static inline uint16_t txt_rev (uint32_t v, int n)
+{
+    uint32_t r = 0;
+    for (int i=0; i<n; i++) r |= ((v >> i) & 1) << (n-1-i);
+    return (uint16_t)r;
+}
+
+// load font file, returns 0 if ok
+static int txt_load (txt_font* f, const char* fname, char* err)
+{
+    f->w = 8; f->h = 10;
+    f->sx = f->sy = 1;
+    f->ox = f->oy = -1;
+    f->background = 0;
+    f->lsb = 0;
+    f->align_wait = 0;
+    f->nglyphs = f->nslots = 0;
+    f->table.assign(TXT_SLOTS, txt_glyph());
+    FILE* fp = fopen(fname, "r");
+    if (fp == NULL) {
+        snprintf(err, TXT_ERR_SIZE, "unable to open font %.160s", fname);
+        return 1;
+    }
+    char line[512];
+    int lineno = 0, res = 0;
+    std::vector<txt_glyph> inv;
+    while (res == 0 && fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = 0;
+        char* tok[TXT_MAXH+2];
+        int n = 0;
+        for (char* t = strtok(line, " \t\r\n"); t && n < TXT_MAXH+2; t = strtok(NULL, " \t\r\n")) tok[n++] = t;
+        if (n == 0) continue;
+        const char* what = NULL;
+        if (strcmp(tok[0], "cell") == 0 && n == 3 && f->nglyphs == 0) {
+            f->w = atoi(tok[1]);
+            f->h = atoi(tok[2]);
+            if (f->w < 1 || f->w > TXT_MAXW || f->h < 1 || f->h > TXT_MAXH) what = "cell size out of range 1..16";
+        } else if (strcmp(tok[0], "pixel") == 0 && (n == 2 || n == 3)) {
+            f->sx = atoi(tok[1]);
+            f->sy = (n == 3) ? atoi(tok[2]) : 1;
+            if (f->sx < 1 || f->sx > 8 || f->sy < 1 || f->sy > 8) what = "pixel size out of range 1..8";
+        } else if (strcmp(tok[0], "lsb") == 0 && n == 1) {
+            f->lsb = 1;
+        } else if (strcmp(tok[0], "background") == 0 && n == 2) {
+            f->background = (uint32_t)strtoul(tok[1], NULL, 0) & 0xFFFFFF;
+        } else if (strcmp(tok[0], "origin") == 0 && n == 3) {
+            f->ox = atoi(tok[1]);
+            f->oy = atoi(tok[2]);
+            if (f->ox < 0 || f->oy < 0) what = "origin out of picture";
+        } else if (strcmp(tok[0], "glyph") == 0 && n == 2 + f->h) {
+            char text[8];
+            uint16_t rows[TXT_MAXH];
+            if (txt_token(tok[1], text) != 0) what = "bad glyph text";
+            for (int r=0; r<f->h && what == NULL; r++) {
+                char* end;
+                unsigned long v = strtoul(tok[2+r], &end, 16);
+                if (*end != 0 || v >> f->w) what = "bad glyph row";
+                rows[r] = f->lsb ? txt_rev((uint32_t)v, f->w) : (uint16_t)v;
+            }
+            if (what == NULL) {
+                uint16_t mask = (uint16_t)((1u << f->w) - 1);
+                int blank = 1;
+                for (int r=0; r<f->h; r++) blank &= (rows[r] == 0);
+                if (!blank && txt_add(f, rows, text, 1) != 0) what = "too many glyphs";
+                // inverse ones go after all glyphs, so glyph wins if it looks the same
+                txt_glyph g;
+                for (int r=0; r<f->h; r++) g.rows[r] = rows[r] ^ mask;
+                memcpy(g.text, text, sizeof(g.text));
+                inv.push_back(g);
+                f->nglyphs++;
+            }
+        } else {
+            what = (strcmp(tok[0], "glyph") == 0) ? "glyph needs text and a row for every line of cell" : "unknown line";
+        }
+        if (what) {
+            snprintf(err, TXT_ERR_SIZE, "%.160s:%i: %s", fname, lineno, what);
+            res = 1;
+        }
+    }
+    fclose(fp);
+    for (size_t i=0; res == 0 && i<inv.size(); i++) {
+        if (txt_add(f, inv[i].rows, inv[i].text, 2) != 0) {
+            snprintf(err, TXT_ERR_SIZE, "%.160s: too many glyphs", fname);
+            res = 1;
+        }
+    }
+    return res;
+}
+
+// (helper) bitmaps of one text row - cols cells starting at line y, pixel clock x
+static void txt_cells (const txt_font* f, const uint32_t* pix, int width, int x, int y, int cols,
+    uint16_t (*cells)[TXT_MAXH])
+{
+    const uint32_t bg = f->background;
+    const int step = f->w * f->sx;
+    for (int r=0; r<f->h; r++) {
+        const uint32_t* p = pix + (size_t)(y + r*f->sy) * width + x;
+        for (int c=0; c<cols; c++, p += step) {
+            uint32_t bits = 0;
+            for (int i=0; i<f->w; i++) bits = (bits << 1) | ((p[i*f->sx] & 0xFFFFFF) != bg);
+            cells[c][r] = (uint16_t)bits;
+        }
+    }
+}
+
+// (helper) count known and unknown non-blank cells with origin ox, oy (distinct unknown ones
+// for alignment - cells cut across characters make up many different bitmaps)
+static void txt_score (const txt_font* f, const uint32_t* pix, int width, int height, int ox, int oy,
+    int* known, int* unknown)
+{
+    uint16_t cells[TXT_MAXCOLS][TXT_MAXH];
+    std::vector<uint64_t> seen;
+    int cols = (width - ox) / (f->w * f->sx), rows = (height - oy) / (f->h * f->sy);
+    if (cols > TXT_MAXCOLS) cols = TXT_MAXCOLS;
+    *known = *unknown = 0;
+    for (int row=0; row<rows; row++) {
+        txt_cells(f, pix, width, ox, oy + row*f->h*f->sy, cols, cells);
+        for (int c=0; c<cols; c++) {
+            uint16_t any = 0;
+            for (int r=0; r<f->h; r++) any |= cells[c][r];
+            if (any == 0) continue;
+            if (txt_find(f, cells[c])) (*known)++;
+            else seen.push_back(hash64(cells[c], f->h*sizeof(uint16_t)));
+        }
+    }
+    std::sort(seen.begin(), seen.end());
+    *unknown = (int)(std::unique(seen.begin(), seen.end()) - seen.begin());
+}
+
+// find origin of cells grid on picture - the one with most cells found in font
+// (fewest different unknown ones if none is), returns 1 if picture has text to tell
+static int txt_align (txt_font* f, const uint32_t* pix, int width, int height)
+{
+    int best = -0x7FFFFFFF, bx = 0, by = 0, bk = 0;
+    for (int oy=0; oy<f->h*f->sy; oy++)
+        for (int ox=0; ox<f->w*f->sx; ox++) {
+            int known, unknown;
+            txt_score(f, pix, width, height, ox, oy, &known, &unknown);
+            if (known == 0 && unknown == 0) return 0;
+            int score = known*4 - unknown;
+            if (score > best) { best = score; bx = ox; by = oy; bk = known; }
+        }
+    if (bk == 0 && f->nglyphs > 0) return 0;
+    f->ox = bx;
+    f->oy = by;
+    return 1;
+}
+
+// read text of picture (aligns font first time, tries again every TXT_ALIGN_WAIT frames
+// while there is no text on screen), unknown cells become TXT_UNKNOWN
+static void txt_read (txt_font* f, const uint32_t* pix, int width, int height, txt_screen* s)
+{
+    uint16_t cells[TXT_MAXCOLS][TXT_MAXH];
+    s->text.clear();
+    s->miss.clear();
+    s->known = s->unknown = 0;
+    s->cols = s->rows = 0;
+    if (f->ox < 0 && (f->align_wait > 0 || txt_align(f, pix, width, height) == 0)) {
+        if (f->align_wait-- <= 0) f->align_wait = TXT_ALIGN_WAIT;
+        s->hash = 0;
+        return;
+    }
+    s->cols = (width - f->ox) / (f->w * f->sx);
+    s->rows = (height - f->oy) / (f->h * f->sy);
+    if (s->cols > TXT_MAXCOLS) s->cols = TXT_MAXCOLS;
+    if (s->cols < 0 || s->rows < 0) s->cols = s->rows = 0;
+    for (int row=0; row<s->rows; row++) {
+        txt_cells(f, pix, width, f->ox, f->oy + row*f->h*f->sy, s->cols, cells);
+        size_t len = s->text.size(), trimmed = len;
+        for (int c=0; c<s->cols; c++) {
+            uint16_t any = 0;
+            for (int r=0; r<f->h; r++) any |= cells[c][r];
+            const char* t = " ";
+            if (any) {
+                const txt_glyph* g = txt_find(f, cells[c]);
+                if (g) {
+                    t = g->text;
+                    s->known++;
+                } else {
+                    t = TXT_UNKNOWN;
+                    s->unknown++;
+                    s->miss.insert(s->miss.end(), cells[c], cells[c] + f->h);
+                }
+            }
+            s->text.insert(s->text.end(), t, t + strlen(t));
+            if (t[0] != ' ' || t[1] != 0) trimmed = s->text.size();
+        }
+        s->text.resize(trimmed);
+        s->text.push_back('\n');
+    }
+    s->hash = hash64(s->text.data(), s->text.size());
+}
+
+// print non-blank lines of screen as "row: text"
+static void txt_print (const txt_screen* s, FILE* out)
+{
+    const char* p = s->text.data();
+    const char* end = p + s->text.size();
+    for (int row=0; p < end; row++) {
+        const char* nl = (const char*) memchr(p, '\n', end - p);
+        if (nl > p) fprintf(out, "%3i: %.*s\n", row, (int)(nl - p), p);
+        p = nl + 1;
+    }
+}
+
+// print unknown cell bitmap as glyph line of font file (to put its text in)
+static void txt_print_glyph (const txt_font* f, const uint16_t* rows, FILE* out)
+{
+    fprintf(out, "glyph ?");
+    for (int r=0; r<f->h; r++) fprintf(out, " %0*X", (f->w + 3) / 4, f->lsb ? txt_rev(rows[r], f->w) : rows[r]);
+    fprintf(out, "\n");
+}
+
+#endif
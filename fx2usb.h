@@ -0,0 +1,214 @@
+// FX2 board access - firmware upload, acquisition start, async bulk transfers
+// (header only, shared by fx2bk.cpp and fx2head.cpp; front end supplies transfer callback)
+
+#ifndef FX2USB_H
+#define FX2USB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include "lib/libusb.h"
+
+#define TR_CHUNK_SIZE   0x20000     // chunk size for async data transferring from fx2
+// sigrok sources say it should hold 10ms of data (and be aligned with 0x200 bytes)
+#define TR_COUNT        4           // transfers in flight
+
+#define VID 0x04B4                  // (0xFFFF:0x2048) for y-salnikov's)
+#define PID 0x8613                  // 
+#define ENDPOINT 0x82
+
+// protocol commands
+#define CMD_START                       0xB1
+#define CMD_START_FLAGS_INV_CLK         0x01
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Data
+////////////////////////////////////////////////////////////////////////////////
+
+    libusb_device_handle* device_h = NULL;
+    const char* fw_filename = "fx2lafw-cypress-fx2.fw";
+
+    int stop = 0;                   // encountered an error somewhere
+    int nactive = 0;                // active transfers count
+    int handled_count = 0;          // count of processed usb bulk transfers
+    int errors_count = 0;           // count of not processed
+
+    char error[1024];
+
+    int tr_chunk_size = TR_CHUNK_SIZE;  // (config) transfer size, rounded down to 0x200
+    int tr_count = TR_COUNT;            // (config) transfers in flight
+
+
+////////////////////////////////////////////////////////////////////////////////
+// FX2 code
+////////////////////////////////////////////////////////////////////////////////
+
+// read/write FX2 RAM (0x40 - write, 0xC0 - read)
+static int fx2_ram_readwrite ( uint16_t addr, uint8_t* buf, uint16_t length, uint8_t command )
+{
+    int chunk_size = 0x1000;
+    while (length > 0)
+    {
+        if (length < chunk_size) chunk_size = length;
+        int res = libusb_control_transfer(device_h, command, 0xA0, addr, 0, buf, chunk_size, 1000);
+        if (res < 0) {
+            sprintf(error, "0x%X (%s) unable to perform operation 0x%X with FX2 (0x%X, 0x%X)", 
+                res, libusb_error_name(res), 
+                command, addr, chunk_size);
+            return res;            
+        }
+        addr += chunk_size;
+        buf += chunk_size;
+        length -= chunk_size;
+    }
+    return 0;
+}
+
+// write data to FX2 RAM 
+static int fx2_ram_write ( uint16_t addr, uint8_t* buf, uint16_t length )
+{
+    return fx2_ram_readwrite(addr, buf, length, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT);
+}
+
+// read data from FX2 RAM
+static int fx2_ram_read ( uint16_t addr, uint8_t* buf, uint16_t length )
+{
+    return fx2_ram_readwrite(addr, buf, length, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_IN );
+}
+
+// put fx2 to stop or run (write 1 or 0 to address 0xE600)
+static int fx2_reset(struct libusb_device_handle *hdl, int is_stop)
+{
+    uint8_t buf[1];
+    buf[0] = is_stop ? 1 : 0;
+    return fx2_ram_write(0xE600, buf, 1);
+}
+
+// send start acquisition control
+static int fx2_send_start ()
+{
+    uint8_t cbuf[3] = {CMD_START_FLAGS_INV_CLK, 0, 0};
+    int res = libusb_control_transfer(device_h, LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_ENDPOINT_OUT, CMD_START, 0, 0, cbuf, 3, 100);
+    if (res < 0) {
+        sprintf(error, "0x%X (%s) unable to start fx2 data polling", res, libusb_error_name(res));
+        return res;
+    }
+    return 0;
+}
+
+// read acquisition data (not async)
+static int fx2_data_read ( uint8_t* buf, uint32_t length)
+{
+    int res, readed;
+    res = libusb_bulk_transfer(device_h, ENDPOINT, buf, length, &readed, 1000);
+    if (res < 0) {
+        sprintf(error, "0x%X (%s) unable to read fx2 data", res, libusb_error_name(res));
+        return res;
+    }
+    return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// USB code
+////////////////////////////////////////////////////////////////////////////////
+
+// close all without even checking for errors
+static void usb_close ()
+{
+    if (device_h) { 
+        libusb_release_interface(device_h, 0); 
+        libusb_close(device_h);
+        // libusb_exit(NULL);
+        device_h = 0; 
+    }
+}
+
+// init libusb, find FX2 device etc.
+static int usb_init (uint16_t vid, uint16_t pid)
+{
+    usb_close();
+    libusb_init(NULL);
+    // libusb_set_option(NULL, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);   
+    device_h = libusb_open_device_with_vid_pid(NULL, vid, pid);
+    if (device_h == NULL) {
+        sprintf(error, "can't find usb device with VID:PID %04x:%04x (or 0xFFFF:0x2048)", VID, PID);
+        return 1;
+    }
+	int res = libusb_set_configuration(device_h, 1);
+    if (res != 0) {
+		sprintf(error, "0x%X (%s) can't set device configuration 1", res, libusb_error_name(res));
+        return 2;
+    }
+    res = libusb_claim_interface(device_h, 0);
+    if (res != 0) {
+		sprintf(error, "0x%X (%s) can't claim interface 0", res, libusb_error_name(res));
+        return 3;
+    }
+    return 0;
+}
+
+// write firmware to fx2 device (restart it)
+static int usb_write_firmware ()
+{
+    // init usb with standard VID:PID for fx2
+    int res = usb_init(VID, PID); // 04B4:8613
+    if (res != 0) {
+        // not found, lets try y-salnikov's modified (and we don't need to change firmware then)
+        if (res == 1) res = usb_init(0xFFFF, 0x2048);
+        if (res == 0) error[0] = 0x00;
+        return res;
+    }
+    // stop device
+    res = fx2_reset(device_h, 1);
+    if (res !=0) return res;
+    // read firmware file and try to write to device RAM
+    FILE* f = fopen(fw_filename, "rb");
+    if (f == NULL) {
+        sprintf(error, "unable to open firmware file %s", fw_filename);
+        return 1;
+    }
+    uint8_t* buf = (uint8_t*) malloc(0x2000);
+    fread(buf, 1, 0x2000, f);
+    res = fx2_ram_write(0, buf, 0x2000);
+    fclose(f);
+    free(buf);
+    if (res != 0) return res;
+    // start device then wait some to reinit usb
+    res = fx2_reset(device_h, 0);
+    if (res != 0) return res;
+    std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+    // init with y-salnikov's now
+    return usb_init(0xFFFF, 0x2048);
+}
+
+// init bulk transfer struct and send it, cb is called on its completion
+static int add_transfer (libusb_transfer_cb_fn cb)
+{
+    int size = (tr_chunk_size < 0x200) ? 0x200 : tr_chunk_size & ~0x1FF;
+    uint8_t *buf = (uint8_t *) malloc(size);
+    struct libusb_transfer *t = libusb_alloc_transfer(0);
+    libusb_fill_bulk_transfer(t, device_h, ENDPOINT, buf, size, cb, (void*)1, 100);
+    int res = libusb_submit_transfer(t);
+    if (res < 0) {
+        sprintf(error, "0x%X (%s) unable to submit usb data transfer", res, libusb_error_name(res));
+        return res;
+    }
+    nactive++;
+    return 0;
+}
+
+// submit tr_count transfers, returns 0 if ok
+static int add_transfers (libusb_transfer_cb_fn cb)
+{
+    for (int i=0; i<tr_count; i++) {
+        int res = add_transfer(cb);
+        if (res != 0) return res;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,196 @@
+// video recording - completed frames to raw (bgr0) or y4m video file or pipe
+// (e.g. "|ffmpeg -i - -c:v libx264 out.mp4"), or to palette-indexed gif / apng file
+// live recording takes frames from decoder buffers ring on its own thread,
+// frames it was not able to take in time are counted as skipped
+
+#ifndef FX2VID_H
+#define FX2VID_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fx2dec.h"
+#include "fx2anim.h"
+#include "fx2met.h"
+#include "fx2trace.h"
+
+#ifdef _WIN32
+#define vid_popen(cmd)  _popen(cmd, "wb")
+#define vid_pclose      _pclose
+#else
+#define vid_popen(cmd)  popen(cmd, "w")
+#define vid_pclose      pclose
+#endif
+
+#define VID_Y4M         0           // yuv4mpeg2, 4:4:4
+#define VID_RAW         1           // raw frames of 32-bit pixels (ffmpeg -f rawvideo -pix_fmt bgr0)
+#define VID_GIF         2           // animated gif (see fx2anim.h)
+#define VID_APNG        3           // animated png, regular files only
+
+struct vid_state {
+    FILE*     f;
+    int       is_pipe;
+    int       format;
+    int       width;
+    int       height;
+    uint32_t* snap;                 // frame copied out of decoder ring
+    uint8_t*  out;                  // converted frame
+    anim_state anim;                // (gif, apng) encoder
+    dec_state* d;                   // (live) decoder we take frames from
+    uint32_t  next_seq;             // (live) next frame to write
+    std::thread th;
+    std::atomic<int> active;
+    std::atomic<uint32_t> frames_written;
+    std::atomic<uint32_t> frames_skipped;
+    int       io_error;
+};
+
+
+// (helper) 0..255 of chroma sum (pure blue and red come out at 256)
+static inline uint8_t vid_clamp (int x)
+{
+    return (uint8_t)((x < 0) ? 0 : (x > 255) ? 255 : x);
+}
+
+// pixel 0x00RRGGBB to bt.601 full range yuv, integer
+static inline void vid_yuv (uint32_t rgb, uint8_t* y, uint8_t* u, uint8_t* v)
+{
+    int r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+    *y = vid_clamp(( 77*r + 150*g +  29*b + 128) >> 8);
+    *u = vid_clamp((-43*r -  85*g + 128*b + 128*256 + 128) >> 8);
+    *v = vid_clamp((128*r - 107*g -  21*b + 128*256 + 128) >> 8);
+}
+
+// open output (name starting with | is a command to pipe to, "-" is stdout), returns 0 if ok
+// (vid_close is needed whatever it returns)
+static int vid_open (vid_state* v, const char* name, int format, int width, int height)
+{
+    // state vid_close works on is set before anything can fail
+    v->format = format;
+    v->width = width;
+    v->height = height;
+    v->frames_written = 0;
+    v->frames_skipped = 0;
+    v->io_error = 0;
+    v->snap = NULL;
+    v->out = NULL;
+    v->anim.pend = NULL;
+    v->anim.next = NULL;
+    v->anim.error = 0;
+    v->is_pipe = 0;
+    if (name[0] == '|') {
+        v->f = vid_popen(name + 1);
+        v->is_pipe = 1;
+    } else if (strcmp(name, "-") == 0) {
+        v->f = stdout;
+    } else {
+        v->f = fopen(name, "wb");
+    }
+    if (v->f == NULL) return 1;
+    if (format == VID_APNG && (v->is_pipe || v->f == stdout)) return 3;
+    v->snap = (uint32_t*) malloc(width*height*sizeof(uint32_t));
+    v->out = (uint8_t*) malloc(width*height*3);
+    if (v->snap == NULL || v->out == NULL) return 2;
+    if (format == VID_Y4M) {
+        // every line is shown twice on screen - pixel aspect 1:2
+        fprintf(v->f, "YUV4MPEG2 W%i H%i F50:1 Ip A1:2 C444 XCOLORRANGE=FULL\n", width, height);
+    }
+    if (format == VID_GIF || format == VID_APNG) {
+        // no pixel aspect in practice - lines are doubled
+        if (anim_open(&v->anim, v->f, format == VID_GIF ? ANIM_GIF : ANIM_APNG, width, height, 2) != 0) return 2;
+    }
+    return 0;
+}
+
+// convert and write one frame of 32-bit pixels
+static void vid_frame (vid_state* v, const uint32_t* pix)
+{
+    int n = v->width * v->height;
+    if (v->format == VID_RAW) {
+        if (fwrite(pix, sizeof(uint32_t), n, v->f) != (size_t)n) v->io_error = 1;
+    } else if (v->format == VID_GIF || v->format == VID_APNG) {
+        anim_frame(&v->anim, pix);
+        if (v->anim.error) v->io_error = 1;
+    } else {
+        // bt.601 full range (tagged in header)
+        uint8_t* py = v->out;
+        uint8_t* pu = v->out + n;
+        uint8_t* pv = v->out + n*2;
+        for (int i=0; i<n; i++) vid_yuv(pix[i], &py[i], &pu[i], &pv[i]);
+        if (fwrite("FRAME\n", 1, 6, v->f) != 6) v->io_error = 1;
+        if (fwrite(v->out, 1, n*3, v->f) != (size_t)n*3) v->io_error = 1;
+    }
+    v->frames_written++;
+}
+
+// (thread) take completed frames from decoder ring as they come
+static void vid_thread_proc (vid_state* v)
+{
+    dec_state* d = v->d;
+    int n = v->width * v->height;
+    met_thread("video");
+    trace_thread("video");
+    while (v->active.load()) {
+        uint32_t seq = d->seq;
+        if (v->next_seq == seq) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        // frame k is in buffer k % nbuf, it is safe while less than
+        // nbuf-1 newer frames are completed
+        if (seq - v->next_seq > d->nbuf - 2) {
+            v->frames_skipped += seq - 1 - v->next_seq;
+            met_add(MET_DROPPED, seq - 1 - v->next_seq);
+            v->next_seq = seq - 1;
+        }
+        uint32_t k = v->next_seq;
+        memcpy(v->snap, d->bufs[k & (d->nbuf-1)], n*sizeof(uint32_t));
+        if (d->seq - k > d->nbuf - 2) {
+            // overwritten while copying
+            v->frames_skipped++;
+            met_add(MET_DROPPED, 1);
+        } else {
+            if (d->palette == 0 && d->mode == MODE_BK) dec_to_bw(v->snap, n);
+            trace_begin("video frame", k);
+            vid_frame(v, v->snap);
+            trace_end("video frame");
+        }
+        v->next_seq = k + 1;
+    }
+}
+
+// start taking frames from decoder (frames completed from now on)
+static void vid_start_live (vid_state* v, dec_state* d)
+{
+    v->d = d;
+    v->next_seq = d->seq;
+    v->active = 1;
+    v->th = std::thread(vid_thread_proc, v);
+}
+
+// stop thread (if any) and close output
+static void vid_close (vid_state* v)
+{
+    v->active = 0;
+    if (v->th.joinable()) v->th.join();
+    if (v->f && (v->format == VID_GIF || v->format == VID_APNG)) {
+        anim_close(&v->anim);
+        if (v->anim.error) v->io_error = 1;
+    }
+    if (v->f) {
+        if (v->is_pipe) vid_pclose(v->f);
+        else if (v->f != stdout) fclose(v->f);
+        else fflush(v->f);
+    }
+    v->f = NULL;
+    free(v->snap);
+    free(v->out);
+    v->snap = NULL;
+    v->out = NULL;
+}
+
+#endif